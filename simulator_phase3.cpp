@@ -4,17 +4,85 @@
 #include <vector>
 #include <array>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <queue>
 #include <deque>
 #include <list>
+#include <map>
 #include <random>
 #include <ctime>
 #include <algorithm>
+#include <numeric>
 #include <chrono>
+#include <iomanip>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#endif
 
 using namespace std;
 
+// One level of a configured cache hierarchy (CACHE_LEVEL and VICTIM_CACHE lines)
+struct CacheLevelConfig {
+    string name;
+    char kind;              // 'I' instructions, 'D' data, 'U' unified
+    int size;               // Bytes
+    int associativity;
+    int latency;            // Cycles
+    bool is_private;        // One instance per core instead of one shared by all
+    string inclusion;       // NON_INCLUSIVE, INCLUSIVE or EXCLUSIVE towards the levels above
+    string victim_of;       // Victim caches: the level whose evictions they hold
+};
+
+// A program run by a group of cores instead of the one given at the prompt (CORE_PROGRAM lines)
+struct CoreProgramConfig {
+    int first_core;
+    int last_core;
+    string file;
+};
+
+// Set sampling of one cache level (CACHE_SAMPLING lines)
+struct CacheSamplingConfig {
+    string level;
+    int interval;       // About one set in this many is modelled
+};
+
+// Banking of one cache level (CACHE_BANKS lines)
+struct CacheBankConfig {
+    string level;
+    int banks;
+    int ports;          // Accesses each bank serves per cycle
+    int interleave;     // Consecutive bytes mapped to one bank, 0 for the block size
+};
+
+// A class of execution units (FUNCTIONAL_UNIT lines)
+struct FunctionalUnitConfig {
+    string name;        // ALU, MUL, DIV or AGU
+    int count;          // Identical units
+    int latency;        // Cycles per operation, 0 for the latencies given at the prompt
+    bool pipelined;     // Accepts a new operation every cycle, else only once the last one is done
+};
+
 // Configuration structure to hold cache parameters from input file
 struct CacheConfig {
     int l1i_size;           // L1 instruction cache size in bytes
@@ -29,6 +97,56 @@ struct CacheConfig {
     int memory_latency;     // Main memory access latency in cycles
     int spm_size;           // Scratchpad memory size in bytes
     string replacement_policy; // Replacement policy (LRU or RANDOM)
+    int num_cores;          // Number of cores to simulate
+    int page_size;          // Main memory page size in bytes (power of two)
+    int max_cycles;         // Cycle limit for a run
+    int vlen;               // Vector register length in bits, at most MAX_VLEN
+    static const int MAX_VLEN = 4096;
+    int vector_lanes;       // 32-bit elements the vector unit processes per cycle
+    uint32_t shared_memory_base; // Addresses from here up are shared by all cores
+    string barrier_algorithm; // SYNC barrier algorithm (CENTRALIZED, TREE or DISSEMINATION)
+    int barrier_latency;    // Cycles per barrier message (counter update or signal)
+    int barrier_fan_in;     // Children per node of the TREE barrier
+    int profile_top;        // Instructions listed in the hotspot report (0 turns the report off)
+    string profile_folded;  // File for folded stacks (flamegraph input), empty for none
+    string stats_json;      // File for the JSON statistics dump, empty for none
+    string stats_csv;       // File for the CSV statistics dump, empty for none
+    string pipeline_trace;  // File for a pipeline snapshot of every core every cycle, empty for none
+    string trace_format;    // TEXT or BINARY pipeline trace records
+    bool trace_compress;    // Pipe the pipeline trace through gzip
+    int l2_bandwidth;       // Bytes per cycle through the shared L2 port
+    int memory_bandwidth;   // Bytes per cycle through the main memory channel
+    int dma_queue_depth;    // Transfers each core's DMA engine accepts before the core stalls
+    bool cache_heatmap;     // Print per-set miss heatmaps with the statistics
+    string simulation_mode; // DETAILED (cycle-level pipeline) or FUNCTIONAL (architectural state only)
+    int fast_forward;       // Instructions each core runs functionally before the detailed simulation
+    int loop_extrapolation; // Identical loop iterations before the rest are extrapolated (0 turns it off)
+    int smt_threads;        // Hardware threads per core (1, 2 or 4)
+    string smt_fetch_policy; // Thread that fetches each cycle: ROUND_ROBIN, ICOUNT or SWITCH_ON_MISS
+    bool memory_blocking;   // Loads and instruction fetches wait for their data instead of only counting stalls
+    int store_buffer;       // Store buffer entries per core (0 writes stores in MEM)
+    bool memory_speculation; // Loads go ahead of buffered stores whose page offset matches
+    bool virtual_memory;    // Translate core addresses through TLBs and per-core page tables
+    int vm_page_size;       // Translation page size in bytes (power of two, 4KB to 1GB)
+    int itlb_entries;       // Per-core L1 instruction TLB entries
+    int dtlb_entries;       // Per-core L1 data TLB entries
+    int tlb_associativity;  // L1 TLB associativity
+    int l2_tlb_entries;     // Shared L2 TLB entries
+    int l2_tlb_associativity; // L2 TLB associativity
+    int l2_tlb_latency;     // Cycles an L1 TLB miss spends in the L2 TLB
+    string noc_topology;    // Network carrying LDC/SWC between cores: NONE, MESH or RING
+    int noc_mesh_columns;   // Routers per mesh row (0 for a square-ish grid)
+    string noc_routing;     // Mesh dimension order: XY or YX
+    int noc_hop_latency;    // Cycles a packet's head takes through one router and link
+    int noc_link_width;     // Bytes a link carries per cycle (the flit size)
+    int noc_virtual_channels; // Virtual channels per link
+    vector<CacheLevelConfig> cache_levels;  // Levels from the top down; empty for L1I/L1D/L2 above
+    vector<CacheLevelConfig> victim_caches; // Victim caches attached to those levels
+    vector<CoreProgramConfig> core_programs; // Cores running their own program
+    vector<FunctionalUnitConfig> functional_units; // Execution unit pool; empty for unlimited units
+    vector<CacheBankConfig> cache_banks;    // Banked levels; the others serve any number of accesses per cycle
+    vector<CacheSamplingConfig> cache_sampling; // Levels modelling only a sample of their sets
+    bool sampling_calibrate; // Rerun without set sampling and compare the miss rates
     
     // Default constructor with reasonable defaults
     CacheConfig() : 
@@ -43,7 +161,50 @@ struct CacheConfig {
         l2_latency(10),      // 10 cycles
         memory_latency(100), // 100 cycles
         spm_size(400),       // 400 bytes
-        replacement_policy("LRU") {} 
+        replacement_policy("LRU"), // LRU replacement
+        num_cores(4),        // 4 cores
+        page_size(4096),     // 4KB pages
+        max_cycles(10000),   // 10000 cycles
+        vlen(128),           // 128-bit vector registers (4 elements)
+        vector_lanes(4),     // 4 lanes
+        shared_memory_base(0x80000000), // Upper 2GB shared
+        barrier_algorithm("CENTRALIZED"), // Single shared counter
+        barrier_latency(0),  // Instant release
+        barrier_fan_in(4),   // 4 children per tree node
+        profile_top(10),     // Top 10 instructions
+        profile_folded(""),  // No folded stack file
+        stats_json(""),      // No JSON dump
+        stats_csv(""),       // No CSV dump
+        pipeline_trace(""),  // No pipeline trace
+        trace_format("TEXT"), // Same text as the pipeline display
+        trace_compress(false), // Uncompressed trace
+        l2_bandwidth(32),    // 32 bytes per cycle
+        memory_bandwidth(8), // 8 bytes per cycle
+        dma_queue_depth(4),  // 4 queued transfers
+        cache_heatmap(false), // No heatmaps
+        simulation_mode("DETAILED"), // Cycle-level simulation
+        fast_forward(0),     // No fast-forwarding
+        loop_extrapolation(0), // Every iteration simulated
+        smt_threads(1),      // No SMT
+        smt_fetch_policy("ROUND_ROBIN"), // Threads take turns
+        memory_blocking(false), // Memory stalls are only counted
+        store_buffer(0),     // No store buffer
+        memory_speculation(false), // Loads wait for possibly aliasing stores
+        virtual_memory(false), // Addresses are used untranslated
+        vm_page_size(4096),  // 4KB pages, two-level page table
+        itlb_entries(16),    // 16-entry L1 ITLB
+        dtlb_entries(32),    // 32-entry L1 DTLB
+        tlb_associativity(4), // 4-way L1 TLBs
+        l2_tlb_entries(512), // 512-entry L2 TLB
+        l2_tlb_associativity(8), // 8-way L2 TLB
+        l2_tlb_latency(7),   // 7 cycles
+        noc_topology("NONE"), // LDC/SWC cost a local access
+        noc_mesh_columns(0), // Square-ish mesh
+        noc_routing("XY"),   // X first, then Y
+        noc_hop_latency(2),  // 2 cycles per hop
+        noc_link_width(8),   // 8-byte flits
+        noc_virtual_channels(2), // 2 virtual channels per link
+        sampling_calibrate(false) {} // No calibration run
 
     // Load configuration from file
     bool load_from_file(const string& filename) {
@@ -52,7 +213,13 @@ struct CacheConfig {
             cerr << "Error opening configuration file: " << filename << endl;
             return false;
         }
-
+        load(file);
+        return true;
+    }
+    
+    // Parse configuration lines from any stream (the server builds its jobs' configurations
+    // from a file plus overrides), then validate them; problems are reported to log
+    void load(istream& file, ostream& log = cerr) {
         string line;
         while (getline(file, line)) {
             istringstream iss(line);
@@ -71,9 +238,349 @@ struct CacheConfig {
             else if (param == "MEMORY_LATENCY") iss >> memory_latency;
             else if (param == "SPM_SIZE") iss >> spm_size;
             else if (param == "REPLACEMENT_POLICY") iss >> replacement_policy;
+            else if (param == "NUM_CORES") iss >> num_cores;
+            else if (param == "PAGE_SIZE") iss >> page_size;
+            else if (param == "MAX_CYCLES") iss >> max_cycles;
+            else if (param == "VLEN") iss >> vlen;
+            else if (param == "VECTOR_LANES") iss >> vector_lanes;
+            else if (param == "SHARED_MEMORY_BASE") iss >> hex >> shared_memory_base >> dec;
+            else if (param == "BARRIER_ALGORITHM") iss >> barrier_algorithm;
+            else if (param == "BARRIER_LATENCY") iss >> barrier_latency;
+            else if (param == "BARRIER_FAN_IN") iss >> barrier_fan_in;
+            else if (param == "PROFILE_TOP") iss >> profile_top;
+            else if (param == "PROFILE_FOLDED") iss >> profile_folded;
+            else if (param == "PIPELINE_TRACE") iss >> pipeline_trace;
+            else if (param == "TRACE_FORMAT") iss >> trace_format;
+            else if (param == "TRACE_COMPRESS") iss >> trace_compress;
+            else if (param == "STATS_JSON") iss >> stats_json;
+            else if (param == "STATS_CSV") iss >> stats_csv;
+            else if (param == "L2_BANDWIDTH") iss >> l2_bandwidth;
+            else if (param == "MEMORY_BANDWIDTH") iss >> memory_bandwidth;
+            else if (param == "DMA_QUEUE_DEPTH") iss >> dma_queue_depth;
+            else if (param == "CACHE_HEATMAP") iss >> cache_heatmap;
+            else if (param == "SIMULATION_MODE") iss >> simulation_mode;
+            else if (param == "FAST_FORWARD") iss >> fast_forward;
+            else if (param == "LOOP_EXTRAPOLATION") iss >> loop_extrapolation;
+            else if (param == "SMT_THREADS") iss >> smt_threads;
+            else if (param == "SMT_FETCH_POLICY") iss >> smt_fetch_policy;
+            else if (param == "MEMORY_BLOCKING") iss >> memory_blocking;
+            else if (param == "STORE_BUFFER") iss >> store_buffer;
+            else if (param == "MEMORY_SPECULATION") iss >> memory_speculation;
+            else if (param == "VIRTUAL_MEMORY") iss >> virtual_memory;
+            else if (param == "VM_PAGE_SIZE") iss >> vm_page_size;
+            else if (param == "ITLB_ENTRIES") iss >> itlb_entries;
+            else if (param == "DTLB_ENTRIES") iss >> dtlb_entries;
+            else if (param == "TLB_ASSOCIATIVITY") iss >> tlb_associativity;
+            else if (param == "L2_TLB_ENTRIES") iss >> l2_tlb_entries;
+            else if (param == "L2_TLB_ASSOCIATIVITY") iss >> l2_tlb_associativity;
+            else if (param == "L2_TLB_LATENCY") iss >> l2_tlb_latency;
+            else if (param == "NOC_TOPOLOGY") iss >> noc_topology;
+            else if (param == "NOC_MESH_COLUMNS") iss >> noc_mesh_columns;
+            else if (param == "NOC_ROUTING") iss >> noc_routing;
+            else if (param == "NOC_HOP_LATENCY") iss >> noc_hop_latency;
+            else if (param == "NOC_LINK_WIDTH") iss >> noc_link_width;
+            else if (param == "NOC_VIRTUAL_CHANNELS") iss >> noc_virtual_channels;
+            else if (param == "CACHE_LEVEL") {
+                // CACHE_LEVEL <name> <I|D|U> <size> <assoc> <latency> <PRIVATE|SHARED> [inclusion]
+                CacheLevelConfig level{"", 0, 0, 0, 0, false, "NON_INCLUSIVE", ""};
+                string kind, scope, inclusion;
+                if (iss >> level.name >> kind >> level.size >> level.associativity >> level.latency >> scope &&
+                    (scope == "PRIVATE" || scope == "SHARED")) {
+                    if (iss >> inclusion) level.inclusion = inclusion;
+                    level.kind = kind[0];
+                    level.is_private = scope == "PRIVATE";
+                    cache_levels.push_back(level);
+                } else {
+                    log << "Ignoring malformed CACHE_LEVEL line: " << line << endl;
+                }
+            }
+            else if (param == "CORE_PROGRAM") {
+                // CORE_PROGRAM <core>[-<last core>] <file>
+                CoreProgramConfig program{0, 0, ""};
+                string cores;
+                char dash = 0;
+                if (iss >> cores >> program.file) {
+                    istringstream range(cores);
+                    range >> program.first_core;
+                    program.last_core = program.first_core;
+                    if (range >> dash) range >> program.last_core;
+                }
+                if (!program.file.empty() && !cores.empty() && isdigit(static_cast<unsigned char>(cores[0])) &&
+                    (dash == 0 || dash == '-') && program.last_core >= program.first_core) {
+                    core_programs.push_back(program);
+                } else {
+                    log << "Ignoring malformed CORE_PROGRAM line: " << line << endl;
+                }
+            }
+            else if (param == "CACHE_BANKS") {
+                // CACHE_BANKS <level> <banks> [ports per bank] [interleave bytes]
+                CacheBankConfig banking{"", 0, 1, 0};
+                if (iss >> banking.level >> banking.banks) {
+                    if (iss >> banking.ports) iss >> banking.interleave;
+                }
+                if (banking.banks >= 1 && banking.ports >= 1 && (banking.interleave == 0 ||
+                    (banking.interleave >= 4 && (banking.interleave & (banking.interleave - 1)) == 0))) {
+                    cache_banks.push_back(banking);
+                } else {
+                    log << "Ignoring malformed CACHE_BANKS line: " << line << endl;
+                }
+            }
+            else if (param == "CACHE_SAMPLING") {
+                // CACHE_SAMPLING <level> <one set in interval>
+                CacheSamplingConfig sampling{"", 0};
+                iss >> sampling.level >> sampling.interval;
+                if (sampling.interval >= 1) {
+                    cache_sampling.push_back(sampling);
+                } else {
+                    log << "Ignoring malformed CACHE_SAMPLING line: " << line << endl;
+                }
+            }
+            else if (param == "SAMPLING_CALIBRATE") iss >> sampling_calibrate;
+            else if (param == "FUNCTIONAL_UNIT") {
+                // FUNCTIONAL_UNIT <ALU|MUL|DIV|AGU> <count> [latency] [PIPELINED|UNPIPELINED]
+                FunctionalUnitConfig unit{"", 0, 0, true};
+                string pipelining;
+                if (iss >> unit.name >> unit.count) {
+                    if (iss >> unit.latency) iss >> pipelining;
+                }
+                if ((unit.name == "ALU" || unit.name == "MUL" || unit.name == "DIV" || unit.name == "AGU") &&
+                    unit.count >= 1 && unit.latency >= 0 &&
+                    (pipelining.empty() || pipelining == "PIPELINED" || pipelining == "UNPIPELINED")) {
+                    // Dividers are unpipelined unless stated otherwise
+                    unit.pipelined = pipelining.empty() ? unit.name != "DIV" : pipelining == "PIPELINED";
+                    functional_units.push_back(unit);
+                } else {
+                    log << "Ignoring malformed FUNCTIONAL_UNIT line: " << line << endl;
+                }
+            }
+            else if (param == "VICTIM_CACHE") {
+                // VICTIM_CACHE <name> <level> <entries> [latency], fully associative
+                CacheLevelConfig victim{"", 0, 0, 0, 1, false, "EXCLUSIVE", ""};
+                if (iss >> victim.name >> victim.victim_of >> victim.associativity) {
+                    iss >> victim.latency;
+                    victim_caches.push_back(victim);
+                } else {
+                    log << "Ignoring malformed VICTIM_CACHE line: " << line << endl;
+                }
+            }
         }
         
-        file.close();
+        if (num_cores < 1) {
+            log << "Invalid NUM_CORES " << num_cores << ", using 1" << endl;
+            num_cores = 1;
+        }
+        if (page_size < 4 || (page_size & (page_size - 1)) != 0) {
+            log << "Invalid PAGE_SIZE " << page_size << ", using 4096" << endl;
+            page_size = 4096;
+        }
+        if (barrier_algorithm != "CENTRALIZED" && barrier_algorithm != "TREE" &&
+            barrier_algorithm != "DISSEMINATION") {
+            log << "Unknown BARRIER_ALGORITHM " << barrier_algorithm << ", using CENTRALIZED" << endl;
+            barrier_algorithm = "CENTRALIZED";
+        }
+        if (l2_bandwidth < 1 || memory_bandwidth < 1 || dma_queue_depth < 1) {
+            log << "L2_BANDWIDTH, MEMORY_BANDWIDTH and DMA_QUEUE_DEPTH must be positive, using defaults" << endl;
+            l2_bandwidth = 32;
+            memory_bandwidth = 8;
+            dma_queue_depth = 4;
+        }
+        if (simulation_mode != "DETAILED" && simulation_mode != "FUNCTIONAL") {
+            log << "Unknown SIMULATION_MODE " << simulation_mode << ", using DETAILED" << endl;
+            simulation_mode = "DETAILED";
+        }
+        if (trace_format != "TEXT" && trace_format != "BINARY") {
+            log << "Unknown TRACE_FORMAT " << trace_format << ", using TEXT" << endl;
+            trace_format = "TEXT";
+        }
+        if (fast_forward < 0) {
+            log << "Invalid FAST_FORWARD " << fast_forward << ", using 0" << endl;
+            fast_forward = 0;
+        }
+        if (loop_extrapolation < 0) {
+            log << "Invalid LOOP_EXTRAPOLATION " << loop_extrapolation << ", using 0" << endl;
+            loop_extrapolation = 0;
+        }
+        if (store_buffer < 0) {
+            log << "Invalid STORE_BUFFER " << store_buffer << ", using 0" << endl;
+            store_buffer = 0;
+        }
+        if (vm_page_size < 4096 || vm_page_size > (1 << 30) || (vm_page_size & (vm_page_size - 1)) != 0) {
+            log << "Invalid VM_PAGE_SIZE " << vm_page_size << ", using 4096" << endl;
+            vm_page_size = 4096;
+        }
+        if (itlb_entries < 1 || dtlb_entries < 1 || tlb_associativity < 1 || l2_tlb_entries < 1 ||
+            l2_tlb_associativity < 1 || l2_tlb_latency < 0) {
+            log << "TLB entries and associativities must be positive, using defaults" << endl;
+            itlb_entries = 16;
+            dtlb_entries = 32;
+            tlb_associativity = 4;
+            l2_tlb_entries = 512;
+            l2_tlb_associativity = 8;
+            l2_tlb_latency = 7;
+        }
+        if (noc_topology != "NONE" && noc_topology != "MESH" && noc_topology != "RING") {
+            log << "Unknown NOC_TOPOLOGY " << noc_topology << ", using NONE" << endl;
+            noc_topology = "NONE";
+        }
+        if (noc_routing != "XY" && noc_routing != "YX") {
+            log << "Unknown NOC_ROUTING " << noc_routing << ", using XY" << endl;
+            noc_routing = "XY";
+        }
+        if (noc_mesh_columns < 0 || noc_hop_latency < 1 || noc_link_width < 1 || noc_virtual_channels < 1) {
+            log << "NoC hop latency, link width and virtual channels must be positive, using defaults" << endl;
+            noc_mesh_columns = 0;
+            noc_hop_latency = 2;
+            noc_link_width = 8;
+            noc_virtual_channels = 2;
+        }
+        if (smt_threads != 1 && smt_threads != 2 && smt_threads != 4) {
+            log << "Invalid SMT_THREADS " << smt_threads << ", using 1" << endl;
+            smt_threads = 1;
+        }
+        if (smt_fetch_policy != "ROUND_ROBIN" && smt_fetch_policy != "ICOUNT" && smt_fetch_policy != "SWITCH_ON_MISS") {
+            log << "Unknown SMT_FETCH_POLICY " << smt_fetch_policy << ", using ROUND_ROBIN" << endl;
+            smt_fetch_policy = "ROUND_ROBIN";
+        }
+        for (auto program = core_programs.begin(); program != core_programs.end(); ) {
+            if (program->last_core >= num_cores * smt_threads) {
+                log << "Ignoring CORE_PROGRAM " << program->file << ": core " << program->last_core
+                     << " does not exist" << endl;
+                program = core_programs.erase(program);
+            } else {
+                ++program;
+            }
+        }
+        if (vlen < 32 || vlen > MAX_VLEN || vlen % 32 != 0) {
+            log << "Invalid VLEN " << vlen << ", using 128" << endl;
+            vlen = 128;
+        }
+        if ((!cache_levels.empty() || !victim_caches.empty()) && !validate_cache_hierarchy(log)) {
+            log << "Using the default L1I/L1D/L2 hierarchy" << endl;
+            cache_levels.clear();
+            victim_caches.clear();
+        }
+        vector<CacheLevelConfig> levels = cache_hierarchy();
+        for (auto banking = cache_banks.begin(); banking != cache_banks.end(); ) {
+            bool found = any_of(levels.begin(), levels.end(),
+                                [&](const CacheLevelConfig& level) { return level.name == banking->level; });
+            if (!found) {
+                log << "Ignoring CACHE_BANKS: no cache level named " << banking->level << endl;
+                banking = cache_banks.erase(banking);
+            } else {
+                ++banking;
+            }
+        }
+        for (auto sampling = cache_sampling.begin(); sampling != cache_sampling.end(); ) {
+            bool found = any_of(levels.begin(), levels.end(),
+                                [&](const CacheLevelConfig& level) { return level.name == sampling->level; });
+            if (!found) {
+                log << "Ignoring CACHE_SAMPLING: no cache level named " << sampling->level << endl;
+                sampling = cache_sampling.erase(sampling);
+            } else {
+                ++sampling;
+            }
+        }
+    }
+    
+    // The configured levels (or L1I, L1D and a shared L2), followed by the victim caches
+    vector<CacheLevelConfig> cache_hierarchy() const {
+        vector<CacheLevelConfig> levels = cache_levels;
+        if (levels.empty()) {
+            levels.push_back({"L1I", 'I', l1i_size, l1i_associativity, l1_latency, false, "NON_INCLUSIVE", ""});
+            levels.push_back({"L1D", 'D', l1d_size, l1d_associativity, l1_latency, false, "NON_INCLUSIVE", ""});
+            levels.push_back({"L2", 'U', l2_size, l2_associativity, l2_latency, false, "NON_INCLUSIVE", ""});
+        }
+        for (CacheLevelConfig victim : victim_caches) {
+            for (const auto& level : levels) {
+                if (level.name != victim.victim_of || !level.victim_of.empty()) continue;
+                victim.kind = level.kind;
+                victim.is_private = level.is_private;
+                victim.size = victim.associativity * block_size; // Fully associative
+            }
+            levels.push_back(victim);
+        }
+        return levels;
+    }
+    
+    // Index of the level a level misses into, or -1 for main memory. A level falls through to
+    // the next listed level that holds its kind of block, via its victim cache if it has one.
+    static int parent_level(const vector<CacheLevelConfig>& levels, int index) {
+        const CacheLevelConfig& level = levels[index];
+        if (level.victim_of.empty()) {
+            for (size_t v = 0; v < levels.size(); v++) {
+                if (levels[v].victim_of == level.name) return static_cast<int>(v);
+            }
+        } else {
+            for (size_t i = 0; i < levels.size(); i++) {
+                if (levels[i].name == level.victim_of) return next_level(levels, static_cast<int>(i));
+            }
+        }
+        return next_level(levels, index);
+    }
+    
+    static int next_level(const vector<CacheLevelConfig>& levels, int index) {
+        for (size_t j = index + 1; j < levels.size(); j++) {
+            if (levels[j].victim_of.empty() && (levels[j].kind == 'U' || levels[j].kind == levels[index].kind)) {
+                return static_cast<int>(j);
+            }
+        }
+        return -1;
+    }
+    
+    // Check the CACHE_LEVEL/VICTIM_CACHE description forms a usable tree
+    bool validate_cache_hierarchy(ostream& log = cerr) const {
+        vector<CacheLevelConfig> levels = cache_hierarchy();
+        bool instructions = false, data = false;
+        vector<int> children(levels.size(), 0);
+        for (size_t i = 0; i < levels.size(); i++) {
+            const CacheLevelConfig& level = levels[i];
+            if (!level.victim_of.empty() && level.kind == 0) {
+                log << "Victim cache " << level.name << ": no cache level named " << level.victim_of << endl;
+                return false;
+            }
+            if (level.kind != 'I' && level.kind != 'D' && level.kind != 'U') {
+                log << "Cache level " << level.name << ": kind must be I, D or U" << endl;
+                return false;
+            }
+            if (level.size <= 0 || level.associativity <= 0 || level.latency < 0 ||
+                level.size / (block_size * level.associativity) < 1) {
+                log << "Cache level " << level.name << ": needs a positive size holding at least one set" << endl;
+                return false;
+            }
+            if (level.inclusion != "NON_INCLUSIVE" && level.inclusion != "INCLUSIVE" && level.inclusion != "EXCLUSIVE") {
+                log << "Cache level " << level.name << ": unknown inclusion policy " << level.inclusion << endl;
+                return false;
+            }
+            for (size_t j = 0; j < i; j++) {
+                if (levels[j].name == level.name) {
+                    log << "Cache level " << level.name << " is defined twice" << endl;
+                    return false;
+                }
+            }
+            int parent = parent_level(levels, static_cast<int>(i));
+            if (parent >= 0) {
+                children[parent]++;
+                if (levels[parent].is_private && !level.is_private) {
+                    log << "Cache level " << level.name << " is shared but misses into private " 
+                         << levels[parent].name << endl;
+                    return false;
+                }
+            }
+            if (level.victim_of.empty()) {
+                instructions = instructions || level.kind != 'D';
+                data = data || level.kind != 'I';
+            }
+        }
+        for (size_t i = 0; i < levels.size(); i++) {
+            if (levels[i].inclusion == "EXCLUSIVE" && children[i] == 0) {
+                log << "Cache level " << levels[i].name << ": an exclusive level needs levels above it" << endl;
+                return false;
+            }
+        }
+        if (!instructions || !data) {
+            log << "The cache hierarchy needs levels for both instructions and data" << endl;
+            return false;
+        }
         return true;
     }
 };
@@ -96,9 +603,18 @@ struct Instruction {
     int imm = 0;          // Immediate value
     int mem_addr = -1;    // Memory address
     string label;         // Branch/jump label
+    int target = -1;      // Branch/jump target (instruction index)
+    int pc = -1;          // Instruction index this was fetched from
+    int vdest = -1;       // Vector destination register (vd)
+    int vsrc1 = -1;       // Vector source 1 (vs1, or vs3 for stores)
+    int vsrc2 = -1;       // Vector source 2 (vs2)
+    int vl = 0;           // Vector length captured at decode
+    int csr = -1;         // CSR number (Zicsr instructions)
+    int stride = 4;       // Byte stride for vector memory operations
     int issue_cycle = -1; // Cycle when instruction was issued
     bool is_spm = false;  // Flag for SPM instructions
     int offset = 0;       // Offset for SPM instructions
+    int memory_done_cycle = -1; // MEMORY_BLOCKING: cycle a load's data arrives
     
     // Pipeline tracking information
     PipelineStage current_stage = NONE;
@@ -107,6 +623,221 @@ struct Instruction {
     int result_value = 0;              // Result of computation (for forwarding)
 };
 
+// Instruction formats of the RV32IM base encodings
+enum RiscvFormat { FMT_R, FMT_I, FMT_I_SHIFT, FMT_S, FMT_B, FMT_U, FMT_J, FMT_SYS, FMT_CSR,
+                   FMT_VSETVLI, FMT_VLOAD, FMT_VSTORE, FMT_VV, FMT_VX, FMT_VMV_XS };
+
+// One row of the decode table: a word matches when (word & mask) == match
+struct RiscvEncoding {
+    uint32_t mask;
+    uint32_t match;
+    const char* opcode;
+    RiscvFormat format;
+};
+
+static const RiscvEncoding RV32IM_ENCODINGS[] = {
+    {0x0000007f, 0x00000037, "LUI",    FMT_U},
+    {0x0000007f, 0x00000017, "AUIPC",  FMT_U},
+    {0x0000007f, 0x0000006f, "JAL",    FMT_J},
+    {0x0000707f, 0x00000067, "JALR",   FMT_I},
+    {0x0000707f, 0x00000063, "BEQ",    FMT_B},
+    {0x0000707f, 0x00001063, "BNE",    FMT_B},
+    {0x0000707f, 0x00004063, "BLT",    FMT_B},
+    {0x0000707f, 0x00005063, "BGE",    FMT_B},
+    {0x0000707f, 0x00006063, "BLTU",   FMT_B},
+    {0x0000707f, 0x00007063, "BGEU",   FMT_B},
+    {0x0000707f, 0x00000003, "LB",     FMT_I},
+    {0x0000707f, 0x00001003, "LH",     FMT_I},
+    {0x0000707f, 0x00002003, "LW",     FMT_I},
+    {0x0000707f, 0x00004003, "LBU",    FMT_I},
+    {0x0000707f, 0x00005003, "LHU",    FMT_I},
+    {0x0000707f, 0x00000023, "SB",     FMT_S},
+    {0x0000707f, 0x00001023, "SH",     FMT_S},
+    {0x0000707f, 0x00002023, "SW",     FMT_S},
+    {0x0000707f, 0x00000013, "ADDI",   FMT_I},
+    {0x0000707f, 0x00002013, "SLTI",   FMT_I},
+    {0x0000707f, 0x00003013, "SLTIU",  FMT_I},
+    {0x0000707f, 0x00004013, "XORI",   FMT_I},
+    {0x0000707f, 0x00006013, "ORI",    FMT_I},
+    {0x0000707f, 0x00007013, "ANDI",   FMT_I},
+    {0xfe00707f, 0x00001013, "SLLI",   FMT_I_SHIFT},
+    {0xfe00707f, 0x00005013, "SRLI",   FMT_I_SHIFT},
+    {0xfe00707f, 0x40005013, "SRAI",   FMT_I_SHIFT},
+    {0xfe00707f, 0x00000033, "ADD",    FMT_R},
+    {0xfe00707f, 0x40000033, "SUB",    FMT_R},
+    {0xfe00707f, 0x00001033, "SLL",    FMT_R},
+    {0xfe00707f, 0x00002033, "SLT",    FMT_R},
+    {0xfe00707f, 0x00003033, "SLTU",   FMT_R},
+    {0xfe00707f, 0x00004033, "XOR",    FMT_R},
+    {0xfe00707f, 0x00005033, "SRL",    FMT_R},
+    {0xfe00707f, 0x40005033, "SRA",    FMT_R},
+    {0xfe00707f, 0x00006033, "OR",     FMT_R},
+    {0xfe00707f, 0x00007033, "AND",    FMT_R},
+    {0xfe00707f, 0x02000033, "MUL",    FMT_R},
+    {0xfe00707f, 0x02001033, "MULH",   FMT_R},
+    {0xfe00707f, 0x02002033, "MULHSU", FMT_R},
+    {0xfe00707f, 0x02003033, "MULHU",  FMT_R},
+    {0xfe00707f, 0x02004033, "DIV",    FMT_R},
+    {0xfe00707f, 0x02005033, "DIVU",   FMT_R},
+    {0xfe00707f, 0x02006033, "REM",    FMT_R},
+    {0xfe00707f, 0x02007033, "REMU",   FMT_R},
+    {0x0000707f, 0x0000000f, "FENCE",  FMT_SYS},
+    {0x0000707f, 0x0000100f, "FENCE",  FMT_SYS}, // FENCE.I
+    {0xffffffff, 0x00000073, "ECALL",  FMT_SYS},
+    {0xffffffff, 0x00100073, "EBREAK", FMT_SYS},
+    
+    // Zicsr (only the counter CSRs and the ROI marker are implemented)
+    {0x0000707f, 0x00001073, "CSRRW",  FMT_CSR},
+    {0x0000707f, 0x00002073, "CSRRS",  FMT_CSR},
+    {0x0000707f, 0x00003073, "CSRRC",  FMT_CSR},
+    {0x0000707f, 0x00005073, "CSRRWI", FMT_CSR},
+    {0x0000707f, 0x00006073, "CSRRSI", FMT_CSR},
+    {0x0000707f, 0x00007073, "CSRRCI", FMT_CSR},
+    
+    // Atomics (aq/rl bits are ignored; accesses are performed in order)
+    {0xf9f0707f, 0x1000202f, "LR.W",      FMT_R},
+    {0xf800707f, 0x1800202f, "SC.W",      FMT_R},
+    {0xf800707f, 0x0800202f, "AMOSWAP.W", FMT_R},
+    {0xf800707f, 0x0000202f, "AMOADD.W",  FMT_R},
+    {0xf800707f, 0x2000202f, "AMOXOR.W",  FMT_R},
+    {0xf800707f, 0x6000202f, "AMOAND.W",  FMT_R},
+    {0xf800707f, 0x4000202f, "AMOOR.W",   FMT_R},
+    {0xf800707f, 0x8000202f, "AMOMIN.W",  FMT_R},
+    {0xf800707f, 0xa000202f, "AMOMAX.W",  FMT_R},
+    {0xf800707f, 0xc000202f, "AMOMINU.W", FMT_R},
+    {0xf800707f, 0xe000202f, "AMOMAXU.W", FMT_R},
+    
+    // Vector subset: unmasked, SEW=32, LMUL=1
+    {0x8000707f, 0x00007057, "VSETVLI",    FMT_VSETVLI},
+    {0xfff0707f, 0x02006007, "VLE32.V",    FMT_VLOAD},
+    {0xfe00707f, 0x0a006007, "VLSE32.V",   FMT_VLOAD},
+    {0xfff0707f, 0x02006027, "VSE32.V",    FMT_VSTORE},
+    {0xfe00707f, 0x0a006027, "VSSE32.V",   FMT_VSTORE},
+    {0xfe00707f, 0x02000057, "VADD.VV",    FMT_VV},
+    {0xfe00707f, 0x02004057, "VADD.VX",    FMT_VX},
+    {0xfe00707f, 0x96002057, "VMUL.VV",    FMT_VV},
+    {0xfe00707f, 0x96006057, "VMUL.VX",    FMT_VX},
+    {0xfe00707f, 0x02002057, "VREDSUM.VS", FMT_VV},
+    {0xfe0ff07f, 0x42002057, "VMV.X.S",    FMT_VMV_XS},
+    {0xfff0707f, 0x5e004057, "VMV.V.X",    FMT_VX},
+};
+
+// Table-driven decoder for 32-bit RV32IM encodings
+class RiscvDecoder {
+public:
+    RiscvDecoder() {
+        // Bucket the table by major opcode so a lookup scans only a few rows
+        for (const auto& encoding : RV32IM_ENCODINGS) {
+            by_major_opcode[encoding.match & 0x7f].push_back(&encoding);
+        }
+    }
+    
+    // Decode one word fetched from address; base is the address of instruction 0
+    Instruction decode(uint32_t word, uint64_t address, uint64_t base) const {
+        Instruction instr;
+        instr.opcode = "ILLEGAL";
+        
+        for (const RiscvEncoding* encoding : by_major_opcode[word & 0x7f]) {
+            if ((word & encoding->mask) != encoding->match) continue;
+            
+            instr.opcode = encoding->opcode;
+            int rd = (word >> 7) & 0x1f;
+            int rs1 = (word >> 15) & 0x1f;
+            int rs2 = (word >> 20) & 0x1f;
+            int32_t sword = static_cast<int32_t>(word);
+            
+            switch (encoding->format) {
+                case FMT_R:
+                    instr.src_reg1 = rs1;
+                    instr.src_reg2 = rs2;
+                    break;
+                case FMT_I:
+                    instr.src_reg1 = rs1;
+                    instr.imm = sword >> 20;
+                    break;
+                case FMT_I_SHIFT:
+                    instr.src_reg1 = rs1;
+                    instr.imm = rs2; // shamt
+                    break;
+                case FMT_S:
+                    instr.src_reg1 = rs1;
+                    instr.src_reg2 = rs2;
+                    instr.imm = ((sword >> 25) << 5) | rd;
+                    rd = 0;
+                    break;
+                case FMT_B:
+                    instr.src_reg1 = rs1;
+                    instr.src_reg2 = rs2;
+                    instr.imm = ((sword >> 31) << 12) | (((word >> 7) & 0x1) << 11) |
+                                (((word >> 25) & 0x3f) << 5) | (((word >> 8) & 0xf) << 1);
+                    rd = 0;
+                    break;
+                case FMT_U:
+                    instr.imm = static_cast<int>(word & 0xfffff000);
+                    break;
+                case FMT_J:
+                    instr.imm = ((sword >> 31) << 20) | (((word >> 12) & 0xff) << 12) |
+                                (((word >> 20) & 0x1) << 11) | (((word >> 21) & 0x3ff) << 1);
+                    break;
+                case FMT_SYS:
+                    rd = 0;
+                    break;
+                case FMT_CSR:
+                    instr.csr = word >> 20;
+                    if (instr.opcode.back() == 'I') instr.imm = rs1; // zimm
+                    else instr.src_reg1 = rs1;
+                    break;
+                case FMT_VSETVLI:
+                    // rs1 = x0 requests VLMAX; only e32/m1 is supported
+                    instr.src_reg1 = rs1 != 0 ? rs1 : -1;
+                    instr.imm = (word >> 20) & 0x7ff;
+                    if ((instr.imm & 0x3f) != 0x10) instr.opcode = "ILLEGAL";
+                    break;
+                case FMT_VLOAD:
+                case FMT_VSTORE:
+                    if (encoding->format == FMT_VLOAD) instr.vdest = rd;
+                    else instr.vsrc1 = rd; // vs3
+                    instr.src_reg1 = rs1;
+                    if ((word >> 27) & 1) instr.src_reg2 = rs2; // Strided
+                    rd = 0;
+                    break;
+                case FMT_VV:
+                    instr.vdest = rd;
+                    instr.vsrc2 = rs2;
+                    instr.vsrc1 = rs1;
+                    rd = 0;
+                    break;
+                case FMT_VX:
+                    instr.vdest = rd;
+                    instr.vsrc2 = instr.opcode == "VMV.V.X" ? -1 : rs2; // vmv.v.x has no vs2
+                    instr.src_reg1 = rs1;
+                    rd = 0;
+                    break;
+                case FMT_VMV_XS:
+                    instr.vsrc2 = rs2;
+                    break;
+            }
+            
+            // x0 is hardwired to zero, so writes to it are dropped at decode
+            instr.dest_reg = rd != 0 ? rd : -1;
+            
+            // PC-relative targets become instruction indices
+            if (encoding->format == FMT_B || encoding->format == FMT_J) {
+                uint64_t target_address = address + instr.imm;
+                if (target_address >= base) {
+                    instr.target = static_cast<int>((target_address - base) / 4);
+                }
+            }
+            break;
+        }
+        
+        return instr;
+    }
+    
+private:
+    vector<const RiscvEncoding*> by_major_opcode[128];
+};
+
 // Cache block structure
 struct CacheBlock {
     bool valid = false;           // Valid bit
@@ -121,8 +852,80 @@ struct CacheBlock {
     }
 };
 
+// Hit, miss and per-set counters of a cache; private levels add up their instances' counters
+struct CacheStats {
+    int hits = 0;                // Hit counter
+    int misses = 0;              // Miss counter
+    
+    // Misses by cause (three-C classification, plus coherence)
+    long long compulsory_misses = 0;
+    long long capacity_misses = 0;
+    long long conflict_misses = 0;
+    long long coherence_misses = 0;      // Misses to blocks another core invalidated
+    
+    // Per-set counters for the conflict heatmap
+    vector<long long> set_accesses;
+    vector<long long> set_misses;
+    
+    void add(const CacheStats& other) {
+        hits += other.hits;
+        misses += other.misses;
+        compulsory_misses += other.compulsory_misses;
+        capacity_misses += other.capacity_misses;
+        conflict_misses += other.conflict_misses;
+        coherence_misses += other.coherence_misses;
+        set_accesses.resize(max(set_accesses.size(), other.set_accesses.size()), 0);
+        set_misses.resize(max(set_misses.size(), other.set_misses.size()), 0);
+        for (size_t i = 0; i < other.set_accesses.size(); i++) {
+            set_accesses[i] += other.set_accesses[i];
+            set_misses[i] += other.set_misses[i];
+        }
+    }
+    
+    // Calculate miss rate
+    double get_miss_rate() const {
+        int total = hits + misses;
+        return total > 0 ? static_cast<double>(misses) / total : 0.0;
+    }
+    
+    // Misses split by cause
+    string miss_breakdown(const string& name) const {
+        stringstream ss;
+        ss << name << " misses: compulsory " << compulsory_misses << ", capacity " << capacity_misses
+           << ", conflict " << conflict_misses;
+        if (coherence_misses > 0) ss << ", coherence " << coherence_misses;
+        return ss.str();
+    }
+    
+    // One character per set, darker for more misses, 64 sets per row
+    string miss_heatmap(const string& name) const {
+        static const char shades[] = " .:-=+*#%@";
+        long long most = *max_element(set_misses.begin(), set_misses.end());
+        int hottest = static_cast<int>(max_element(set_misses.begin(), set_misses.end()) - set_misses.begin());
+        int num_sets = static_cast<int>(set_misses.size());
+        stringstream ss;
+        ss << name << " misses per set (0-" << most << ", set " << hottest << " worst: " << set_misses[hottest]
+           << " misses in " << set_accesses[hottest] << " accesses):" << endl;
+        for (int row = 0; row < num_sets; row += 64) {
+            ss << "  " << setw(5) << row << " |";
+            for (int i = row; i < min(num_sets, row + 64); i++) {
+                ss << shades[most > 0 ? (set_misses[i] * 9 + most - 1) / most : 0];
+            }
+            ss << "|" << endl;
+        }
+        return ss.str();
+    }
+};
+
+// How a cache level relates to the levels above it
+enum class InclusionPolicy {
+    NON_INCLUSIVE,  // Filled on the way up, evicts without touching the levels above
+    INCLUSIVE,      // Evicting a block removes it from every level above
+    EXCLUSIVE       // Holds only blocks evicted from above; a hit moves the block up
+};
+
 // Cache structure
-class Cache {
+class Cache : public CacheStats {
 public:
     string name;                 // Cache name (L1I, L1D, L2)
     int size_bytes;              // Cache size in bytes
@@ -134,8 +937,38 @@ public:
     int num_sets;                // Number of sets
     vector<vector<CacheBlock>> sets; // Cache sets with blocks
     
-    int hits = 0;                // Hit counter
-    int misses = 0;              // Miss counter
+    // Position in the hierarchy
+    Cache* parent = nullptr;     // Level misses go to; nullptr for main memory
+    vector<Cache*> children;     // Levels that miss into this one
+    InclusionPolicy inclusion = InclusionPolicy::NON_INCLUSIVE;
+    bool is_private = false;     // One instance per core
+    
+    // Three-C miss classification: a first-touch set and a fully-associative LRU shadow of the
+    // same capacity separate compulsory, capacity and conflict misses. Under set sampling the
+    // shadow only sees the modelled sets, so it only holds as many blocks as they do
+    unordered_set<uint64_t> touched;     // Block numbers ever accessed
+    unordered_set<uint64_t> invalidated; // Block numbers removed by invalidate()
+    list<uint64_t> shadow_lru;           // Shadow cache contents, most recent first
+    unordered_map<uint64_t, list<uint64_t>::iterator> shadow_index;
+    int shadow_capacity;                 // Blocks the shadow cache holds
+    
+    // Banking: each bank serves a limited number of accesses per cycle, and accesses beyond
+    // that wait for a port. Unbanked caches serve any number of accesses per cycle
+    int num_banks = 1;
+    int bank_interleave = 0;             // Consecutive bytes mapped to one bank
+    vector<vector<int>> bank_ports;      // Per bank and port, the cycle the port is free again
+    long long bank_accesses = 0;
+    long long bank_conflicts = 0;        // Accesses that waited for a port
+    long long bank_conflict_cycles = 0;
+    
+    // Set sampling: only the modelled sets hold blocks. The outcome of an access to another
+    // set is estimated from the miss rate of the modelled sets, and its data is read from or
+    // written to the levels below, so values stay exact
+    vector<bool> modelled;               // Per set; empty when every set is modelled
+    int modelled_sets = 0;
+    long long estimated_hits = 0;        // Included in hits
+    long long estimated_misses = 0;      // Included in misses
+    double miss_credit = 0;              // Estimated misses owed (error diffusion)
     
     // Random number generator for RANDOM replacement policy
     default_random_engine generator;
@@ -151,6 +984,7 @@ public:
         
         // Calculate number of sets
         num_sets = size_bytes / (block_size_bytes * associativity);
+        shadow_capacity = num_sets * associativity;
         
         // Initialize cache sets and blocks
         sets.resize(num_sets);
@@ -160,11 +994,72 @@ public:
                 sets[i].emplace_back(block_size_bytes);
             }
         }
+        set_accesses.assign(num_sets, 0);
+        set_misses.assign(num_sets, 0);
         
         // Seed random generator
         generator.seed(static_cast<unsigned>(time(nullptr)));
     }
     
+    void configure_banks(int banks, int ports, int interleave) {
+        num_banks = banks;
+        bank_interleave = interleave;
+        bank_ports.assign(banks, vector<int>(ports, 0));
+    }
+    
+    // Model about one set in interval, picked by a multiplicative hash of the set index so that
+    // strided accesses do not all fall into (or all miss) the sample. The other sets give up
+    // their blocks
+    void configure_sampling(int interval) {
+        modelled.assign(num_sets, false);
+        modelled_sets = 0;
+        for (int i = 0; i < num_sets; i++) {
+            modelled[i] = ((static_cast<uint32_t>(i) * 2654435761u) >> 8) % interval == 0;
+            if (modelled[i]) {
+                modelled_sets++;
+            } else {
+                vector<CacheBlock>().swap(sets[i]);
+            }
+        }
+        shadow_capacity = max(1, modelled_sets) * associativity;
+    }
+    
+    bool models_set(int set_index) const {
+        return modelled.empty() || modelled[set_index];
+    }
+    
+    bool models(uint64_t address) const {
+        return models_set((address / block_size_bytes) % num_sets);
+    }
+    
+    // Outcome of an access to a set that is not modelled: misses come at the rate the modelled
+    // sets have shown so far, spread evenly so that runs stay deterministic
+    bool estimate_miss() {
+        long long sampled_misses = misses - estimated_misses;
+        long long sampled = hits - estimated_hits + sampled_misses;
+        miss_credit += sampled > 0 ? static_cast<double>(sampled_misses) / sampled : 1.0;
+        if (miss_credit < 1.0) return false;
+        miss_credit -= 1.0;
+        return true;
+    }
+    
+    // Take a port of the bank holding address from cycle on; returns the cycles the access
+    // waits because the bank's ports are taken by earlier accesses
+    int claim_bank(uint64_t address, int cycle) {
+        if (bank_ports.empty()) return 0;
+        
+        vector<int>& ports = bank_ports[(address / bank_interleave) % num_banks];
+        int& port = *min_element(ports.begin(), ports.end());
+        int wait = max(0, port - cycle);
+        port = cycle + wait + 1;
+        bank_accesses++;
+        if (wait > 0) {
+            bank_conflicts++;
+            bank_conflict_cycles += wait;
+        }
+        return wait;
+    }
+    
     // Calculate set index and tag from address
     pair<int, uint64_t> get_set_and_tag(uint64_t address) {
         int block_offset = address % block_size_bytes;
@@ -177,6 +1072,7 @@ public:
     // Check if address is in cache
     bool is_hit(uint64_t address, int& block_index) {
         auto [set_index, tag] = get_set_and_tag(address);
+        if (!models_set(set_index)) return false;
         
         for (int i = 0; i < associativity; i++) {
             if (sets[set_index][i].valid && sets[set_index][i].tag == tag) {
@@ -233,16 +1129,80 @@ public:
             // Update LRU information
             sets[set_index][block_index].last_used_cycle = current_cycle;
             
-            if (update_stats) hits++;
+            if (update_stats) record_access(address, true);
             return true;
         }
         
-        if (update_stats) misses++;
+        if (update_stats) record_access(address, false);
         return false;
     }
     
-    // Write data to cache
-    bool write(uint64_t address, int data, int current_cycle, bool update_stats = true) {
+    // Count an access and classify it if it missed
+    void record_access(uint64_t address, bool hit) {
+        uint64_t block = address / block_size_bytes;
+        int set_index = block % num_sets;
+        if (!models_set(set_index)) {
+            if (hit) {
+                hits++;
+                estimated_hits++;
+            } else {
+                misses++;
+                estimated_misses++;
+            }
+            return;
+        }
+        set_accesses[set_index]++;
+        bool first_touch = touched.insert(block).second;
+        
+        // The shadow cache sees every access so it tracks what full associativity would hold
+        bool shadow_hit = false;
+        auto it = shadow_index.find(block);
+        if (it != shadow_index.end()) {
+            shadow_lru.splice(shadow_lru.begin(), shadow_lru, it->second);
+            shadow_hit = true;
+        } else {
+            shadow_lru.push_front(block);
+            shadow_index[block] = shadow_lru.begin();
+            if (static_cast<int>(shadow_lru.size()) > shadow_capacity) {
+                shadow_index.erase(shadow_lru.back());
+                shadow_lru.pop_back();
+            }
+        }
+        
+        if (hit) {
+            hits++;
+            return;
+        }
+        misses++;
+        set_misses[set_index]++;
+        if (first_touch) compulsory_misses++;
+        else if (invalidated.erase(block)) coherence_misses++;
+        else if (!shadow_hit) capacity_misses++;
+        else conflict_misses++;
+    }
+    
+    // Read a resident word without touching LRU state or statistics (DMA snoops)
+    bool peek(uint64_t address, int& data) {
+        int block_index = -1;
+        if (!is_hit(address, block_index)) return false;
+        auto [set_index, tag] = get_set_and_tag(address);
+        data = sets[set_index][block_index].data[(address % block_size_bytes) / 4];
+        return true;
+    }
+    
+    // Update a resident word without touching LRU state or statistics
+    bool poke(uint64_t address, int data) {
+        int block_index = -1;
+        if (!is_hit(address, block_index)) return false;
+        auto [set_index, tag] = get_set_and_tag(address);
+        sets[set_index][block_index].data[(address % block_size_bytes) / 4] = data;
+        sets[set_index][block_index].dirty = true;
+        return true;
+    }
+    
+    // Write data to cache (only the bytes selected by byte_mask change)
+    bool write(uint64_t address, int data, int current_cycle, bool update_stats = true,
+               uint32_t byte_mask = 0xFFFFFFFF) {
         int block_index = -1;
         bool hit = is_hit(address, block_index);
         
@@ -253,1092 +1213,6611 @@ public:
             int word_offset = (address % block_size_bytes) / 4;
             
             // Write data to cache
-            sets[set_index][block_index].data[word_offset] = data;
+            int& word = sets[set_index][block_index].data[word_offset];
+            word = static_cast<int>((static_cast<uint32_t>(word) & ~byte_mask) |
+                                    (static_cast<uint32_t>(data) & byte_mask));
             sets[set_index][block_index].dirty = true;
             
             // Update LRU information
             sets[set_index][block_index].last_used_cycle = current_cycle;
             
-            if (update_stats) hits++;
+            if (update_stats) record_access(address, true);
             return true;
         }
         
-        if (update_stats) misses++;
+        if (update_stats) record_access(address, false);
         return false;
     }
     
-    // Load block from lower level (L2 or memory)
-    void load_block(uint64_t address, vector<int>& block_data, int current_cycle) {
+    // A block pushed out by load_block
+    struct Eviction {
+        bool valid = false;
+        bool dirty = false;
+        uint64_t address = 0;
+        vector<int> data;
+    };
+    
+    // Load block from the level below; the victim it replaces is handed back so the caller
+    // can write it back or move it down the hierarchy
+    Eviction load_block(uint64_t address, const vector<int>& block_data, int current_cycle, bool dirty = false) {
         auto [set_index, tag] = get_set_and_tag(address);
         
         // Find victim block
         int victim_index = find_victim(set_index, current_cycle);
+        CacheBlock& block = sets[set_index][victim_index];
+        
+        Eviction victim;
+        if (block.valid) {
+            victim.valid = true;
+            victim.dirty = block.dirty;
+            victim.address = get_block_address(set_index, block.tag);
+            victim.data = block.data;
+        }
         
         // Update cache block
-        sets[set_index][victim_index].valid = true;
-        sets[set_index][victim_index].dirty = false;
-        sets[set_index][victim_index].tag = tag;
-        sets[set_index][victim_index].last_used_cycle = current_cycle;
+        block.valid = true;
+        block.dirty = dirty;
+        block.tag = tag;
+        block.last_used_cycle = current_cycle;
         
         // Copy data to cache block
-        for (size_t i = 0; i < block_data.size() && i < sets[set_index][victim_index].data.size(); i++) {
-            sets[set_index][victim_index].data[i] = block_data[i];
+        for (size_t i = 0; i < block_data.size() && i < block.data.size(); i++) {
+            block.data[i] = block_data[i];
         }
+        
+        return victim;
     }
     
-    // Get block data for writing back to lower level
-    vector<int> get_block_data(int set_index, int block_index) {
-        return sets[set_index][block_index].data;
+    // Copy out a resident block; dirty (if given) says whether it is newer than the level below
+    bool copy_block(uint64_t address, vector<int>& block_data, bool* dirty = nullptr) {
+        int block_index = -1;
+        if (!is_hit(address, block_index)) return false;
+        auto [set_index, tag] = get_set_and_tag(address);
+        block_data = sets[set_index][block_index].data;
+        if (dirty) *dirty = sets[set_index][block_index].dirty;
+        return true;
     }
     
-    // Calculate miss rate
-    double get_miss_rate() {
-        int total = hits + misses;
-        return total > 0 ? static_cast<double>(misses) / total : 0.0;
+    // Remove a resident block without writing it back
+    void drop(uint64_t address) {
+        int block_index = -1;
+        if (!is_hit(address, block_index)) return;
+        auto [set_index, tag] = get_set_and_tag(address);
+        sets[set_index][block_index].valid = false;
+    }
+    
+    // Hand back a dirty block's data and keep it as a clean copy
+    bool clean(uint64_t address, vector<int>& block_data) {
+        int block_index = -1;
+        if (!is_hit(address, block_index)) return false;
+        auto [set_index, tag] = get_set_and_tag(address);
+        CacheBlock& block = sets[set_index][block_index];
+        if (!block.dirty) return false;
+        block_data = block.data;
+        block.dirty = false;
+        return true;
+    }
+    
+    // Rebuild the block address from a set index and tag
+    uint64_t get_block_address(int set_index, uint64_t tag) {
+        return (tag * num_sets + set_index) * block_size_bytes;
+    }
+    
+    // Overwrite a resident block with newer data from an upper level
+    bool update_block(uint64_t address, const vector<int>& block_data) {
+        int block_index = -1;
+        if (!is_hit(address, block_index)) return false;
+        
+        auto [set_index, tag] = get_set_and_tag(address);
+        sets[set_index][block_index].data = block_data;
+        sets[set_index][block_index].dirty = true;
+        return true;
+    }
+    
+    // Drop a block another core wrote (private caches); its next miss counts as a coherence miss
+    void invalidate(uint64_t address) {
+        int block_index = -1;
+        if (!is_hit(address, block_index)) return;
+        auto [set_index, tag] = get_set_and_tag(address);
+        sets[set_index][block_index].valid = false;
+        invalidated.insert(address / block_size_bytes);
     }
     
     // Reset statistics
     void reset_stats() {
         hits = 0;
         misses = 0;
+        compulsory_misses = capacity_misses = conflict_misses = coherence_misses = 0;
+        bank_accesses = bank_conflicts = bank_conflict_cycles = 0;
+        estimated_hits = estimated_misses = 0;
+        miss_credit = 0;
+        set_accesses.assign(num_sets, 0);
+        set_misses.assign(num_sets, 0);
     }
 };
 
-// Memory hierarchy class to manage caches and main memory
-class MemoryHierarchy {
+// Sparse main memory backed by pages that are allocated on first write
+class PagedMemory {
 public:
-    Cache* l1i_cache;
-    Cache* l1d_cache;
-    Cache* l2_cache;
-    vector<vector<int>> main_memory;  // Main memory
-    vector<vector<int>> scratchpad;   // Scratchpad memory
+    int page_size_bytes;         // Page size in bytes
+    int page_shift;              // log2(page_size_bytes)
+    int words_per_page;          // 4-byte words per page
     
-    int l1_latency;
-    int l2_latency;
-    int memory_latency;
-    int num_cores;
+    unordered_map<uint64_t, vector<int>> page_table; // Page number -> page data
     
-    // Memory access statistics
-    int memory_accesses = 0;
-    int memory_stalls = 0;
+    // Small direct-mapped software TLB in front of the page table
+    static const int TLB_INDEX_BITS = 4;
+    static const int TLB_ENTRIES = 1 << TLB_INDEX_BITS;
+    struct TlbEntry {
+        uint64_t page_number = UINT64_MAX;
+        int* data = nullptr;
+    };
+    array<TlbEntry, TLB_ENTRIES> tlb;
     
-    // Constructor
-    MemoryHierarchy(const CacheConfig& config, int cores) : 
-        l1_latency(config.l1_latency),
-        l2_latency(config.l2_latency),
-        memory_latency(config.memory_latency),
-        num_cores(cores) {
-        
-        // Initialize caches
-        l1i_cache = new Cache("L1I", config.l1i_size, config.block_size, 
-                             config.l1i_associativity, config.l1_latency, 
-                             config.replacement_policy);
-                             
-        l1d_cache = new Cache("L1D", config.l1d_size, config.block_size, 
-                             config.l1d_associativity, config.l1_latency, 
-                             config.replacement_policy);
-                             
-        l2_cache = new Cache("L2", config.l2_size, config.block_size, 
-                            config.l2_associativity, config.l2_latency, 
-                            config.replacement_policy);
-        
-        // Initialize main memory and scratchpad
-        main_memory.resize(cores, vector<int>(1024, 0));
-        scratchpad.resize(cores, vector<int>(config.spm_size/4, 0)); // Assuming 4 bytes per word
-    }
+    uint64_t tlb_hits = 0;       // Lookups served by the software TLB
+    uint64_t tlb_misses = 0;     // Lookups that went to the page table
     
-    ~MemoryHierarchy() {
-        delete l1i_cache;
-        delete l1d_cache;
-        delete l2_cache;
+    // Constructor
+    PagedMemory(int page_size) :
+        page_size_bytes(page_size),
+        page_shift(0),
+        words_per_page(page_size / 4) {
+        while ((1 << page_shift) < page_size_bytes) page_shift++;
     }
     
-    // Read instruction from memory hierarchy
-    int read_instruction(int core_id, uint64_t address, int current_cycle, int& stall_cycles) {
-        memory_accesses++;
-        int data = 0;
-        stall_cycles = 0;
+    // Find the page holding an address, allocating it if requested
+    // Returns nullptr for untouched pages when not allocating
+    int* lookup_page(uint64_t address, bool allocate) {
+        uint64_t page_number = address >> page_shift;
+        // Fibonacci hashing keeps the per-core partitions from colliding
+        TlbEntry& entry = tlb[(page_number * 0x9E3779B97F4A7C15ULL) >> (64 - TLB_INDEX_BITS)];
         
-        // Try L1I cache
-        if (l1i_cache->read(address, data, current_cycle)) {
-            stall_cycles = l1_latency;
+        if (entry.page_number == page_number) {
+            tlb_hits++;
+            return entry.data;
         }
-        // Try L2 cache
-        else if (l2_cache->read(address, data, current_cycle)) {
-            stall_cycles = l1_latency + l2_latency;
-            
-            // Load block into L1I from L2
-            auto [set_index, tag] = l2_cache->get_set_and_tag(address);
-            int block_index = -1;
-            l2_cache->is_hit(address, block_index);
-            vector<int> block_data = l2_cache->get_block_data(set_index, block_index);
-            l1i_cache->load_block(address, block_data, current_cycle);
-        }
-        // Access main memory
-        else {
-            stall_cycles = l1_latency + l2_latency + memory_latency;
-            
-            // Calculate block address and load from main memory
-            uint64_t block_addr = (address / l1i_cache->block_size_bytes) * l1i_cache->block_size_bytes;
-            vector<int> block_data;
-            
-            for (int i = 0; i < l1i_cache->block_size_bytes/4; i++) {
-                uint64_t mem_addr = block_addr + i*4;
-                int word_data = 0;
-                
-                if (mem_addr < main_memory[core_id].size() * 4) {
-                    word_data = main_memory[core_id][mem_addr/4];
-                }
-                
-                block_data.push_back(word_data);
-            }
-            
-            // Load block into L2 and L1I
-            l2_cache->load_block(address, block_data, current_cycle);
-            l1i_cache->load_block(address, block_data, current_cycle);
-            
-            // Read the requested data
-            l1i_cache->read(address, data, current_cycle, false);
+        tlb_misses++;
+        
+        auto it = page_table.find(page_number);
+        if (it == page_table.end()) {
+            if (!allocate) return nullptr;
+            it = page_table.emplace(page_number, vector<int>(words_per_page, 0)).first;
         }
         
-        memory_stalls += stall_cycles;
-        return data;
+        // Page data never moves once allocated, so the pointer stays valid
+        entry.page_number = page_number;
+        entry.data = it->second.data();
+        return entry.data;
     }
     
-    // Read data from memory hierarchy
-    int read_data(int core_id, uint64_t address, int current_cycle, int& stall_cycles) {
-        memory_accesses++;
-        int data = 0;
-        stall_cycles = 0;
-        
-        // Try L1D cache
-        if (l1d_cache->read(address, data, current_cycle)) {
-            stall_cycles = l1_latency;
+    // Read a word; untouched memory reads as zero
+    int read_word(uint64_t address) {
+        int* page = lookup_page(address, false);
+        return page ? page[(address & (page_size_bytes - 1)) / 4] : 0;
+    }
+    
+    // Write a word, allocating its page if needed
+    void write_word(uint64_t address, int data) {
+        int* page = lookup_page(address, true);
+        page[(address & (page_size_bytes - 1)) / 4] = data;
+    }
+    
+    // Read a whole cache block starting at a block-aligned address
+    void read_block(uint64_t block_addr, vector<int>& block_data, int block_size_bytes) {
+        block_data.resize(block_size_bytes / 4);
+        for (int i = 0; i < block_size_bytes / 4; i++) {
+            block_data[i] = read_word(block_addr + i*4);
         }
-        // Try L2 cache
-        else if (l2_cache->read(address, data, current_cycle)) {
-            stall_cycles = l1_latency + l2_latency;
-            
-            // Load block into L1D from L2
-            auto [set_index, tag] = l2_cache->get_set_and_tag(address);
-            int block_index = -1;
-            l2_cache->is_hit(address, block_index);
-            vector<int> block_data = l2_cache->get_block_data(set_index, block_index);
-            l1d_cache->load_block(address, block_data, current_cycle);
+    }
+    
+    // Write a whole cache block starting at a block-aligned address
+    void write_block(uint64_t block_addr, const vector<int>& block_data) {
+        for (size_t i = 0; i < block_data.size(); i++) {
+            write_word(block_addr + i*4, block_data[i]);
         }
-        // Access main memory
-        else {
-            stall_cycles = l1_latency + l2_latency + memory_latency;
-            
-            // Calculate block address and load from main memory
-            uint64_t block_addr = (address / l1d_cache->block_size_bytes) * l1d_cache->block_size_bytes;
-            vector<int> block_data;
-            
-            for (int i = 0; i < l1d_cache->block_size_bytes/4; i++) {
-                uint64_t mem_addr = block_addr + i*4;
-                int word_data = 0;
-                
-                if (mem_addr/4 < main_memory[core_id].size()) {
-                    word_data = main_memory[core_id][mem_addr/4];
-                }
-                
-                block_data.push_back(word_data);
-            }
-            
-            // Load block into L2 and L1D
-            l2_cache->load_block(address, block_data, current_cycle);
-            l1d_cache->load_block(address, block_data, current_cycle);
-            
-            // Read the requested data
-            l1d_cache->read(address, data, current_cycle, false);
+    }
+    
+    // Host memory actually in use
+    size_t pages_allocated() const {
+        return page_table.size();
+    }
+};
+
+// Hardware lock and reservation tracking for atomic memory operations
+// Atomics take exclusive ownership of their cache line for the duration of
+// the access; a line owned by another core has to migrate through L2 first
+class AtomicUnit {
+public:
+    struct LineState {
+        int owner = -1;          // Core that last held the line for an atomic
+        int busy_until = 0;      // Cycle the hardware lock on the line is released
+    };
+    
+    int block_size_bytes;
+    int transfer_latency;        // Cycles to migrate ownership between cores
+    
+    unordered_map<uint64_t, LineState> lines;          // Block address -> lock state
+    vector<uint64_t> reservation_of_core;              // LR reservation per core (block address)
+    unordered_map<uint64_t, int> reservations_on_line; // Block address -> cores holding a reservation
+    
+    // Statistics
+    int atomic_operations = 0;
+    int ownership_transfers = 0;
+    int contention_stalls = 0;
+    int sc_successes = 0;
+    int sc_failures = 0;
+    
+    AtomicUnit(int cores, int block_size, int transfer_cycles) :
+        block_size_bytes(block_size),
+        transfer_latency(transfer_cycles),
+        reservation_of_core(cores, UINT64_MAX) {}
+    
+    uint64_t block_of(uint64_t address) const {
+        return address / block_size_bytes * block_size_bytes;
+    }
+    
+    // Try to take the hardware lock on a line; fails while another core holds it
+    // On success, extra_cycles is the ownership migration cost
+    bool acquire(int core_id, uint64_t address, int current_cycle, int& extra_cycles) {
+        LineState& line = lines[block_of(address)];
+        extra_cycles = 0;
+        
+        if (line.owner != core_id && line.busy_until > current_cycle) {
+            contention_stalls++;
+            return false;
         }
         
-        memory_stalls += stall_cycles;
-        return data;
+        if (line.owner != -1 && line.owner != core_id) {
+            extra_cycles = transfer_latency;
+            ownership_transfers++;
+        }
+        line.owner = core_id;
+        atomic_operations++;
+        return true;
     }
     
-    // Write data to memory hierarchy
-    void write_data(int core_id, uint64_t address, int data, int current_cycle, int& stall_cycles) {
-        memory_accesses++;
-        stall_cycles = 0;
+    // Hold the lock until the access has finished
+    void release_at(uint64_t address, int cycle) {
+        lines[block_of(address)].busy_until = cycle;
+    }
+    
+    // LR.W: reserve the line for a later SC.W
+    void reserve(int core_id, uint64_t address) {
+        clear_reservation(core_id);
+        reservation_of_core[core_id] = block_of(address);
+        reservations_on_line[block_of(address)]++;
+    }
+    
+    // SC.W succeeds only if the reservation survived; either way it is consumed
+    bool check_reservation(int core_id, uint64_t address) {
+        bool valid = reservation_of_core[core_id] == block_of(address);
+        clear_reservation(core_id);
+        if (valid) sc_successes++;
+        else sc_failures++;
+        return valid;
+    }
+    
+    void clear_reservation(int core_id) {
+        uint64_t block = reservation_of_core[core_id];
+        if (block == UINT64_MAX) return;
         
-        // Try L1D cache
-        if (l1d_cache->write(address, data, current_cycle)) {
-            stall_cycles = l1_latency;
+        auto it = reservations_on_line.find(block);
+        if (it != reservations_on_line.end() && --it->second == 0) reservations_on_line.erase(it);
+        reservation_of_core[core_id] = UINT64_MAX;
+    }
+    
+    // A store by any core breaks the other cores' reservations on that line
+    void invalidate_reservations(int writer, uint64_t address) {
+        if (reservations_on_line.empty()) return;
+        
+        uint64_t block = block_of(address);
+        if (!reservations_on_line.count(block)) return;
+        for (size_t core = 0; core < reservation_of_core.size(); core++) {
+            if (static_cast<int>(core) != writer && reservation_of_core[core] == block) {
+                clear_reservation(static_cast<int>(core));
+            }
         }
-        // Try L2 cache
-        else if (l2_cache->write(address, data, current_cycle)) {
-            stall_cycles = l1_latency + l2_latency;
-            
-            // Update L1D
-            auto [set_index, tag] = l2_cache->get_set_and_tag(address);
-            int block_index = -1;
-            l2_cache->is_hit(address, block_index);
-            vector<int> block_data = l2_cache->get_block_data(set_index, block_index);
-            l1d_cache->load_block(address, block_data, current_cycle);
-            l1d_cache->write(address, data, current_cycle, false);
+    }
+};
+
+// Set-associative TLB with LRU replacement. Entries are keyed by core and virtual page
+// number, so one instance can be shared by several cores' address spaces
+class Tlb {
+public:
+    struct Entry {
+        uint64_t key;
+        uint64_t last_used;
+    };
+    
+    string name;
+    int num_sets = 1;
+    int ways = 1;
+    vector<vector<Entry>> sets;
+    uint64_t use_clock = 0;
+    
+    long long hits = 0;
+    long long misses = 0;
+    
+    Tlb() {}
+    Tlb(const string& tlb_name, int entries, int associativity) :
+        name(tlb_name),
+        num_sets(max(1, entries / min(associativity, entries))),
+        ways(min(associativity, entries)),
+        sets(num_sets) {}
+    
+    static uint64_t key_of(int core_id, uint64_t page_number) {
+        return (static_cast<uint64_t>(core_id) << 32) | page_number;
+    }
+    
+    bool lookup(uint64_t key) {
+        for (Entry& entry : sets[key % num_sets]) {
+            if (entry.key != key) continue;
+            entry.last_used = ++use_clock;
+            hits++;
+            return true;
         }
-        // Write to main memory
-        else {
-            stall_cycles = l1_latency + l2_latency + memory_latency;
-            
-            // Update main memory
-            if (address/4 < main_memory[core_id].size()) {
-                main_memory[core_id][address/4] = data;
+        misses++;
+        return false;
+    }
+    
+    void insert(uint64_t key) {
+        vector<Entry>& set = sets[key % num_sets];
+        if (static_cast<int>(set.size()) < ways) {
+            set.push_back({key, ++use_clock});
+            return;
+        }
+        auto victim = min_element(set.begin(), set.end(),
+                                  [](const Entry& a, const Entry& b) { return a.last_used < b.last_used; });
+        *victim = {key, ++use_clock};
+    }
+    
+    double get_miss_rate() const {
+        return hits + misses > 0 ? static_cast<double>(misses) / (hits + misses) : 0.0;
+    }
+};
+
+// Network on chip joining the physical cores' routers, which carries LDC/SWC accesses to
+// other cores' memories. A mesh routes in dimension order (XY or YX) over a full grid of
+// routers; a ring sends each packet the shorter way round. A packet's head takes hop_latency
+// cycles per hop and its flits follow one per cycle. On each link it needs the link itself
+// for one cycle per flit, and one of the link's virtual channels until its tail reaches the
+// next router. Like the cache bank ports, links and channels are reserved by the cycle they
+// are free again.
+class NetworkOnChip {
+public:
+    struct Link {
+        int from;
+        int to;
+        int free_at = 0;            // Cycle the link can start another packet's flits
+        vector<int> channel_free;   // Per virtual channel
+        long long packets = 0;
+        long long flits = 0;        // Cycles the link was busy
+        long long wait_cycles = 0;  // Cycles packets waited for the link or a channel
+    };
+    
+    static const int HEADER_BYTES = 8;  // Request and reply headers; data words come on top
+    static const int DIRECTIONS = 4;    // Mesh: east, west, north, south; ring: clockwise, anticlockwise
+    
+    bool ring;
+    bool yx_routing;
+    int nodes;              // Routers; a mesh has a full grid of them
+    int cores;              // Routers with a core attached
+    int columns;
+    int rows;
+    int hop_latency;
+    int link_width;
+    vector<Link> links;
+    vector<array<int, DIRECTIONS>> out_link;    // Link leaving each router in each direction, -1 for none
+    
+    // NUMA distance: remote accesses and their round-trip cycles by hop count
+    vector<long long> accesses_by_hops;
+    vector<long long> cycles_by_hops;
+    
+    NetworkOnChip(const CacheConfig& config, int physical_cores) :
+        ring(config.noc_topology == "RING"),
+        yx_routing(config.noc_routing == "YX"),
+        cores(physical_cores),
+        hop_latency(config.noc_hop_latency),
+        link_width(config.noc_link_width) {
+        columns = ring ? physical_cores : config.noc_mesh_columns;
+        if (columns == 0) columns = static_cast<int>(ceil(sqrt(static_cast<double>(physical_cores))));
+        rows = ring ? 1 : (physical_cores + columns - 1) / columns;
+        nodes = ring ? physical_cores : columns * rows;
+        
+        out_link.assign(nodes, {-1, -1, -1, -1});
+        for (int n = 0; n < nodes; n++) {
+            for (int d = 0; d < (ring ? 2 : DIRECTIONS); d++) {
+                int to = neighbour(n, d);
+                if (to < 0 || to == n) continue;
+                out_link[n][d] = static_cast<int>(links.size());
+                Link link;
+                link.from = n;
+                link.to = to;
+                link.channel_free.assign(config.noc_virtual_channels, 0);
+                links.push_back(move(link));
             }
-            
-            // Load block into caches
-            uint64_t block_addr = (address / l1d_cache->block_size_bytes) * l1d_cache->block_size_bytes;
-            vector<int> block_data;
-            
-            for (int i = 0; i < l1d_cache->block_size_bytes/4; i++) {
-                uint64_t mem_addr = block_addr + i*4;
-                int word_data = 0;
-                
-                if (mem_addr/4 < main_memory[core_id].size()) {
-                    word_data = main_memory[core_id][mem_addr/4];
-                }
-                
-                block_data.push_back(word_data);
+        }
+    }
+    
+    // Router next to n in direction d, -1 off the edge of the mesh
+    int neighbour(int n, int d) const {
+        if (ring) return d == 0 ? (n + 1) % nodes : (n + nodes - 1) % nodes;
+        int x = n % columns, y = n / columns;
+        if (d == 0) return x + 1 < columns ? n + 1 : -1;
+        if (d == 1) return x > 0 ? n - 1 : -1;
+        if (d == 2) return y > 0 ? n - columns : -1;
+        return y + 1 < rows ? n + columns : -1;
+    }
+    
+    // Links a packet crosses from one router to another
+    vector<int> route(int from, int to) const {
+        vector<int> path;
+        for (int n = from; n != to; n = links[path.back()].to) {
+            int d;
+            if (ring) {
+                d = (to - n + nodes) % nodes <= nodes / 2 ? 0 : 1;
+            } else {
+                int dx = to % columns - n % columns, dy = to / columns - n / columns;
+                bool along_x = dx != 0 && (!yx_routing || dy == 0);
+                d = along_x ? (dx > 0 ? 0 : 1) : (dy < 0 ? 2 : 3);
             }
-            
-            // Update the specific word
-            int word_offset = (address % l1d_cache->block_size_bytes) / 4;
-            block_data[word_offset] = data;
-            
-            // Load block into L2 and L1D
-            l2_cache->load_block(address, block_data, current_cycle);
-            l1d_cache->load_block(address, block_data, current_cycle);
+            path.push_back(out_link[n][d]);
         }
-        
-        memory_stalls += stall_cycles;
+        return path;
     }
     
-    // Read from scratchpad memory
-    int read_spm(int core_id, int address, int& stall_cycles) {
-        stall_cycles = l1_latency; // SPM has same latency as L1
-        
-        if (address >= 0 && address/4 < scratchpad[core_id].size()) {
-            return scratchpad[core_id][address/4];
+    int hops(int from, int to) const {
+        if (ring) return min((to - from + nodes) % nodes, (from - to + nodes) % nodes);
+        return abs(to % columns - from % columns) + abs(to / columns - from / columns);
+    }
+    
+    // Send a packet of the given size; returns the cycle its tail arrives
+    int send(int from, int to, int bytes, int cycle) {
+        int flits = (bytes + link_width - 1) / link_width;
+        int head = cycle;
+        for (int l : route(from, to)) {
+            Link& link = links[l];
+            auto channel = min_element(link.channel_free.begin(), link.channel_free.end());
+            int start = max(head, max(*channel, link.free_at));
+            link.wait_cycles += start - head;
+            link.free_at = start + flits;
+            *channel = start + flits + hop_latency;
+            link.packets++;
+            link.flits += flits;
+            head = start + hop_latency;
         }
-        
-        return 0; // Return 0 for invalid address
+        return head == cycle ? cycle : head + flits - 1;
     }
     
-    // Write to scratchpad memory
-    void write_spm(int core_id, int address, int data, int& stall_cycles) {
-        stall_cycles = l1_latency; // SPM has same latency as L1
-        
-        if (address >= 0 && address/4 < scratchpad[core_id].size()) {
-            scratchpad[core_id][address/4] = data;
+    void record(int from, int to, int cycles) {
+        size_t distance = hops(from, to);
+        if (accesses_by_hops.size() <= distance) {
+            accesses_by_hops.resize(distance + 1, 0);
+            cycles_by_hops.resize(distance + 1, 0);
         }
+        accesses_by_hops[distance]++;
+        cycles_by_hops[distance] += cycles;
     }
     
-    // Get cache statistics
-    string get_stats() {
+    string describe() const {
         stringstream ss;
-        ss << "Cache Statistics:" << endl;
-        ss << "L1I hits: " << l1i_cache->hits << ", misses: " << l1i_cache->misses 
-           << ", miss rate: " << l1i_cache->get_miss_rate() * 100 << "%" << endl;
-        ss << "L1D hits: " << l1d_cache->hits << ", misses: " << l1d_cache->misses 
-           << ", miss rate: " << l1d_cache->get_miss_rate() * 100 << "%" << endl;
-        ss << "L2 hits: " << l2_cache->hits << ", misses: " << l2_cache->misses 
-           << ", miss rate: " << l2_cache->get_miss_rate() * 100 << "%" << endl;
-        ss << "Total memory accesses: " << memory_accesses << endl;
-        ss << "Total memory stalls: " << memory_stalls << " cycles" << endl;
-        
+        if (ring) ss << nodes << "-router ring";
+        else ss << columns << "x" << rows << " mesh, " << (yx_routing ? "YX" : "XY") << " routing";
+        ss << ", " << hop_latency << " cycles per hop, " << link_width << "-byte flits, "
+           << links[0].channel_free.size() << " virtual channel(s)";
+        return ss.str();
+    }
+    
+    // Cycles link utilization is measured over. Memory stalls only count by default, so
+    // reservations can run past the last simulated cycle
+    long long span(long long total_cycles) const {
+        for (const Link& link : links) total_cycles = max<long long>(total_cycles, link.free_at);
+        return total_cycles;
+    }
+    
+    // Remote accesses by distance, then every link that carried traffic
+    string get_stats(int total_cycles) const {
+        long long cycles = span(total_cycles);
+        stringstream ss;
+        ss << "Network on chip: " << (links.empty() ? "single router" : describe()) << endl;
+        ss << "Remote accesses by distance:";
+        long long accesses = 0;
+        for (size_t h = 0; h < accesses_by_hops.size(); h++) {
+            if (accesses_by_hops[h] == 0) continue;
+            accesses += accesses_by_hops[h];
+            ss << " " << h << (h == 1 ? " hop: " : " hops: ") << accesses_by_hops[h] << " ("
+               << static_cast<double>(cycles_by_hops[h]) / accesses_by_hops[h] << " cycles)";
+        }
+        if (accesses == 0) ss << " none";
+        ss << endl;
+        for (const Link& link : links) {
+            if (link.packets == 0) continue;
+            ss << "Link " << link.from << "->" << link.to << ": " << link.packets << " packets, "
+               << link.flits << " flits, utilization "
+               << (cycles > 0 ? 100.0 * link.flits / cycles : 0.0)
+               << "%, wait " << link.wait_cycles << " cycles" << endl;
+        }
         return ss.str();
     }
 };
 
-// Synchronization barrier for SYNC instruction
-class SyncBarrier {
-private:
-    int num_cores;
-    int remaining;
-    int barrier_id;
-    
+// Memory hierarchy class to manage caches and main memory
+class MemoryHierarchy {
 public:
-    SyncBarrier(int cores) : num_cores(cores), remaining(cores), barrier_id(0) {}
+    // All instances of one configured cache level (one per core when private)
+    struct CacheLevel {
+        string name;
+        vector<Cache*> instances;
+        
+        CacheStats totals() const {
+            CacheStats total;
+            for (const Cache* cache : instances) total.add(*cache);
+            return total;
+        }
+    };
     
-    // Core reaches barrier
-    bool reach_barrier(int core_id) {
-        // Decrement counter
-        remaining--;
+    vector<CacheLevel> levels;        // Top of the hierarchy first
+    vector<Cache*> caches;            // Every cache instance, top levels first
+    vector<Cache*> instruction_entry; // Level each core fetches instructions from
+    vector<Cache*> data_entry;        // Level each core loads and stores through
+    vector<vector<Cache*>> private_caches; // Each physical core's private instances, top levels first
+    bool has_private_levels = false;
+    bool custom_hierarchy = false;    // Configured with CACHE_LEVEL/VICTIM_CACHE lines
+    PagedMemory main_memory;          // Main memory (sparse, paged)
+    vector<vector<int>> scratchpad;   // Scratchpad memory
+    
+    int l1_latency;
+    int l2_latency;
+    int memory_latency;
+    int block_size;
+    int num_cores;          // Hardware threads; each has its own data partition and scratchpad
+    int threads_per_core;   // SMT threads sharing a physical core's private cache levels
+    
+    // The physical address space is split into 4GB partitions: partition 0
+    // holds the program image and the shared data window, partition c+1 is
+    // the private data memory of core c. Further programs of a multi-program
+    // workload keep their code above those, program k in partition num_cores+k
+    // Each core's partition is also rotated by core * partition_stagger bytes, a slice of the
+    // first data cache's sets, so identical private addresses of different cores fall into
+    // different sets of the shared levels instead of all competing for the same ones
+    static const int CORE_PARTITION_BITS = 32;
+    uint64_t partition_stagger = 0;
+    uint64_t shared_base;             // Core addresses at or above this are shared by all cores
+    vector<int> core_program;         // Program each core runs
+    
+    // Virtual memory: each core's 32-bit address space is translated page by page. Pages map
+    // onto the same addresses (the partitions already keep the cores apart), so translation
+    // only costs time. An L1 TLB miss looks in the shared L2 TLB; an L2 TLB miss walks the
+    // core's page table, reading one entry per level through the core's data caches. Core c's
+    // page tables live in partition PAGE_TABLE_PARTITION + c
+    static const uint64_t PAGE_TABLE_PARTITION = 1ULL << 16;
+    bool virtual_memory = false;
+    int vm_page_bits = 12;            // log2 of the translation page size
+    vector<int> walk_level_bits;      // Page number bits each page table level indexes, root first
+    vector<Tlb> itlb;                 // Per core
+    vector<Tlb> dtlb;                 // Per core
+    Tlb l2_tlb;                       // Shared by all cores
+    int l2_tlb_latency = 0;
+    vector<long long> page_walks;     // Per core
+    vector<long long> walk_cycles;    // Per core, cycles spent reading page table entries
+    
+    AtomicUnit atomics;               // Hardware locks and LR/SC reservations
+    NetworkOnChip* noc = nullptr;     // Carries LDC/SWC between physical cores; none makes them local-cost
+    
+    // Functional execution reads and writes the freshest copy of each word, leaving cache
+    // contents, replacement state and statistics alone
+    bool functional = false;
+    long long functional_shared_accesses = 0; // Functional accesses to partition 0 (the shared window)
+    long long functional_misses = 0;          // Functional accesses the core's first data level lacks
+    
+    // Memory access statistics
+    int memory_accesses = 0;
+    int memory_stalls = 0;
+    long long top_level_misses = 0;   // Misses in the levels cores access directly
+    long long last_level_misses = 0;  // Misses that went to main memory
+    long long inclusion_invalidations = 0; // Upper-level copies removed by inclusive evictions
+    long long coherence_invalidations = 0; // Private copies removed by another core's write
+    
+    // Bandwidth of the shared L2 port and main memory channel: the cycle each is free
+    // again. Core misses and DMA blocks both occupy them; DMA blocks queue behind
+    // earlier traffic. Core misses only count latency unless memory is blocking, when
+    // they also wait for the port and channel
+    bool blocking_refills;
+    int l2_port_free = 0;
+    int memory_channel_free = 0;
+    int l2_transfer_cycles;         // Cycles one block occupies the L2 port
+    int memory_transfer_cycles;     // Cycles one block occupies the memory channel
+    long long dma_blocks = 0;       // Blocks moved by DMA engines
+    long long dma_queue_cycles = 0; // Cycles DMA blocks waited for the L2 port or memory channel
+    
+    // Constructor
+    MemoryHierarchy(const CacheConfig& config, int cores) : 
+        main_memory(config.page_size),
+        l1_latency(config.l1_latency),
+        l2_latency(config.l2_latency),
+        memory_latency(config.memory_latency),
+        block_size(config.block_size),
+        num_cores(cores),
+        threads_per_core(config.smt_threads),
+        shared_base(config.shared_memory_base),
+        atomics(cores, config.block_size, config.l2_latency),
+        blocking_refills(config.memory_blocking),
+        l2_transfer_cycles(max(1, config.block_size / config.l2_bandwidth)),
+        memory_transfer_cycles(max(1, config.block_size / config.memory_bandwidth)) {
         
-        // If all cores have reached the barrier
-        if (remaining == 0) {
-            // Reset for next barrier
-            remaining = num_cores;
-            barrier_id++;
-            return true; // Last core to reach barrier
+        build_caches(config);
+        core_program.assign(cores, 0);
+        if (config.virtual_memory) build_tlbs(config);
+        if (config.noc_topology != "NONE") noc = new NetworkOnChip(config, cores / threads_per_core);
+        
+        // Initialize scratchpad (main memory pages are allocated on demand)
+        scratchpad.resize(cores, vector<int>(config.spm_size/4, 0)); // Assuming 4 bytes per word
+    }
+    
+    ~MemoryHierarchy() {
+        for (Cache* cache : caches) delete cache;
+        delete noc;
+    }
+    
+    // Per-core L1 TLBs, the shared L2 TLB and the page table layout for the page size. A page
+    // of 4-byte entries makes up a table, as in Sv32; the root level takes the leftover bits
+    void build_tlbs(const CacheConfig& config) {
+        virtual_memory = true;
+        while ((1 << vm_page_bits) < config.vm_page_size) vm_page_bits++;
+        int page_number_bits = CORE_PARTITION_BITS - vm_page_bits;
+        int table_bits = vm_page_bits - 2;
+        for (int bits = page_number_bits; bits > 0; bits -= table_bits) {
+            walk_level_bits.insert(walk_level_bits.begin(), min(bits, table_bits));
         }
         
-        return false; // Not last core
+        for (int c = 0; c < num_cores; c++) {
+            itlb.emplace_back("ITLB", config.itlb_entries, config.tlb_associativity);
+            dtlb.emplace_back("DTLB", config.dtlb_entries, config.tlb_associativity);
+        }
+        l2_tlb = Tlb("L2 TLB", config.l2_tlb_entries, config.l2_tlb_associativity);
+        l2_tlb_latency = config.l2_tlb_latency;
+        page_walks.assign(num_cores, 0);
+        walk_cycles.assign(num_cores, 0);
     }
     
-    // Get current barrier ID
-    int get_barrier_id() const {
-        return barrier_id;
+    // Create the cache instances of every level and link each to the level it misses into
+    void build_caches(const CacheConfig& config) {
+        vector<CacheLevelConfig> hierarchy = config.cache_hierarchy();
+        custom_hierarchy = !config.cache_levels.empty() || !config.victim_caches.empty();
+        int physical_cores = num_cores / threads_per_core;
+        private_caches.assign(physical_cores, {});
+        
+        for (const auto& level : hierarchy) {
+            CacheLevel instances{level.name, {}};
+            for (int c = 0; c < (level.is_private ? physical_cores : 1); c++) {
+                Cache* cache = new Cache(level.name, level.size, config.block_size, level.associativity,
+                                         level.latency, config.replacement_policy);
+                cache->is_private = level.is_private;
+                cache->inclusion = level.inclusion == "INCLUSIVE" ? InclusionPolicy::INCLUSIVE :
+                                   level.inclusion == "EXCLUSIVE" ? InclusionPolicy::EXCLUSIVE :
+                                                                    InclusionPolicy::NON_INCLUSIVE;
+                for (const auto& banking : config.cache_banks) {
+                    if (banking.level != level.name) continue;
+                    cache->configure_banks(banking.banks, banking.ports,
+                                           banking.interleave > 0 ? banking.interleave : config.block_size);
+                }
+                for (const auto& sampling : config.cache_sampling) {
+                    if (sampling.level == level.name) cache->configure_sampling(sampling.interval);
+                }
+                instances.instances.push_back(cache);
+                caches.push_back(cache);
+                if (level.is_private) private_caches[c].push_back(cache);
+            }
+            has_private_levels = has_private_levels || level.is_private;
+            levels.push_back(instances);
+        }
+        
+        for (size_t i = 0; i < hierarchy.size(); i++) {
+            int parent = CacheConfig::parent_level(hierarchy, static_cast<int>(i));
+            if (parent < 0) continue;
+            for (size_t c = 0; c < levels[i].instances.size(); c++) {
+                Cache* child = levels[i].instances[c];
+                child->parent = levels[parent].instances[hierarchy[parent].is_private ? c : 0];
+                child->parent->children.push_back(child);
+            }
+        }
+        
+        // Cores start at the first listed level of each kind
+        for (size_t i = 0; i < hierarchy.size(); i++) {
+            if (!hierarchy[i].victim_of.empty()) continue;
+            for (int c = 0; c < num_cores; c++) {
+                Cache* cache = levels[i].instances[hierarchy[i].is_private ? physical_core(c) : 0];
+                if (hierarchy[i].kind != 'D' && instruction_entry.size() < static_cast<size_t>(num_cores)) {
+                    instruction_entry.push_back(cache);
+                }
+                if (hierarchy[i].kind != 'I' && data_entry.size() < static_cast<size_t>(num_cores)) {
+                    data_entry.push_back(cache);
+                }
+            }
+        }
+        
+        if (!data_entry.empty()) {
+            partition_stagger = static_cast<uint64_t>(block_size) * max(1, data_entry[0]->num_sets / num_cores);
+        }
     }
-};
-
-class Core
-{
-public:
-    array<array<int, 32>, 4> registers{}; // 4 compute units, each with 32 registers
     
-    int pc; // Program Counter
-    bool forwarding; // Forwarding flag (for data forwarding in pipeline)
-    unordered_map<string, int> latencies; // Latencies for instructions (ADD, SUB, etc.)
-    int stalls = 0; // Count of pipeline stalls
-    int memory_stalls = 0; // Stalls due to memory access
-    int sync_stalls = 0;   // Stalls due to synchronization
-    int executed_instructions = 0; // Count of executed instructions
-    int CID; // Compute Unit ID
+    // Physical core a hardware thread runs on
+    int physical_core(int core_id) const {
+        return core_id / threads_per_core;
+    }
     
-    // Synchronization state
-    bool waiting_for_sync = false;
-    int barrier_id = -1;
+    // Map a core-local data address into the physical address space
+    uint64_t physical_address(int core_id, uint64_t address) const {
+        const uint64_t mask = (1ULL << CORE_PARTITION_BITS) - 1;
+        address &= mask;
+        if (address >= shared_base) return address;
+        address = (address + static_cast<uint64_t>(core_id) * partition_stagger) & mask;
+        return (static_cast<uint64_t>(core_id + 1) << CORE_PARTITION_BITS) | address;
+    }
     
-    // Pipeline structures
-    deque<Instruction> pipeline_stages[5]; // One queue for each pipeline stage
-    unordered_map<int, pair<int, int>> register_status; // Maps reg -> (producing_instr_idx, ready_cycle)
-    vector<Instruction> completed_instructions; // History of all executed instructions
+    // Map an instruction address into the shared program partition
+    uint64_t instruction_address(uint64_t address) const {
+        return address & ((1ULL << CORE_PARTITION_BITS) - 1);
+    }
     
-    int current_cycle = 0; // Current clock cycle
-    bool branch_taken = false; // Flag for taken branches/jumps
-    int instr_count = 0; // Counter for instruction IDs
-
-    // Memory hierarchy reference
-    MemoryHierarchy* memory;
-    SyncBarrier* sync_barrier;
-
-    // Constructor to initialize the core properties
-    Core(int id, bool enable_forwarding, MemoryHierarchy* mem_hierarchy, SyncBarrier* barrier)
-    {
-        pc = 0;
-        forwarding = enable_forwarding;
-        CID = id;
-        memory = mem_hierarchy;
-        sync_barrier = barrier;
-
-        // Initialize registers for the core
-        for (int i = 0; i < 32; ++i)
-        {
-            registers[CID][i] = 0;
+    // Map an instruction address into the partition holding a program's code
+    uint64_t program_address(int program, uint64_t address) const {
+        uint64_t partition = program == 0 ? 0 : num_cores + program;
+        return (partition << CORE_PARTITION_BITS) | instruction_address(address);
+    }
+    
+    // Only partition 0 (program and shared window) can be cached by several cores' private levels
+    bool shared_by_cores(uint64_t physical) const {
+        return has_private_levels && (physical >> CORE_PARTITION_BITS) == 0;
+    }
+    
+    // Occupy a shared port for duration cycles from the given cycle on; returns when the transfer ends
+    static int occupy(int& free_at, int cycle, int duration) {
+        int start = max(cycle, free_at);
+        free_at = start + duration;
+        return free_at;
+    }
+    
+    // A core miss served by L2, or by memory through L2. Returns the cycles it waited for the
+    // port or channel behind earlier traffic (DMA blocks included); only blocking memory
+    // charges them to the core
+    int note_refill(int current_cycle, bool from_memory) {
+        int wait = occupy(l2_port_free, current_cycle, l2_transfer_cycles) - current_cycle - l2_transfer_cycles;
+        if (from_memory) {
+            wait = max(wait, occupy(memory_channel_free, current_cycle, memory_transfer_cycles) -
+                             current_cycle - memory_transfer_cycles);
         }
+        return blocking_refills ? wait : 0;
     }
-
-    // Convert register name (e.g., x1) to index (1 for x1)
-    int reg_index(const string &r) { return stoi(r.substr(1, r.size() - 1)); }
-
-    // Set instruction latencies for the core
-    void set_latencies(const unordered_map<string, int>& latencies_map)
-    {
-        latencies = latencies_map;
+    
+    // Freshest copy of a word: the highest level holding it, else main memory
+    int coherent_read(uint64_t physical) {
+        int data = 0;
+        for (Cache* cache : caches) {
+            if (cache->peek(physical, data)) return data;
+        }
+        return main_memory.read_word(physical);
     }
-
-    // Check for data hazards in the ID stage
-    bool check_hazards(const Instruction& instr, int& stall_cycles) {
-        stall_cycles = 0;
+    
+    // Update every copy of a word so no level holds stale data
+    void coherent_write(int core_id, uint64_t physical, int data) {
+        bool cached = false;
+        for (Cache* cache : caches) cached = cache->poke(physical, data) || cached;
+        if (!cached) main_memory.write_word(physical, data);
+        atomics.invalidate_reservations(core_id, physical);
+    }
+    
+    // Time one block of a core's DMA engine. The block comes from (or goes to) the core's first
+    // data level if it holds it, otherwise through the L2 port from the level below that does,
+    // and from main memory over the memory channel when no cache has it; nothing is allocated.
+    // Returns the cycle the block transfer completes.
+    // port_free is set to the cycle the engine may start its next block.
+    int dma_block(int core_id, uint64_t address, int start_cycle, int& port_free) {
+        uint64_t physical = physical_address(core_id, address);
+        Cache* holder = data_entry[core_id];
+        int block_index = -1;
+        while (holder && !holder->is_hit(physical, block_index)) holder = holder->parent;
+        
+        int done;
+        if (holder == data_entry[core_id]) {
+            port_free = start_cycle + 1;
+            done = start_cycle + holder->access_latency;
+        } else if (holder) {
+            port_free = occupy(l2_port_free, start_cycle, l2_transfer_cycles);
+            done = port_free + holder->access_latency;
+            dma_queue_cycles += port_free - l2_transfer_cycles - start_cycle;
+        } else {
+            port_free = occupy(memory_channel_free, start_cycle, memory_transfer_cycles);
+            done = port_free + memory_latency;
+            dma_queue_cycles += port_free - memory_transfer_cycles - start_cycle;
+        }
+        dma_blocks++;
+        return done;
+    }
+    
+    // Move the words of a DMA block between a core's memory and a buffer once it has completed
+    void dma_copy(int core_id, uint64_t address, int* words, int count, bool to_memory) {
+        for (int i = 0; i < count; i++) {
+            uint64_t word_address = physical_address(core_id, address + 4ULL * i);
+            if (to_memory) coherent_write(core_id, word_address, words[i]);
+            else words[i] = coherent_read(word_address);
+        }
+    }
+    
+    // Copy a program image into its code partition and the data memory of every core running it
+    void load_image(uint64_t address, const uint8_t* bytes, size_t size, int program = 0) {
+        for (size_t i = 0; i < size; ) {
+            uint64_t word_address = (address + i) & ~3ULL;
+            
+            // Merge the bytes that fall into this word
+            uint32_t word = static_cast<uint32_t>(main_memory.read_word(program_address(program, word_address)));
+            for (; i < size && ((address + i) & ~3ULL) == word_address; i++) {
+                int shift = ((address + i) & 3) * 8;
+                word = (word & ~(0xFFu << shift)) | (static_cast<uint32_t>(bytes[i]) << shift);
+            }
+            
+            main_memory.write_word(program_address(program, word_address), static_cast<int>(word));
+            for (int core = 0; core < num_cores; core++) {
+                if (core_program[core] != program) continue;
+                main_memory.write_word(physical_address(core, word_address), static_cast<int>(word));
+            }
+        }
+    }
+    
+    // Write a dirty block back to the first level at or below level that holds it, else to memory
+    void write_back(Cache* level, uint64_t address, const vector<int>& block_data) {
+        for (; level; level = level->parent) {
+            if (level->update_block(address, block_data)) return;
+        }
+        main_memory.write_block(address, block_data);
+    }
+    
+    // Read or write a word at the first level at or below level that holds it, else in memory,
+    // leaving replacement state, statistics and timing alone
+    void access_below(Cache* level, uint64_t address, bool is_write, int& data, uint32_t byte_mask) {
+        int word = 0;
+        for (; level && !level->peek(address, word); level = level->parent) {}
+        if (!level) word = main_memory.read_word(address);
+        if (!is_write) {
+            data = word;
+            return;
+        }
+        word = static_cast<int>((static_cast<uint32_t>(word) & ~byte_mask) | (static_cast<uint32_t>(data) & byte_mask));
+        if (level) level->poke(address, word);
+        else main_memory.write_word(address, word);
+    }
+    
+    // Fetch the block holding address from the first level at or below level that has it, else
+    // from memory. An exclusive level gives its copy up; dirty says whether that copy was newer
+    // than memory.
+    void fetch_block(Cache* level, uint64_t address, vector<int>& block_data, bool& dirty) {
+        dirty = false;
+        for (; level; level = level->parent) {
+            bool level_dirty = false;
+            if (!level->copy_block(address, block_data, &level_dirty)) continue;
+            if (level->inclusion == InclusionPolicy::EXCLUSIVE) {
+                dirty = level_dirty;
+                level->drop(address);
+            }
+            return;
+        }
+        uint64_t block_addr = (address / block_size) * block_size;
+        main_memory.read_block(block_addr, block_data, block_size);
+    }
+    
+    // Install a block in a cache and pass its victim down according to the inclusion policies
+    void fill(Cache* cache, uint64_t address, const vector<int>& block_data, bool dirty, int current_cycle) {
+        // A set that is not modelled holds nothing; newer data goes on down
+        if (!cache->models(address)) {
+            if (dirty) write_back(cache->parent, address, block_data);
+            return;
+        }
+        
+        int block_index = -1;
+        if (cache->is_hit(address, block_index)) {
+            if (dirty) cache->update_block(address, block_data);
+            return;
+        }
+        
+        Cache::Eviction victim = cache->load_block(address, block_data, current_cycle, dirty);
+        if (!victim.valid) return;
+        
+        // An inclusive level takes its victim out of every level above, keeping the newest data
+        if (cache->inclusion == InclusionPolicy::INCLUSIVE) back_invalidate(cache, victim);
+        
+        // Exclusive levels (victim caches) hold what the level above evicts, clean or dirty
+        Cache* below = cache->parent;
+        if (below && below->inclusion == InclusionPolicy::EXCLUSIVE) {
+            fill(below, victim.address, victim.data, victim.dirty, current_cycle);
+        } else if (victim.dirty) {
+            write_back(below, victim.address, victim.data);
+        }
+    }
+    
+    // Remove a victim from the levels above; a dirty copy up there is newer than the victim
+    void back_invalidate(Cache* cache, Cache::Eviction& victim) {
+        for (Cache* child : cache->children) {
+            vector<int> data;
+            bool dirty = false;
+            if (child->copy_block(victim.address, data, &dirty)) {
+                if (dirty) {
+                    victim.data = data;
+                    victim.dirty = true;
+                }
+                child->drop(victim.address);
+                inclusion_invalidations++;
+            }
+            back_invalidate(child, victim);
+        }
+    }
+    
+    // Before a read leaves a core's private levels, other cores write back their dirty copies
+    // of a shared block (lowest private level first, so the newest data lands last)
+    void flush_peer_copies(int core_id, uint64_t address) {
+        vector<int> data;
+        for (size_t c = 0; c < private_caches.size(); c++) {
+            if (static_cast<int>(c) == physical_core(core_id)) continue;
+            for (auto it = private_caches[c].rbegin(); it != private_caches[c].rend(); ++it) {
+                if (!(*it)->clean(address, data)) continue;
+                Cache* shared = (*it)->parent;
+                while (shared && shared->is_private) shared = shared->parent;
+                write_back(shared, address, data);
+            }
+        }
+    }
+    
+    // A write takes the block away from every other core's private levels
+    void invalidate_peer_copies(int core_id, uint64_t address) {
+        flush_peer_copies(core_id, address);
+        for (size_t c = 0; c < private_caches.size(); c++) {
+            if (static_cast<int>(c) == physical_core(core_id)) continue;
+            for (Cache* cache : private_caches[c]) {
+                int block_index = -1;
+                if (!cache->is_hit(address, block_index)) continue;
+                cache->invalidate(address);
+                coherence_invalidations++;
+            }
+        }
+    }
+    
+    // A core's lowest private level: its misses leave the core
+    static bool last_private_level(const Cache* cache) {
+        return cache->is_private && (!cache->parent || !cache->parent->is_private);
+    }
+    
+    // Access a word through cache and the levels below it, filling the block into every
+    // non-exclusive level on the way back up. A write updates the first level holding the block
+    // (or memory) and every level filled above a cache that held it. Returns the stall cycles;
+    // source is set to the cache that had the block, nullptr for main memory.
+    int access(Cache* cache, int core_id, uint64_t address, int current_cycle, bool is_write, int& data,
+               uint32_t byte_mask, Cache*& source) {
+        if (!cache) {
+            source = nullptr;
+            // Reads take the word from the block filled above
+            if (is_write) {
+                uint32_t old_word = static_cast<uint32_t>(main_memory.read_word(address));
+                main_memory.write_word(address, static_cast<int>((old_word & ~byte_mask) |
+                                                                 (static_cast<uint32_t>(data) & byte_mask)));
+            }
+            return memory_latency;
+        }
+        
+        int bank_wait = cache->claim_bank(address, current_cycle);
+        
+        // In a set that is not modelled, an estimated hit takes its data from below for free;
+        // an estimated miss goes down as a real one would
+        if (!cache->models(address) && !cache->estimate_miss()) {
+            if (last_private_level(cache) && shared_by_cores(address)) flush_peer_copies(core_id, address);
+            access_below(cache->parent, address, is_write, data, byte_mask);
+            cache->record_access(address, true);
+            source = cache;
+            return bank_wait + cache->access_latency;
+        }
+        
+        bool hit = is_write ? cache->write(address, data, current_cycle, true, byte_mask)
+                            : cache->read(address, data, current_cycle);
+        if (hit) {
+            source = cache;
+            return bank_wait + cache->access_latency;
+        }
+        
+        if (cache->children.empty()) top_level_misses++;
+        if (!cache->parent) last_level_misses++;
+        if (last_private_level(cache) && shared_by_cores(address)) flush_peer_copies(core_id, address);
+        
+        int stall_cycles = bank_wait + cache->access_latency +
+                           access(cache->parent, core_id, address, current_cycle, is_write, data, byte_mask, source);
+        if (cache->inclusion == InclusionPolicy::EXCLUSIVE) return stall_cycles;
+        
+        vector<int> block_data;
+        bool dirty = false;
+        fetch_block(cache->parent, address, block_data, dirty);
+        fill(cache, address, block_data, dirty, current_cycle);
+        if (is_write && source) {
+            cache->write(address, data, current_cycle, false, byte_mask);
+        } else if (!is_write && !source && !cache->read(address, data, current_cycle, false)) {
+            // Not filled (a set sampled out): the word is still only in memory
+            data = main_memory.read_word(address);
+        }
+        return stall_cycles;
+    }
+    
+    // Access from a core's first level, charging the L2 port and memory channel for refills
+    int access_from(Cache* entry, int core_id, uint64_t address, int current_cycle, bool is_write, int& data,
+                    uint32_t byte_mask = 0xFFFFFFFF) {
+        memory_accesses++;
+        Cache* source = nullptr;
+        int stall_cycles = access(entry, core_id, address, current_cycle, is_write, data, byte_mask, source);
+        if (source != entry) stall_cycles += note_refill(current_cycle, source == nullptr);
+        memory_stalls += stall_cycles;
+        return stall_cycles;
+    }
+    
+    // Cycles to translate a core address: nothing on an L1 TLB hit, the L2 TLB latency on
+    // an L2 TLB hit, plus a page walk on an L2 TLB miss
+    int translate(int core_id, uint64_t address, bool fetch, int current_cycle) {
+        uint64_t page_number = instruction_address(address) >> vm_page_bits;
+        uint64_t key = Tlb::key_of(core_id, page_number);
+        Tlb& first = fetch ? itlb[core_id] : dtlb[core_id];
+        if (first.lookup(key)) return 0;
+        
+        int cycles = l2_tlb_latency;
+        if (!l2_tlb.lookup(key)) {
+            cycles += walk_page_table(core_id, page_number, current_cycle);
+            l2_tlb.insert(key);
+        }
+        first.insert(key);
+        return cycles;
+    }
+    
+    // Read the entry of every page table level from the root down; returns the cycles taken
+    int walk_page_table(int core_id, uint64_t page_number, int current_cycle) {
+        uint64_t base = (PAGE_TABLE_PARTITION + core_id) << CORE_PARTITION_BITS;
+        uint64_t table = 0;          // Table within its level
+        uint64_t tables_above = 0;   // Tables in the levels above
+        uint64_t tables_in_level = 1;
+        int bits_below = CORE_PARTITION_BITS - vm_page_bits;
+        int cycles = 0;
+        
+        for (int bits : walk_level_bits) {
+            bits_below -= bits;
+            uint64_t index = (page_number >> bits_below) & ((1ULL << bits) - 1);
+            uint64_t entry = base + ((tables_above + table) << vm_page_bits) + index * 4;
+            int data = 0;
+            cycles += access_from(data_entry[core_id], core_id, entry, current_cycle, false, data);
+            tables_above += tables_in_level;
+            tables_in_level <<= bits;
+            table = (table << bits) | index;
+        }
+        page_walks[core_id]++;
+        walk_cycles[core_id] += cycles;
+        return cycles;
+    }
+    
+    // Read instruction from memory hierarchy
+    int read_instruction(int core_id, uint64_t address, int current_cycle, int& stall_cycles) {
+        int data = 0;
+        int translation = virtual_memory ? translate(core_id, address, true, current_cycle) : 0;
+        uint64_t physical = program_address(core_program[core_id], address);
+        stall_cycles = translation +
+                       access_from(instruction_entry[core_id], core_id, physical, current_cycle, false, data);
+        return data;
+    }
+    
+    void note_functional_access(int core_id, uint64_t physical) {
+        int block_index = -1;
+        if ((physical >> CORE_PARTITION_BITS) == 0) functional_shared_accesses++;
+        if (!data_entry[core_id]->is_hit(physical, block_index)) functional_misses++;
+    }
+    
+    // Read data from memory hierarchy
+    int read_data(int core_id, uint64_t address, int current_cycle, int& stall_cycles) {
+        if (functional) {
+            uint64_t physical = physical_address(core_id, address);
+            note_functional_access(core_id, physical);
+            stall_cycles = 0;
+            return coherent_read(physical);
+        }
+        int data = 0;
+        int translation = virtual_memory ? translate(core_id, address, false, current_cycle) : 0;
+        stall_cycles = translation + access_from(data_entry[core_id], core_id, physical_address(core_id, address),
+                                                 current_cycle, false, data);
+        return data;
+    }
+    
+    // Write data to memory hierarchy (only the bytes selected by byte_mask change)
+    void write_data(int core_id, uint64_t address, int data, int current_cycle, int& stall_cycles,
+                    uint32_t byte_mask = 0xFFFFFFFF) {
+        address = physical_address(core_id, address);
+        if (functional) {
+            note_functional_access(core_id, address);
+            stall_cycles = 0;
+            uint32_t old_word = static_cast<uint32_t>(coherent_read(address));
+            coherent_write(core_id, address, static_cast<int>((old_word & ~byte_mask) | (static_cast<uint32_t>(data) & byte_mask)));
+            return;
+        }
+        int translation = virtual_memory ? translate(core_id, address, false, current_cycle) : 0;
+        atomics.invalidate_reservations(core_id, address);
+        if (shared_by_cores(address)) invalidate_peer_copies(core_id, address);
+        stall_cycles = translation + access_from(data_entry[core_id], core_id, address, current_cycle, true, data, byte_mask);
+    }
+    
+    // LDC/SWC: a core reads or writes a word of the home core's memory through the home
+    // core's data caches. With a network on chip the request crosses it first, the access
+    // starts when it arrives, and the reply (data or acknowledgement) crosses back
+    int remote_access(int core_id, int home, uint64_t address, bool write, int data, int current_cycle,
+                      int& stall_cycles) {
+        if (!noc || functional) {
+            if (write) write_data(home, address, data, current_cycle, stall_cycles);
+            else data = read_data(home, address, current_cycle, stall_cycles);
+            return data;
+        }
+        int from = core_id / threads_per_core;
+        int to = home / threads_per_core;
+        int arrival = noc->send(from, to, NetworkOnChip::HEADER_BYTES + (write ? 4 : 0), current_cycle);
+        int access_stalls = 0;
+        if (write) write_data(home, address, data, arrival, access_stalls);
+        else data = read_data(home, address, arrival, access_stalls);
+        int reply = noc->send(to, from, NetworkOnChip::HEADER_BYTES + (write ? 0 : 4), arrival + access_stalls);
+        stall_cycles = reply - current_cycle;
+        noc->record(from, to, stall_cycles);
+        return data;
+    }
+    
+    // Read vector elements: one timed access per cache block touched, the
+    // remaining elements of that block are served from the core's first-level copy
+    void read_vector(int core_id, const uint64_t* addresses, int count, int* values, int current_cycle,
+                     int& stall_cycles) {
+        stall_cycles = 0;
+        uint64_t last_block = UINT64_MAX;
+        
+        for (int i = 0; i < count; i++) {
+            uint64_t block = addresses[i] / block_size;
+            if (block != last_block || functional) {
+                int element_stalls = 0;
+                values[i] = read_data(core_id, addresses[i], current_cycle, element_stalls);
+                stall_cycles += element_stalls;
+                last_block = block;
+            } else {
+                // A set sampled out of the first level holds nothing; the word is further down
+                uint64_t physical = physical_address(core_id, addresses[i]);
+                if (!data_entry[core_id]->read(physical, values[i], current_cycle, false)) {
+                    access_below(data_entry[core_id]->parent, physical, false, values[i], 0xFFFFFFFF);
+                }
+            }
+        }
+    }
+    
+    // Write vector elements with one timed access per cache block touched
+    void write_vector(int core_id, const uint64_t* addresses, int count, const int* values, int current_cycle,
+                      int& stall_cycles) {
+        stall_cycles = 0;
+        uint64_t last_block = UINT64_MAX;
+        
+        for (int i = 0; i < count; i++) {
+            uint64_t block = addresses[i] / block_size;
+            if (block != last_block || functional) {
+                int element_stalls = 0;
+                write_data(core_id, addresses[i], values[i], current_cycle, element_stalls);
+                stall_cycles += element_stalls;
+                last_block = block;
+            } else {
+                uint64_t physical = physical_address(core_id, addresses[i]);
+                int value = values[i];
+                if (!data_entry[core_id]->write(physical, value, current_cycle, false)) {
+                    access_below(data_entry[core_id]->parent, physical, true, value, 0xFFFFFFFF);
+                }
+                atomics.invalidate_reservations(core_id, physical);
+            }
+        }
+    }
+    
+    // Read from scratchpad memory
+    int read_spm(int core_id, int address, int& stall_cycles) {
+        stall_cycles = l1_latency; // SPM has same latency as L1
+        
+        if (address >= 0 && address/4 < scratchpad[core_id].size()) {
+            return scratchpad[core_id][address/4];
+        }
+        
+        return 0; // Return 0 for invalid address
+    }
+    
+    // Write to scratchpad memory
+    void write_spm(int core_id, int address, int data, int& stall_cycles) {
+        stall_cycles = l1_latency; // SPM has same latency as L1
+        
+        if (address >= 0 && address/4 < scratchpad[core_id].size()) {
+            scratchpad[core_id][address/4] = data;
+        }
+    }
+    
+    // Each level's size, scope, inclusion policy and where its misses go
+    string describe_hierarchy() const {
+        stringstream ss;
+        for (size_t i = 0; i < levels.size(); i++) {
+            const Cache* cache = levels[i].instances[0];
+            if (i > 0) ss << "; ";
+            ss << cache->name << " " << cache->size_bytes / 1024.0 << "KB " << cache->associativity << "-way "
+               << (cache->is_private ? "private" : "shared")
+               << (cache->inclusion == InclusionPolicy::INCLUSIVE ? " inclusive" :
+                   cache->inclusion == InclusionPolicy::EXCLUSIVE ? " exclusive" : "")
+               << " -> " << (cache->parent ? cache->parent->name : "memory");
+        }
+        return ss.str();
+    }
+    
+    // Get cache statistics
+    // Miss rate of a sampled level's modelled sets and the half-width of its 95% confidence
+    // interval. Each modelled set is a cluster of accesses, so the rate is a ratio estimate
+    // whose variance comes from how far the sets' miss counts scatter around it. Sets that all
+    // behave alike scatter by nothing, so the binomial error of the sampled accesses is a floor
+    static void sampled_miss_rate(const CacheLevel& level, double& rate, double& bound) {
+        const Cache* first = level.instances[0];
+        CacheStats total = level.totals();
+        long long accesses = 0, misses = 0;
+        for (int i = 0; i < first->num_sets; i++) {
+            if (!first->models_set(i)) continue;
+            accesses += total.set_accesses[i];
+            misses += total.set_misses[i];
+        }
+        rate = accesses > 0 ? static_cast<double>(misses) / accesses : 0.0;
+        bound = 0;
+        int sets = first->modelled_sets;
+        if (sets < 2 || accesses == 0) return;
+        
+        double scatter = 0;
+        for (int i = 0; i < first->num_sets; i++) {
+            if (!first->models_set(i)) continue;
+            double residual = total.set_misses[i] - rate * total.set_accesses[i];
+            scatter += residual * residual;
+        }
+        double mean_accesses = static_cast<double>(accesses) / sets;
+        double unsampled = 1.0 - static_cast<double>(sets) / first->num_sets;
+        double cluster_variance = unsampled * scatter / (sets - 1) / sets / (mean_accesses * mean_accesses);
+        double binomial_variance = rate * (1.0 - rate) / accesses;
+        bound = 1.96 * sqrt(max(cluster_variance, binomial_variance));
+    }
+    
+    string get_stats() {
+        stringstream ss;
+        ss << "Cache Statistics:" << endl;
+        if (custom_hierarchy) ss << "Hierarchy: " << describe_hierarchy() << endl;
+        for (const auto& level : levels) {
+            CacheStats total = level.totals();
+            ss << level.name << " hits: " << total.hits << ", misses: " << total.misses
+               << ", miss rate: " << total.get_miss_rate() * 100 << "%" << endl;
+        }
+        for (const auto& level : levels) {
+            CacheStats total = level.totals();
+            if (total.misses == 0) continue;
+            ss << total.miss_breakdown(level.name);
+            // Only accesses to modelled sets are classified under set sampling
+            if (!level.instances[0]->modelled.empty()) {
+                long long estimated = 0;
+                for (const Cache* cache : level.instances) estimated += cache->estimated_misses;
+                ss << " (of " << total.misses - estimated << " sampled misses)";
+            }
+            ss << endl;
+        }
+        for (const auto& level : levels) {
+            const Cache* first = level.instances[0];
+            if (first->bank_ports.empty()) continue;
+            long long accesses = 0, conflicts = 0, cycles = 0;
+            for (const Cache* cache : level.instances) {
+                accesses += cache->bank_accesses;
+                conflicts += cache->bank_conflicts;
+                cycles += cache->bank_conflict_cycles;
+            }
+            ss << level.name << " banks: " << first->num_banks << " x " << first->bank_ports[0].size()
+               << " port(s), " << conflicts << " of " << accesses << " accesses delayed by bank conflicts, "
+               << cycles << " conflict cycles" << endl;
+        }
+        for (const auto& level : levels) {
+            const Cache* first = level.instances[0];
+            if (first->modelled.empty()) continue;
+            long long estimated = 0;
+            for (const Cache* cache : level.instances) estimated += cache->estimated_hits + cache->estimated_misses;
+            double rate = 0, bound = 0;
+            sampled_miss_rate(level, rate, bound);
+            CacheStats total = level.totals();
+            ss << level.name << " sampling: " << first->modelled_sets << " of " << first->num_sets
+               << " sets modelled, miss rate " << rate * 100 << "% +/- " << bound * 100 << "% (95%), "
+               << estimated << " of " << total.hits + total.misses << " accesses estimated" << endl;
+        }
+        if (inclusion_invalidations > 0 || coherence_invalidations > 0) {
+            ss << "Upper-level copies invalidated by inclusive evictions: " << inclusion_invalidations
+               << ", by other cores' writes: " << coherence_invalidations << endl;
+        }
+        ss << "Total memory accesses: " << memory_accesses << endl;
+        ss << "Total memory stalls: " << memory_stalls << " cycles" << endl;
+        if (atomics.atomic_operations > 0) {
+            ss << "Atomic operations: " << atomics.atomic_operations
+               << ", ownership transfers: " << atomics.ownership_transfers
+               << ", contention stalls: " << atomics.contention_stalls
+               << ", SC success/fail: " << atomics.sc_successes << "/" << atomics.sc_failures << endl;
+        }
+        if (dma_blocks > 0) {
+            ss << "DMA blocks: " << dma_blocks << ", cycles queued for L2/memory bandwidth: "
+               << dma_queue_cycles << endl;
+        }
+        if (virtual_memory) {
+            long long walks = 0, cycles = 0;
+            Tlb l1_totals[2];
+            for (int c = 0; c < num_cores; c++) {
+                walks += page_walks[c];
+                cycles += walk_cycles[c];
+                l1_totals[0].hits += itlb[c].hits;
+                l1_totals[0].misses += itlb[c].misses;
+                l1_totals[1].hits += dtlb[c].hits;
+                l1_totals[1].misses += dtlb[c].misses;
+            }
+            ss << "TLBs (" << (1 << vm_page_bits) / 1024 << "KB pages, " << walk_level_bits.size()
+               << "-level page table):" << endl;
+            ss << "ITLB hits: " << l1_totals[0].hits << ", misses: " << l1_totals[0].misses
+               << ", miss rate: " << l1_totals[0].get_miss_rate() * 100 << "%" << endl;
+            ss << "DTLB hits: " << l1_totals[1].hits << ", misses: " << l1_totals[1].misses
+               << ", miss rate: " << l1_totals[1].get_miss_rate() * 100 << "%" << endl;
+            ss << "L2 TLB hits: " << l2_tlb.hits << ", misses: " << l2_tlb.misses
+               << ", miss rate: " << l2_tlb.get_miss_rate() * 100 << "%" << endl;
+            ss << "Page walks: " << walks << ", walk cycles: " << cycles;
+            if (walks > 0) ss << " (" << static_cast<double>(cycles) / walks << " per walk)";
+            ss << endl;
+        }
+        ss << "Main memory pages touched: " << main_memory.pages_allocated()
+           << " (" << main_memory.pages_allocated() * main_memory.page_size_bytes / 1024 << " KB)"
+           << ", page lookup TLB hits: " << main_memory.tlb_hits
+           << ", misses: " << main_memory.tlb_misses << endl;
+        
+        return ss.str();
+    }
+};
+
+// Per-core DMA engine moving data between the core's memory and its scratchpad in the
+// background. Transfers run in order; each is split at cache block boundaries and a new
+// block starts as soon as the previous one has gone through the L2 port or memory channel.
+class DmaEngine {
+private:
+    struct Transfer {
+        int tag;
+        bool to_spm;          // Memory -> SPM, or SPM -> memory
+        uint64_t address;     // Next byte address in the core's memory
+        int spm_index;        // Next word index in the scratchpad
+        int words;            // Words left to move
+        int done_cycle;       // Cycle the last block issued so far completes
+    };
+    
+    // An issued block; its data moves only when it completes, so software that reads the
+    // destination before waiting for the transfer sees the old contents
+    struct Block {
+        bool to_spm;
+        uint64_t address;
+        int spm_index;
+        int count;
+        int done_cycle;
+    };
+    
+    MemoryHierarchy* memory;
+    int core_id;
+    size_t queue_depth;
+    deque<Transfer> queue;
+    vector<Block> in_flight;   // Issued blocks, oldest first
+    int next_issue_cycle = 0;  // Cycle the engine can start its next block
+    vector<int> finish_cycle;  // Completion cycle by tag, -1 while in flight
+    
+    // Copy the data of every block that has completed by this cycle
+    void land(int cycle) {
+        vector<int>& spm = memory->scratchpad[core_id];
+        int buffer[256];
+        size_t kept = 0;
+        for (size_t b = 0; b < in_flight.size(); b++) {
+            const Block& block = in_flight[b];
+            if (block.done_cycle > cycle) {
+                in_flight[kept++] = block;
+                continue;
+            }
+            if (block.to_spm) {
+                memory->dma_copy(core_id, block.address, buffer, block.count, false);
+                for (int i = 0; i < block.count; i++) {
+                    int index = block.spm_index + i;
+                    if (index >= 0 && index < static_cast<int>(spm.size())) spm[index] = buffer[i];
+                }
+            } else {
+                for (int i = 0; i < block.count; i++) {
+                    int index = block.spm_index + i;
+                    buffer[i] = index >= 0 && index < static_cast<int>(spm.size()) ? spm[index] : 0;
+                }
+                memory->dma_copy(core_id, block.address, buffer, block.count, true);
+            }
+        }
+        in_flight.resize(kept);
+    }
+    
+public:
+    long long transfers = 0;
+    long long words_moved = 0;
+    
+    DmaEngine(MemoryHierarchy* mem, int core, int depth)
+        : memory(mem), core_id(core), queue_depth(max(1, depth)), finish_cycle(1, 0) {}
+    
+    bool full() const { return queue.size() >= queue_depth; }
+    bool busy() const { return !queue.empty() || !in_flight.empty(); }
+    
+    // Queue a transfer of words 32-bit words; returns its tag
+    int submit(bool to_spm, uint64_t address, int spm_index, int words, int cycle) {
+        int tag = finish_cycle.size();
+        finish_cycle.push_back(-1);
+        if (queue.empty()) next_issue_cycle = max(next_issue_cycle, cycle);
+        queue.push_back({tag, to_spm, address, spm_index, max(0, words), cycle});
+        transfers++;
+        return tag;
+    }
+    
+    // Land the blocks that have completed, then issue every block whose turn has come by this cycle
+    void advance(int cycle) {
+        land(cycle);
+        int block_size = memory->block_size;
+        
+        while (!queue.empty() && next_issue_cycle <= cycle) {
+            Transfer& t = queue.front();
+            if (t.words > 0) {
+                int block_words = (block_size - static_cast<int>(t.address % block_size)) / 4;
+                int count = min({t.words, max(1, block_words), 256});
+                
+                int port_free = 0;
+                int done = memory->dma_block(core_id, t.address, next_issue_cycle, port_free);
+                in_flight.push_back({t.to_spm, t.address, t.spm_index, count, done});
+                
+                next_issue_cycle = port_free;
+                t.done_cycle = max(t.done_cycle, done);
+                t.address += 4ULL * count;
+                t.spm_index += count;
+                t.words -= count;
+                words_moved += count;
+            }
+            
+            if (t.words == 0) {
+                finish_cycle[t.tag] = t.done_cycle;
+                queue.pop_front();
+            }
+        }
+    }
+    
+    // Move a whole transfer at once for functional execution; its tag is complete immediately
+    int transfer_now(bool to_spm, uint64_t address, int spm_index, int words) {
+        vector<int>& spm = memory->scratchpad[core_id];
+        for (int i = 0; i < words; i++) {
+            uint64_t physical = memory->physical_address(core_id, address + 4ULL * i);
+            int index = spm_index + i;
+            bool in_spm = index >= 0 && index < static_cast<int>(spm.size());
+            if (to_spm) {
+                if (in_spm) spm[index] = memory->coherent_read(physical);
+            } else {
+                memory->coherent_write(core_id, physical, in_spm ? spm[index] : 0);
+            }
+        }
+        
+        transfers++;
+        words_moved += max(0, words);
+        finish_cycle.push_back(0);
+        return finish_cycle.size() - 1;
+    }
+    
+    // Transfer tag has completed by this cycle (tag 0: every transfer has); its data is in place
+    bool complete(int tag, int cycle) {
+        land(cycle);
+        if (tag == 0) {
+            // Transfers finish in order, so the newest one finishes last
+            return !busy() && finish_cycle.back() <= cycle;
+        }
+        return tag > 0 && tag < static_cast<int>(finish_cycle.size()) &&
+               finish_cycle[tag] >= 0 && finish_cycle[tag] <= cycle;
+    }
+};
+
+// Barrier algorithms for the SYNC instruction
+enum BarrierAlgorithm {
+    BARRIER_CENTRALIZED,   // One shared counter every core increments, then a broadcast release
+    BARRIER_TREE,          // Combining tree of counters with BARRIER_FAN_IN children per node
+    BARRIER_DISSEMINATION  // log2(N) rounds of pairwise signals, no shared counter
+};
+
+// Synchronization barrier for SYNC instruction
+// Cores record when they arrive; once the last core of its group arrives the release cycle
+// of every core in the group is computed from the arrival times and the algorithm's message
+// pattern, each message costing BARRIER_LATENCY cycles. Waiting cores are descheduled until then.
+// Each program of a multi-program workload synchronizes only the group of cores running it
+class SyncBarrier {
+private:
+    // Cores that synchronize with each other
+    struct Group {
+        vector<int> members;
+        int remaining = 0;
+    };
+    
+    int num_cores;
+    int barrier_id;
+    BarrierAlgorithm algorithm;
+    int latency;
+    int fan_in;
+    vector<int> group_of;       // Group of each core, -1 for cores without a program
+    vector<Group> groups;
+    vector<int> arrival_cycle;  // Arrival cycle of each core in the current episode
+    vector<int> release_cycle;  // Cycle each core may proceed, -1 while the episode is open
+    long long released = 0;     // Core releases over all episodes
+    
+    // Arrivals at one counter are serialized: each increment costs one message
+    int combine(vector<int> arrivals) {
+        sort(arrivals.begin(), arrivals.end());
+        int done = INT_MIN;
+        for (int t : arrivals) {
+            done = max(t, done) + latency;
+            messages++;
+        }
+        return done;
+    }
+    
+    void compute_release(const vector<int>& members) {
+        int n = static_cast<int>(members.size());
+        vector<int> arrivals(n);
+        for (int i = 0; i < n; i++) arrivals[i] = arrival_cycle[members[i]];
+        vector<int> done(n);
+        
+        if (algorithm == BARRIER_CENTRALIZED) {
+            // Shared counter, then every core observes the release flag
+            fill(done.begin(), done.end(), combine(arrivals) + latency);
+            messages += n;
+        } else if (algorithm == BARRIER_TREE) {
+            // Combine fan_in nodes per level until one root remains
+            vector<int> level = arrivals;
+            int depth = 0;
+            while (level.size() > 1) {
+                vector<int> parents;
+                for (size_t i = 0; i < level.size(); i += fan_in) {
+                    size_t last = min(level.size(), i + fan_in);
+                    parents.push_back(combine(vector<int>(level.begin() + i, level.begin() + last)));
+                }
+                level.swap(parents);
+                depth++;
+            }
+            // The wake-up travels back down the tree one level per message
+            fill(done.begin(), done.end(), level[0] + depth * latency);
+            messages += n - 1;
+        } else {
+            // Round r: core i signals core (i + 2^r) mod N and waits for core (i - 2^r) mod N
+            done = arrivals;
+            for (int step = 1; step < n; step <<= 1) {
+                vector<int> next(n);
+                for (int i = 0; i < n; i++) {
+                    next[i] = max(done[i], done[(i - step + n) % n]) + latency;
+                }
+                done.swap(next);
+                messages += n;
+            }
+        }
+        
+        for (int i = 0; i < n; i++) {
+            release_cycle[members[i]] = done[i];
+            wait_cycles += done[i] - arrivals[i];
+        }
+        released += n;
+    }
+    
+public:
+    long long messages = 0;     // Counter updates and signals sent
+    long long wait_cycles = 0;  // Cycles from arrival to release, summed over cores
+    
+    // Until groups are assigned every core synchronizes with all others
+    SyncBarrier(int cores, BarrierAlgorithm alg = BARRIER_CENTRALIZED, int message_latency = 0, int tree_fan_in = 4)
+        : num_cores(cores), barrier_id(0), algorithm(alg),
+          latency(max(0, message_latency)), fan_in(max(2, tree_fan_in)),
+          group_of(cores, 0), groups(1), arrival_cycle(cores, 0), release_cycle(cores, -1) {
+        groups[0].members.resize(cores);
+        iota(groups[0].members.begin(), groups[0].members.end(), 0);
+        groups[0].remaining = cores;
+    }
+    
+    static bool parse_algorithm(const string& name, BarrierAlgorithm& alg) {
+        if (name == "CENTRALIZED") alg = BARRIER_CENTRALIZED;
+        else if (name == "TREE") alg = BARRIER_TREE;
+        else if (name == "DISSEMINATION") alg = BARRIER_DISSEMINATION;
+        else return false;
+        return true;
+    }
+    
+    // Make the given cores group number group (a program index); group 0 starts a new
+    // assignment, leaving cores outside every group until they are given one
+    void assign_group(int group, const vector<int>& cores) {
+        if (group == 0) fill(group_of.begin(), group_of.end(), -1);
+        for (int c : cores) group_of[c] = group;
+        groups.assign(max<size_t>(groups.size(), group + 1), Group());
+        for (int c = 0; c < num_cores; c++) {
+            if (group_of[c] >= 0) groups[group_of[c]].members.push_back(c);
+        }
+        for (auto& g : groups) g.remaining = static_cast<int>(g.members.size());
+    }
+    
+    // Cores that synchronize with core_id
+    const vector<int>& group_members(int core_id) const {
+        return groups[max(0, group_of[core_id])].members;
+    }
+    
+    // Core reaches barrier
+    bool reach_barrier(int core_id, int cycle) {
+        arrival_cycle[core_id] = cycle;
+        release_cycle[core_id] = -1;
+        
+        // Decrement the group's counter
+        Group& group = groups[max(0, group_of[core_id])];
+        group.remaining--;
+        
+        // If all cores of the group have reached the barrier
+        if (group.remaining == 0) {
+            compute_release(group.members);
+            
+            // Reset for next barrier
+            group.remaining = static_cast<int>(group.members.size());
+            barrier_id++;
+            return true; // Last core to reach barrier
+        }
+        
+        return false; // Not last core
+    }
+    
+    // Cycle the core may leave the barrier, -1 until every core of its group has arrived
+    int get_release_cycle(int core_id) const {
+        return release_cycle[core_id];
+    }
+    
+    // Get current barrier ID (barriers completed by all groups together)
+    int get_barrier_id() const {
+        return barrier_id;
+    }
+    
+    string get_stats() const {
+        static const char* names[] = {"centralized", "tree", "dissemination"};
+        stringstream ss;
+        ss << "Barriers (" << names[algorithm] << ", " << latency << " cycles per message): "
+           << barrier_id << " completed, " << messages << " messages, average wait "
+           << (released > 0 ? static_cast<double>(wait_cycles) / released : 0)
+           << " cycles per core" << endl;
+        return ss.str();
+    }
+};
+
+// Host SIMD kernels used to execute vector instructions on 32-bit elements
+// Arithmetic wraps modulo 2^32 like the scalar ALU
+namespace simd {
+    inline void add(int* dst, const int* a, const int* b, int n) {
+        int i = 0;
+#if defined(__AVX2__)
+        for (; i + 8 <= n; i += 8) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_add_epi32(va, vb));
+        }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+        for (; i + 4 <= n; i += 4) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi32(va, vb));
+        }
+#endif
+        for (; i < n; i++) dst[i] = static_cast<int>(static_cast<uint32_t>(a[i]) + static_cast<uint32_t>(b[i]));
+    }
+    
+    inline void mul(int* dst, const int* a, const int* b, int n) {
+        int i = 0;
+#if defined(__AVX2__)
+        for (; i + 8 <= n; i += 8) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_mullo_epi32(va, vb));
+        }
+#endif
+#if defined(__SSE4_1__)
+        for (; i + 4 <= n; i += 4) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_mullo_epi32(va, vb));
+        }
+#endif
+        for (; i < n; i++) dst[i] = static_cast<int>(static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(b[i]));
+    }
+    
+    // .vx forms: the scalar is broadcast inside the kernel
+    inline void add_scalar(int* dst, const int* a, int value, int n) {
+        int i = 0;
+#if defined(__AVX2__)
+        __m256i vb8 = _mm256_set1_epi32(value);
+        for (; i + 8 <= n; i += 8) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_add_epi32(va, vb8));
+        }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128i vb = _mm_set1_epi32(value);
+        for (; i + 4 <= n; i += 4) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi32(va, vb));
+        }
+#endif
+        for (; i < n; i++) dst[i] = static_cast<int>(static_cast<uint32_t>(a[i]) + static_cast<uint32_t>(value));
+    }
+    
+    inline void mul_scalar(int* dst, const int* a, int value, int n) {
+        int i = 0;
+#if defined(__AVX2__)
+        __m256i vb8 = _mm256_set1_epi32(value);
+        for (; i + 8 <= n; i += 8) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_mullo_epi32(va, vb8));
+        }
+#endif
+#if defined(__SSE4_1__)
+        __m128i vb = _mm_set1_epi32(value);
+        for (; i + 4 <= n; i += 4) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_mullo_epi32(va, vb));
+        }
+#endif
+        for (; i < n; i++) dst[i] = static_cast<int>(static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(value));
+    }
+    
+    // Fill dst with a scalar (vmv.v.x)
+    inline void splat(int* dst, int value, int n) {
+        fill(dst, dst + n, value);
+    }
+    
+    inline int sum(const int* a, int n) {
+        int i = 0;
+        uint32_t total = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4) {
+            acc = _mm_add_epi32(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        }
+        alignas(16) int lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        for (int lane : lanes) total += static_cast<uint32_t>(lane);
+#endif
+        for (; i < n; i++) total += static_cast<uint32_t>(a[i]);
+        return static_cast<int>(total);
+    }
+}
+
+// CSR numbers of the counters guest code can read, and of the ROI marker
+enum CounterCsr {
+    CSR_CYCLE = 0xC00,
+    CSR_TIME = 0xC01,              // Same as cycle: one cycle per time unit
+    CSR_INSTRET = 0xC02,
+    CSR_HPM_L1_MISSES = 0xC03,     // hpmcounter3..8 carry simulator events
+    CSR_HPM_L2_MISSES = 0xC04,
+    CSR_HPM_STALLS = 0xC05,
+    CSR_HPM_MEMORY_STALLS = 0xC06,
+    CSR_HPM_SYNC_STALLS = 0xC07,
+    CSR_HPM_SPM_ACCESSES = 0xC08,
+    CSR_HIGH_HALF = 0x80,          // cycleh, instreth, ... are the counter CSR + 0x80
+    CSR_ROI = 0x8C0                // Custom CSR: nonzero while a region of interest is measured
+};
+
+// Event counters of one core; also the start and length of an ROI phase
+struct PerformanceCounters {
+    long long cycles = 0;
+    long long instructions = 0;
+    long long stalls = 0;          // Pipeline stalls (hazards, branches, fetch)
+    long long memory_stalls = 0;
+    long long sync_stalls = 0;
+    long long atomic_stalls = 0;
+    long long vector_stalls = 0;
+    long long l1_misses = 0;
+    long long l2_misses = 0;
+    long long spm_accesses = 0;
+    
+    // Counter names and values in a fixed order, for reports and CSR reads
+    vector<pair<const char*, long long>> fields() const {
+        return {{"cycles", cycles}, {"instructions", instructions}, {"stalls", stalls},
+                {"memory_stalls", memory_stalls}, {"sync_stalls", sync_stalls},
+                {"atomic_stalls", atomic_stalls}, {"vector_stalls", vector_stalls},
+                {"l1_misses", l1_misses}, {"l2_misses", l2_misses}, {"spm_accesses", spm_accesses}};
+    }
+    
+    PerformanceCounters operator-(const PerformanceCounters& start) const {
+        PerformanceCounters d;
+        d.cycles = cycles - start.cycles;
+        d.instructions = instructions - start.instructions;
+        d.stalls = stalls - start.stalls;
+        d.memory_stalls = memory_stalls - start.memory_stalls;
+        d.sync_stalls = sync_stalls - start.sync_stalls;
+        d.atomic_stalls = atomic_stalls - start.atomic_stalls;
+        d.vector_stalls = vector_stalls - start.vector_stalls;
+        d.l1_misses = l1_misses - start.l1_misses;
+        d.l2_misses = l2_misses - start.l2_misses;
+        d.spm_accesses = spm_accesses - start.spm_accesses;
+        return d;
+    }
+    
+    bool operator==(const PerformanceCounters& other) const {
+        return fields() == other.fields();
+    }
+    
+    PerformanceCounters& operator+=(const PerformanceCounters& other) {
+        cycles += other.cycles;
+        instructions += other.instructions;
+        stalls += other.stalls;
+        memory_stalls += other.memory_stalls;
+        sync_stalls += other.sync_stalls;
+        atomic_stalls += other.atomic_stalls;
+        vector_stalls += other.vector_stalls;
+        l1_misses += other.l1_misses;
+        l2_misses += other.l2_misses;
+        spm_accesses += other.spm_accesses;
+        return *this;
+    }
+};
+
+// Counters the hotspot profiler keeps for each static instruction
+struct InstructionProfile {
+    long long cycles = 0;         // Cycles the instruction held up the front of the pipeline
+    long long executions = 0;     // Times the instruction completed
+    long long data_stalls = 0;    // Hazard and multi-cycle execution stalls
+    long long memory_stalls = 0;  // Fetch and data access stall cycles
+    long long branch_stalls = 0;  // Taken branch and jump penalties
+    long long sync_stalls = 0;    // Cycles spent waiting at a barrier
+    long long atomic_stalls = 0;  // Cycles waiting for a line owned by another core
+    long long vector_stalls = 0;  // Waits for the vector unit or a vector register
+    long long l1_misses = 0;      // L1I misses on fetch, L1D misses on data accesses
+    long long l2_misses = 0;
+    long long spm_accesses = 0;
+    
+    void add(const InstructionProfile& other) {
+        cycles += other.cycles;
+        executions += other.executions;
+        data_stalls += other.data_stalls;
+        memory_stalls += other.memory_stalls;
+        branch_stalls += other.branch_stalls;
+        sync_stalls += other.sync_stalls;
+        atomic_stalls += other.atomic_stalls;
+        vector_stalls += other.vector_stalls;
+        l1_misses += other.l1_misses;
+        l2_misses += other.l2_misses;
+        spm_accesses += other.spm_accesses;
+    }
+};
+
+// Data accesses of one core to one word, gathered for the scratchpad allocation tool
+struct WordAccessProfile {
+    long long loads = 0;
+    long long stores = 0;
+    long long stall_cycles = 0;  // Memory stall cycles of these accesses
+    long long first_stall = 0;   // Stall of the first access (usually the cold miss)
+    bool first_is_load = false;  // The first access reads the initial value
+    bool eligible = true;        // Only absolute-address LD/SW touched the word
+};
+
+// Data access profile of a whole run, keyed by core ID (high half) and core address of each word
+struct DataAccessProfile {
+    unordered_map<uint64_t, WordAccessProfile> words;
+    int spm_words_used = 0;      // Highest SPM word the program itself touched, plus one
+    
+    WordAccessProfile& word(int core, uint64_t address) {
+        return words[static_cast<uint64_t>(core) << 32 | (static_cast<uint32_t>(address) & ~3u)];
+    }
+    
+    void use_spm(long long word) {
+        spm_words_used = max(spm_words_used, static_cast<int>(word) + 1);
+    }
+};
+
+// A store waiting in a core's store buffer to be written to memory
+struct BufferedStore {
+    int pc;                 // Store instruction, charged for the misses of its write
+    uint32_t address;       // Word address
+    int data;               // Store data, already shifted to its bytes
+    uint32_t byte_mask;     // Bytes of the word it writes
+    int done_cycle = -1;    // Cycle its write completes, once started
+};
+
+// Steady-state detection for one loop, keyed by its back-edge branch (LOOP_EXTRAPOLATION)
+struct LoopState {
+    PerformanceCounters last;      // Counters when the back-edge was last taken
+    PerformanceCounters delta;     // What the last iteration added to them
+    PerformanceCounters expected;  // Deltas the last extrapolation assumed, checked afterwards
+    bool has_last = false;
+    bool verifying = false;        // Extrapolated; the next steady deltas must match expected
+    bool disabled = false;         // Never extrapolated again (failed a check)
+    int stable = 0;                // Iterations in a row with identical deltas
+};
+
+class Core
+{
+public:
+    array<int, 32> registers{}; // Register file of this core
+    
+    int pc; // Program Counter
+    bool forwarding; // Forwarding flag (for data forwarding in pipeline)
+    unordered_map<string, int> latencies; // Latencies for instructions (ADD, SUB, etc.)
+    int stalls = 0; // Count of pipeline stalls
+    int memory_stalls = 0; // Stalls due to memory access
+    int sync_stalls = 0;   // Stalls due to synchronization
+    int executed_instructions = 0; // Count of executed instructions
+    long long functional_instructions = 0; // Instructions run functionally (FAST_FORWARD or FUNCTIONAL mode)
+    int CID; // Compute Unit ID
+    
+    // Synchronization state
+    bool waiting_for_sync = false;
+    int barrier_id = -1;
+    
+    // Pipeline structures
+    deque<Instruction> pipeline_stages[5]; // One queue for each pipeline stage
+    unordered_map<int, pair<int, int>> register_status; // Maps reg -> (producing_instr_idx, ready_cycle)
+    vector<Instruction> completed_instructions; // History of all executed instructions
+    
+    int current_cycle = 0; // Current clock cycle
+    bool branch_taken = false; // Flag for taken branches/jumps
+    int instr_count = 0; // Counter for instruction IDs
+
+    // Memory hierarchy reference
+    MemoryHierarchy* memory;
+    SyncBarrier* sync_barrier;
+    
+    uint64_t program_base = 0; // Address of the first instruction
+    int program_index = 0;     // Program the core runs in a multi-program workload
+    
+    // SMT: every hardware thread is a Core with its own pc, registers and pipeline latches.
+    // The threads of a physical core share its private caches and one fetch slot per cycle
+    int smt_thread = 0;            // Thread within its physical core
+    bool fetch_slot = true;        // Holds the fetch slot this cycle
+    long long fetch_slot_lost = 0; // Cycles it could have fetched but another thread had the slot
+    bool memory_blocking = false;  // Loads and fetches wait for their data (MEMORY_BLOCKING)
+    
+    // Vector unit state
+    vector<int> vector_registers;  // 32 vector registers of vlmax elements each
+    int vlmax = 4;                 // Elements per vector register (VLEN / 32)
+    int vector_lanes = 4;          // Elements processed per cycle
+    int vl = 0;                    // Current vector length (set by VSETVLI)
+    int vector_busy_until = 0;     // Cycle the vector unit becomes free
+    unordered_map<int, int> vector_register_status; // Maps vreg -> ready_cycle
+    int vector_instructions = 0;   // Vector instructions executed
+    long long vector_elements = 0; // Vector elements processed
+    int vector_stalls = 0;         // Stalls waiting on the vector unit or vector registers
+    
+    int atomic_operations = 0;     // AMO, LR and SC instructions performed
+    int atomic_stalls = 0;         // Cycles spent waiting for a line locked by another core
+    
+    // Execution unit pool (FUNCTIONAL_UNIT): an instruction decodes only once a unit of its
+    // class can take it. Without a pool every operation finds a free unit
+    struct FunctionalUnit {
+        string name;
+        int latency = 0;           // 0 uses the instruction latencies
+        bool pipelined = true;
+        vector<int> free_at;       // Per unit, the first cycle it accepts another operation
+        long long operations = 0;
+        long long busy_cycles = 0;
+        long long structural_stalls = 0;
+    };
+    enum UnitClass { UNIT_ALU, UNIT_MUL, UNIT_DIV, UNIT_AGU, UNIT_CLASSES };
+    vector<FunctionalUnit> functional_units; // Indexed by UnitClass when configured
+    
+    DmaEngine dma;                 // Background memory <-> scratchpad transfers
+    int dma_stalls = 0;            // Cycles waiting for a DMA transfer or a free queue slot
+    
+    // Store buffer (STORE_BUFFER): stores leave MEM into it and are written to memory in the
+    // background, oldest first; other cores only see them once written. Loads compare the
+    // page offset of their address with the buffered stores. Without memory-dependence
+    // speculation a load also waits for a store to a different address with the same offset;
+    // with it, the load goes ahead. The full addresses are known here, so a load only goes
+    // ahead of stores it really does not overlap and is never squashed: speculation removes
+    // the page-offset alias stalls and nothing else.
+    size_t store_buffer_entries = 0;     // 0 writes stores in MEM
+    bool memory_speculation = false;
+    deque<BufferedStore> store_buffer;
+    long long store_forwards = 0;        // Loads that took their value from the buffer
+    long long store_buffer_full_stalls = 0;
+    long long store_dependence_stalls = 0; // Cycles loads waited for a store they partly overlap
+    long long store_alias_stalls = 0;    // Cycles loads waited for a store with the same page offset
+    long long store_fence_stalls = 0;    // Cycles atomics, DMA, vector and remote accesses waited for the buffer to drain
+    long long speculated_loads = 0;      // Loads that went ahead of a store with the same page offset
+    static const uint32_t PAGE_OFFSET_MASK = 0xFFF;
+    
+    // Hotspot profile, indexed by instruction
+    vector<InstructionProfile> profile;
+    InstructionProfile unattributed; // Events with no instruction to charge
+    int profile_pc = -1;             // Instruction charged for the current cycle
+    int sync_pc = -1;                // SYNC the core is waiting at
+    
+    // Events that only the profiler tracked per instruction, totalled for the counter CSRs
+    long long l1_misses = 0;
+    long long l2_misses = 0;
+    long long spm_accesses = 0;
+    
+    DataAccessProfile* data_profile = nullptr; // Set only while profiling for SPM allocation
+    
+    // Loop extrapolation: once a loop's iterations add identical amounts to every counter, the
+    // pipeline drains and the simulator runs further iterations functionally, charging each the
+    // same deltas. The iterations simulated after that must show the same deltas again.
+    int loop_stable_iterations = 0;     // Identical iterations needed, 0 to never extrapolate
+    vector<bool> extrapolatable;        // Back-edges whose loop bodies can run functionally
+    unordered_map<int, LoopState> loops; // By back-edge instruction
+    int draining_loop = -1;             // Back-edge of the loop waiting for the pipeline to drain
+    int extrapolations = 0;
+    int extrapolation_failures = 0;     // Loops whose simulated iterations changed afterwards
+    long long extrapolated_iterations = 0;
+    long long extrapolated_instructions = 0;
+    
+    // Region-of-interest measurement
+    bool roi_active = false;
+    PerformanceCounters roi_start;          // Counters when the open region began
+    vector<PerformanceCounters> roi_phases; // One entry per completed region
+
+    // Constructor to initialize the core properties
+    Core(int id, bool enable_forwarding, MemoryHierarchy* mem_hierarchy, SyncBarrier* barrier)
+        : dma(mem_hierarchy, id, 4)
+    {
+        pc = 0;
+        forwarding = enable_forwarding;
+        CID = id;
+        memory = mem_hierarchy;
+        sync_barrier = barrier;
+        configure_vector_unit(128, 4);
+    }
+
+    // Convert register name (e.g., x1) to index (1 for x1)
+    static int reg_index(const string &r) { return stoi(r.substr(1, r.size() - 1)); }
+
+    // Check for a cross-core load (LDC2, LDC3, ... LDC<num_cores>)
+    static bool is_remote_load(const string& opcode) {
+        return opcode.size() > 3 && opcode.compare(0, 3, "LDC") == 0 &&
+               all_of(opcode.begin() + 3, opcode.end(), ::isdigit);
+    }
+    
+    // Check for a cross-core store (SWC1, SWC2, ... SWC<num_cores>)
+    static bool is_remote_store(const string& opcode) {
+        return opcode.size() > 3 && opcode.compare(0, 3, "SWC") == 0 &&
+               all_of(opcode.begin() + 3, opcode.end(), ::isdigit);
+    }
+    
+    static bool is_remote_access(const string& opcode) {
+        return is_remote_load(opcode) || is_remote_store(opcode);
+    }
+
+    // Set instruction latencies for the core
+    void set_latencies(const unordered_map<string, int>& latencies_map)
+    {
+        latencies = latencies_map;
+    }
+
+    // Check for data hazards in the ID stage
+    bool check_hazards(const Instruction& instr, int& stall_cycles) {
+        stall_cycles = 0;
+        
+        // Check RAW hazards
+        if (instr.src_reg1 != -1) {
+            if (register_status.count(instr.src_reg1)) {
+                auto [instr_idx, ready_cycle] = register_status[instr.src_reg1];
+                
+                // If the value isn't ready yet
+                if (ready_cycle > current_cycle) {
+                    if (!forwarding) {
+                        // Without forwarding, stall until the value is in register file
+                        stall_cycles = max(stall_cycles, ready_cycle - current_cycle);
+                        return stall_cycles > 0;
+                    } else {
+                        // With forwarding, check if we can forward from EX or MEM stages
+                        // Find the instruction that produces the value
+                        bool can_forward = false;
+                        
+                        // Look through all pipeline stages to find the producer instruction
+                        for (int stage = EX; stage <= MEM; stage++) {
+                            for (const auto& pipeline_instr : pipeline_stages[stage]) {
+                                if (pipeline_instr.dest_reg == instr.src_reg1) {
+                                    // If in EX, and will complete this cycle, we can forward
+                                    if (stage == EX && pipeline_instr.stage_complete_cycle[EX] == current_cycle) {
+                                        can_forward = true;
+                                    }
+                                    // If in MEM, we can always forward
+                                    else if (stage == MEM) {
+                                        can_forward = true;
+                                    }
+                                }
+                            }
+                        }
+                        
+                        if (!can_forward) {
+                            stall_cycles = max(stall_cycles, 1); // Stall for at least 1 cycle
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        
+        if (instr.src_reg2 != -1) {
+            if (register_status.count(instr.src_reg2)) {
+                auto [instr_idx, ready_cycle] = register_status[instr.src_reg2];
+                
+                // If the value isn't ready yet
+                if (ready_cycle > current_cycle) {
+                    if (!forwarding) {
+                        // Without forwarding, stall until the value is in register file
+                        stall_cycles = max(stall_cycles, ready_cycle - current_cycle);
+                        return stall_cycles > 0;
+                    } else {
+                        // With forwarding, check if we can forward from EX or MEM stages
+                        bool can_forward = false;
+                        
+                        // Look through all pipeline stages to find the producer instruction
+                        for (int stage = EX; stage <= MEM; stage++) {
+                            for (const auto& pipeline_instr : pipeline_stages[stage]) {
+                                if (pipeline_instr.dest_reg == instr.src_reg2) {
+                                    // If in EX, and will complete this cycle, we can forward
+                                    if (stage == EX && pipeline_instr.stage_complete_cycle[EX] == current_cycle) {
+                                        can_forward = true;
+                                    }
+                                    // If in MEM, we can always forward
+                                    else if (stage == MEM) {
+                                        can_forward = true;
+                                    }
+                                }
+                            }
+                        }
+                        
+                        if (!can_forward) {
+                            stall_cycles = max(stall_cycles, 1); // Stall for at least 1 cycle
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        
+        // Instructions resolved in ID read their operands before older
+        // instructions have necessarily produced them: wait for producers that
+        // have not executed yet, and for loads and atomics still on their way through MEM
+        if (instr.opcode == "JALR" || instr.opcode == "VSETVLI" || is_conditional_branch(instr.opcode)) {
+            for (int stage = ID; stage <= EX; stage++) {
+                for (const auto& pipeline_instr : pipeline_stages[stage]) {
+                    if (pipeline_instr.dest_reg == -1 || (stage == EX && !produces_in_memory(pipeline_instr.opcode))) continue;
+                    if (pipeline_instr.dest_reg == instr.src_reg1 || pipeline_instr.dest_reg == instr.src_reg2) {
+                        stall_cycles = max(stall_cycles, 1);
+                        return true;
+                    }
+                }
+            }
+        }
+        
+        return stall_cycles > 0;
+    }
+
+    // Parse an offset(rs1) operand into the base register and a byte offset
+    static void parse_offset_register(const string& operand, Instruction& instr) {
+        size_t open_paren = operand.find('(');
+        size_t close_paren = operand.find(')');
+        if (open_paren != string::npos && close_paren != string::npos) {
+            instr.imm = open_paren > 0 ? stoi(operand.substr(0, open_paren)) : 0;
+            instr.src_reg1 = reg_index(operand.substr(open_paren + 1, close_paren - open_paren - 1));
+        }
+    }
+    
+    // Parse one line of text assembly into an instruction
+    static Instruction parse_instruction(const string& line) {
+        Instruction instr;
+        istringstream op_stream(line);
+        op_stream >> instr.opcode;
+        
+        // Parse operands based on instruction type
+        if (instr.opcode == "ADD" || instr.opcode == "SUB" || instr.opcode == "MUL" ||
+            instr.opcode == "DIV" || instr.opcode == "REM") {
+            string rd, rs1, rs2;
+            op_stream >> rd >> rs1 >> rs2;
+            instr.dest_reg = reg_index(rd);
+            instr.src_reg1 = reg_index(rs1);
+            instr.src_reg2 = reg_index(rs2);
+        } 
+        else if (instr.opcode == "ADDI") {
+            string rd, rs1;
+            op_stream >> rd >> rs1 >> instr.imm;
+            instr.dest_reg = reg_index(rd);
+            instr.src_reg1 = reg_index(rs1);
+        }
+        else if (instr.opcode == "ARR") {
+            op_stream >> instr.imm;
+        }
+        else if (instr.opcode == "LD" && line.find('(') != string::npos) {
+            // LD rd offset(rs1): rs1 + offset is a byte address
+            string rd, offset_reg;
+            op_stream >> rd >> offset_reg;
+            instr.dest_reg = reg_index(rd);
+            parse_offset_register(offset_reg, instr);
+        }
+        else if (instr.opcode == "LD" || is_remote_load(instr.opcode)) {
+            string rd, address;
+            op_stream >> rd >> address;
+            instr.dest_reg = reg_index(rd);
+            instr.mem_addr = stoi(address) * 4; // Word address to byte address
+            
+            // LDC<n> reads from the memory of core n-1
+            if (instr.opcode != "LD") {
+                instr.imm = stoi(instr.opcode.substr(3)) - 1;
+            }
+        }
+        else if (is_remote_store(instr.opcode)) {
+            // SWC<n> writes to the memory of core n-1
+            string rs, address;
+            op_stream >> rs >> address;
+            instr.src_reg2 = reg_index(rs);
+            instr.mem_addr = stoi(address) * 4; // Word address to byte address
+            instr.imm = stoi(instr.opcode.substr(3)) - 1;
+        }
+        else if (instr.opcode == "SW") {
+            string rs, address;
+            op_stream >> rs >> address;
+            instr.src_reg2 = reg_index(rs);
+            
+            // SW rs offset(rs1) stores to byte address rs1 + offset
+            if (address.find('(') != string::npos) parse_offset_register(address, instr);
+            else instr.mem_addr = stoi(address) * 4; // Word address to byte address
+        }
+        else if (is_conditional_branch(instr.opcode) || instr.opcode == "BLE" || instr.opcode == "BGT") {
+            string rs1, rs2, label;
+            op_stream >> rs1 >> rs2 >> label;
+            instr.src_reg1 = reg_index(rs1);
+            instr.src_reg2 = reg_index(rs2);
+            instr.label = label;
+            
+            // BLE/BGT are BGE/BLT with the operands swapped
+            if (instr.opcode == "BLE" || instr.opcode == "BGT") {
+                swap(instr.src_reg1, instr.src_reg2);
+                instr.opcode = instr.opcode == "BLE" ? "BGE" : "BLT";
+            }
+        }
+        else if (instr.opcode == "J") {
+            op_stream >> instr.label;
+        }
+        // New instructions for SPM
+        else if (instr.opcode == "LW_SPM") {
+            string rd, offset_reg;
+            op_stream >> rd >> offset_reg;
+            instr.dest_reg = reg_index(rd);
+            
+            // Parse offset(rs1) format
+            size_t open_paren = offset_reg.find('(');
+            size_t close_paren = offset_reg.find(')');
+            
+            if (open_paren != string::npos && close_paren != string::npos) {
+                string offset_str = offset_reg.substr(0, open_paren);
+                string rs1 = offset_reg.substr(open_paren + 1, close_paren - open_paren - 1);
+                
+                instr.offset = stoi(offset_str);
+                instr.src_reg1 = reg_index(rs1);
+                instr.is_spm = true;
+            }
+            else {
+                // A bare number is an absolute SPM word slot
+                instr.offset = stoi(offset_reg);
+                instr.is_spm = true;
+            }
+        }
+        else if (instr.opcode == "SW_SPM") {
+            string rs2, offset_reg;
+            op_stream >> rs2 >> offset_reg;
+            instr.src_reg2 = reg_index(rs2);
+            
+            // Parse offset(rs1) format
+            size_t open_paren = offset_reg.find('(');
+            size_t close_paren = offset_reg.find(')');
+            
+            if (open_paren != string::npos && close_paren != string::npos) {
+                string offset_str = offset_reg.substr(0, open_paren);
+                string rs1 = offset_reg.substr(open_paren + 1, close_paren - open_paren - 1);
+                
+                instr.offset = stoi(offset_str);
+                instr.src_reg1 = reg_index(rs1);
+                instr.is_spm = true;
+            }
+            else {
+                // A bare number is an absolute SPM word slot
+                instr.offset = stoi(offset_reg);
+                instr.is_spm = true;
+            }
+        }
+        // SYNC instruction
+        else if (instr.opcode == "SYNC") {
+            // Nothing to parse for SYNC
+        }
+        // Atomics: AMO<op>.W rd rs2 rs1, LR.W rd rs1, SC.W rd rs2 rs1 (rs1 holds a byte address)
+        else if (instr.opcode == "LR.W") {
+            string rd, rs1;
+            op_stream >> rd >> rs1;
+            instr.dest_reg = reg_index(rd);
+            instr.src_reg1 = reg_index(rs1);
+        }
+        else if (is_atomic(instr.opcode)) {
+            string rd, rs2, rs1;
+            op_stream >> rd >> rs2 >> rs1;
+            instr.dest_reg = reg_index(rd);
+            instr.src_reg2 = reg_index(rs2);
+            instr.src_reg1 = reg_index(rs1);
+        }
+        // Counter reads: RDCYCLE/RDTIME/RDINSTRET[H] rd, CSRR rd csr
+        else if (instr.opcode.compare(0, 2, "RD") == 0 || instr.opcode == "CSRR") {
+            static const unordered_map<string, int> counter_csrs = {
+                {"RDCYCLE", CSR_CYCLE}, {"RDTIME", CSR_TIME}, {"RDINSTRET", CSR_INSTRET},
+                {"RDCYCLEH", CSR_CYCLE + CSR_HIGH_HALF}, {"RDTIMEH", CSR_TIME + CSR_HIGH_HALF},
+                {"RDINSTRETH", CSR_INSTRET + CSR_HIGH_HALF}};
+            string rd, csr;
+            op_stream >> rd >> csr;
+            if (instr.opcode == "CSRR") instr.csr = stoi(csr, nullptr, 0);
+            else if (counter_csrs.count(instr.opcode)) instr.csr = counter_csrs.at(instr.opcode);
+            instr.opcode = "CSRRS";
+            instr.dest_reg = reg_index(rd);
+        }
+        // DMA transfers: memory addresses in bytes, scratchpad addresses in words like LW_SPM
+        else if (instr.opcode == "DMA_TO_SPM" || instr.opcode == "DMA_FROM_SPM") {
+            string rd, rs_mem, rs_spm;
+            op_stream >> rd >> rs_mem >> rs_spm >> instr.imm;
+            instr.dest_reg = reg_index(rd);
+            instr.src_reg1 = reg_index(rs_mem);
+            instr.src_reg2 = reg_index(rs_spm);
+        }
+        else if (instr.opcode == "DMA_WAIT" || instr.opcode == "DMA_POLL") {
+            string first, second;
+            op_stream >> first >> second;
+            if (instr.opcode == "DMA_POLL") {
+                instr.dest_reg = reg_index(first);
+                first = second;
+            }
+            if (!first.empty()) instr.src_reg1 = reg_index(first); // No tag: every transfer
+        }
+        // Region-of-interest markers
+        else if (instr.opcode == "ROI_BEGIN" || instr.opcode == "ROI_END") {
+            instr.imm = instr.opcode == "ROI_BEGIN";
+            instr.csr = CSR_ROI;
+            instr.opcode = "CSRRWI";
+        }
+        // Vector instructions
+        else if (instr.opcode == "VSETVLI") {
+            string rd, avl;
+            op_stream >> rd >> avl;
+            instr.dest_reg = reg_index(rd);
+            instr.src_reg1 = reg_index(avl);
+        }
+        else if (is_vector_load(instr.opcode) || is_vector_store(instr.opcode)) {
+            // VLE32.V vd offset(rs1) [stride_reg]; offsets and strides are in bytes
+            string vreg_name, offset_reg, stride;
+            op_stream >> vreg_name >> offset_reg >> stride;
+            if (is_vector_load(instr.opcode)) instr.vdest = reg_index(vreg_name);
+            else instr.vsrc1 = reg_index(vreg_name);
+            
+            size_t open_paren = offset_reg.find('(');
+            size_t close_paren = offset_reg.find(')');
+            if (open_paren != string::npos && close_paren != string::npos) {
+                instr.imm = stoi(offset_reg.substr(0, open_paren));
+                instr.src_reg1 = reg_index(offset_reg.substr(open_paren + 1, close_paren - open_paren - 1));
+            }
+            if (!stride.empty()) instr.src_reg2 = reg_index(stride);
+        }
+        else if (instr.opcode == "VADD.VV" || instr.opcode == "VMUL.VV" || instr.opcode == "VREDSUM.VS") {
+            string vd, vs2, vs1;
+            op_stream >> vd >> vs2 >> vs1;
+            instr.vdest = reg_index(vd);
+            instr.vsrc2 = reg_index(vs2);
+            instr.vsrc1 = reg_index(vs1);
+        }
+        else if (instr.opcode == "VADD.VX" || instr.opcode == "VMUL.VX") {
+            string vd, vs2, rs1;
+            op_stream >> vd >> vs2 >> rs1;
+            instr.vdest = reg_index(vd);
+            instr.vsrc2 = reg_index(vs2);
+            instr.src_reg1 = reg_index(rs1);
+        }
+        else if (instr.opcode == "VMV.V.X") {
+            string vd, rs1;
+            op_stream >> vd >> rs1;
+            instr.vdest = reg_index(vd);
+            instr.src_reg1 = reg_index(rs1);
+        }
+        else if (instr.opcode == "VMV.X.S") {
+            string rd, vs2;
+            op_stream >> rd >> vs2;
+            instr.dest_reg = reg_index(rd);
+            instr.vsrc2 = reg_index(vs2);
+        }
+        
+        return instr;
+    }
+    
+    // Vector instructions (RVV subset, 32-bit elements, LMUL=1)
+    static bool is_vector(const string& op) {
+        return !op.empty() && op[0] == 'V';
+    }
+    
+    static bool is_vector_load(const string& op) {
+        return op == "VLE32.V" || op == "VLSE32.V" || op == "VLE32_SPM" || op == "VLSE32_SPM";
+    }
+    
+    static bool is_vector_store(const string& op) {
+        return op == "VSE32.V" || op == "VSSE32.V" || op == "VSE32_SPM" || op == "VSSE32_SPM";
+    }
+    
+    // DMA instructions: DMA_TO_SPM/DMA_FROM_SPM rd rs_mem rs_spm words, DMA_WAIT [rs], DMA_POLL rd rs
+    static bool is_dma(const string& op) {
+        return op.compare(0, 4, "DMA_") == 0;
+    }
+    
+    // Start, wait for or poll a DMA transfer in the MEM stage; returns false while the
+    // instruction has to wait (full queue, or transfer still running)
+    bool access_dma(Instruction& instr) {
+        if (instr.opcode == "DMA_TO_SPM" || instr.opcode == "DMA_FROM_SPM") {
+            if (dma.full()) return false;
+            instr.result_value = dma.submit(instr.opcode == "DMA_TO_SPM", static_cast<uint32_t>(instr.mem_addr),
+                                            instr.offset, instr.imm, current_cycle);
+            return true;
+        }
+        
+        bool done = dma.complete(instr.mem_addr, current_cycle);
+        if (instr.opcode == "DMA_POLL") {
+            instr.result_value = done;
+            return true;
+        }
+        return done; // DMA_WAIT
+    }
+    
+    // Size the vector register file from VLEN (bits) and the number of lanes
+    void configure_vector_unit(int vlen_bits, int lanes) {
+        vlmax = max(1, vlen_bits / 32);
+        vector_lanes = max(1, lanes);
+        vector_registers.assign(32 * vlmax, 0);
+    }
+    
+    // Build the unit pool from FUNCTIONAL_UNIT lines; classes not listed get one unit, pipelined
+    // except for the divider
+    void configure_functional_units(const vector<FunctionalUnitConfig>& configs) {
+        functional_units.clear();
+        if (configs.empty()) return;
+        
+        for (const char* name : {"ALU", "MUL", "DIV", "AGU"}) {
+            FunctionalUnit units;
+            units.name = name;
+            units.pipelined = units.name != "DIV";
+            units.free_at.assign(1, 0);
+            for (const auto& config : configs) {
+                if (config.name != units.name) continue;
+                units.latency = config.latency;
+                units.pipelined = config.pipelined;
+                units.free_at.assign(config.count, 0);
+            }
+            functional_units.push_back(units);
+        }
+    }
+    
+    // Element storage of one vector register
+    int* vreg(int v) { return &vector_registers[v * vlmax]; }
+    
+    // Cycles the vector unit is busy with an instruction of vl elements
+    int vector_occupancy(const Instruction& instr) const {
+        int beats = max(1, (instr.vl + vector_lanes - 1) / vector_lanes);
+        if (instr.opcode == "VREDSUM.VS") {
+            // Reduction tree across the lanes
+            for (int width = 1; width < vector_lanes; width *= 2) beats++;
+        }
+        return beats;
+    }
+    
+    // Unit class an instruction executes on; -1 for the vector unit and for instructions
+    // that finish in decode
+    static int unit_class(const string& op) {
+        if (op == "DIV" || op == "DIVU" || op == "REM" || op == "REMU") return UNIT_DIV;
+        if (op == "MUL" || op == "MULH" || op == "MULHSU" || op == "MULHU") return UNIT_MUL;
+        if (is_load(op) || is_store(op) || is_atomic(op) || is_remote_access(op) || is_dma(op) ||
+            op == "LW_SPM" || op == "SW_SPM") return UNIT_AGU;
+        if (is_vector(op) || is_conditional_branch(op) || op == "J" || op == "JAL" || op == "JALR" ||
+            op == "SYNC" || op == "ECALL" || op == "EBREAK" || op == "ILLEGAL") return -1;
+        return UNIT_ALU;
+    }
+    
+    // Cycles an instruction spends in EX: its unit's latency if configured, else its own
+    int latency_of(const Instruction& instr) {
+        int unit = functional_units.empty() ? -1 : unit_class(instr.opcode);
+        if (unit >= 0 && functional_units[unit].latency > 0) return functional_units[unit].latency;
+        return latencies.count(instr.opcode) ? latencies[instr.opcode] : 1;
+    }
+    
+    // Structural hazard: every unit of the instruction's class is busy
+    bool check_unit_hazard(const Instruction& instr, int& stall_cycles) {
+        int unit = unit_class(instr.opcode);
+        if (unit < 0) return false;
+        
+        FunctionalUnit& units = functional_units[unit];
+        if (*min_element(units.free_at.begin(), units.free_at.end()) <= current_cycle) return false;
+        stall_cycles = 1;
+        units.structural_stalls++;
+        return true;
+    }
+    
+    // Issue a decoded instruction to a free unit of its class. A pipelined unit takes another
+    // operation the next cycle, an unpipelined one only when this one leaves EX
+    void occupy_unit(const Instruction& instr) {
+        int unit = unit_class(instr.opcode);
+        if (unit < 0) return;
+        
+        FunctionalUnit& units = functional_units[unit];
+        int& free_at = *min_element(units.free_at.begin(), units.free_at.end());
+        int occupancy = units.pipelined ? 1 : latency_of(instr);
+        free_at = current_cycle + occupancy;
+        units.operations++;
+        units.busy_cycles += occupancy;
+    }
+    
+    // Check for hazards on vector registers and the vector unit
+    bool check_vector_hazards(const Instruction& instr, int& stall_cycles) {
+        stall_cycles = 0;
+        
+        if (vector_busy_until > current_cycle) {
+            stall_cycles = 1;
+            vector_stalls++;
+            return true;
+        }
+        
+        for (int v : {instr.vsrc1, instr.vsrc2}) {
+            if (v != -1 && vector_register_status.count(v) && vector_register_status[v] > current_cycle) {
+                stall_cycles = 1;
+                vector_stalls++;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // Execute vector arithmetic and compute vector memory addresses (EX stage)
+    void execute_vector(Instruction& instr) {
+        int vl = instr.vl;
+        
+        if (instr.opcode == "VADD.VV") {
+            simd::add(vreg(instr.vdest), vreg(instr.vsrc2), vreg(instr.vsrc1), vl);
+        }
+        else if (instr.opcode == "VMUL.VV") {
+            simd::mul(vreg(instr.vdest), vreg(instr.vsrc2), vreg(instr.vsrc1), vl);
+        }
+        else if (instr.opcode == "VADD.VX") {
+            simd::add_scalar(vreg(instr.vdest), vreg(instr.vsrc2), read_register(instr.src_reg1), vl);
+        }
+        else if (instr.opcode == "VMUL.VX") {
+            simd::mul_scalar(vreg(instr.vdest), vreg(instr.vsrc2), read_register(instr.src_reg1), vl);
+        }
+        else if (instr.opcode == "VMV.V.X") {
+            simd::splat(vreg(instr.vdest), read_register(instr.src_reg1), vl);
+        }
+        else if (instr.opcode == "VREDSUM.VS") {
+            uint32_t total = static_cast<uint32_t>(vreg(instr.vsrc1)[0]) +
+                             static_cast<uint32_t>(simd::sum(vreg(instr.vsrc2), vl));
+            vreg(instr.vdest)[0] = static_cast<int>(total);
+        }
+        else if (instr.opcode == "VMV.X.S") {
+            instr.result_value = vreg(instr.vsrc2)[0];
+        }
+        else if (is_vector_load(instr.opcode) || is_vector_store(instr.opcode)) {
+            instr.mem_addr = read_register(instr.src_reg1) + instr.imm;
+            instr.stride = instr.src_reg2 != -1 ? read_register(instr.src_reg2) : 4;
+        }
+        
+        vector_elements += vl;
+    }
+    
+    // Move vector elements between registers and memory or SPM (MEM stage)
+    void access_vector_memory(Instruction& instr, int& mem_stalls) {
+        mem_stalls = 0;
+        bool spm = instr.opcode.find("_SPM") != string::npos;
+        int v = is_vector_load(instr.opcode) ? instr.vdest : instr.vsrc1;
+        int* elements = vreg(v);
+        
+        // vl never exceeds VLEN / 32 elements, so the addresses fit on the stack
+        array<uint64_t, CacheConfig::MAX_VLEN / 32> addresses;
+        for (int i = 0; i < instr.vl; i++) {
+            addresses[i] = static_cast<uint32_t>(instr.mem_addr + i * instr.stride);
+        }
+        
+        if (spm) {
+            // The SPM is banked across the lanes
+            int element_stalls = 0;
+            for (int i = 0; i < instr.vl; i++) {
+                if (is_vector_load(instr.opcode)) {
+                    elements[i] = memory->read_spm(CID, static_cast<int>(addresses[i]), element_stalls);
+                } else {
+                    memory->write_spm(CID, static_cast<int>(addresses[i]), elements[i], element_stalls);
+                }
+            }
+            mem_stalls = element_stalls * max(1, (instr.vl + vector_lanes - 1) / vector_lanes);
+        }
+        else if (is_vector_load(instr.opcode)) {
+            memory->read_vector(CID, addresses.data(), instr.vl, elements, current_cycle, mem_stalls);
+        }
+        else {
+            memory->write_vector(CID, addresses.data(), instr.vl, elements, current_cycle, mem_stalls);
+        }
+    }
+    
+    // Atomic memory operations (RV32A)
+    static bool is_atomic(const string& op) {
+        return op.compare(0, 3, "AMO") == 0 || op == "LR.W" || op == "SC.W";
+    }
+    
+    // Perform an atomic access in the MEM stage; returns false while the line is locked by another core
+    bool access_atomic(Instruction& instr, int& mem_stalls) {
+        uint64_t line_address = memory->physical_address(CID, static_cast<uint32_t>(instr.mem_addr) & ~3u);
+        int transfer_cycles = 0;
+        mem_stalls = 0;
+        
+        if (!memory->atomics.acquire(CID, line_address, current_cycle, transfer_cycles)) {
+            return false;
+        }
+        
+        // The line stays locked while ownership migrates and the access completes
+        mem_stalls = perform_atomic(instr) + transfer_cycles;
+        memory->atomics.release_at(line_address, current_cycle + transfer_cycles + 1);
+        return true;
+    }
+    
+    // The access of an AMO, LR or SC on a line this core holds; returns its stall cycles
+    int perform_atomic(Instruction& instr) {
+        uint32_t address = static_cast<uint32_t>(instr.mem_addr) & ~3u;
+        uint64_t line_address = memory->physical_address(CID, address);
+        
+        int access_stalls = 0;
+        if (instr.opcode == "LR.W") {
+            instr.result_value = memory->read_data(CID, address, current_cycle, access_stalls);
+            memory->atomics.reserve(CID, line_address);
+        }
+        else if (instr.opcode == "SC.W") {
+            if (memory->atomics.check_reservation(CID, line_address)) {
+                memory->write_data(CID, address, read_register(instr.src_reg2), current_cycle, access_stalls);
+                instr.result_value = 0;
+            } else {
+                instr.result_value = 1;
+            }
+        }
+        else {
+            // Read-modify-write while holding the line
+            int old_value = memory->read_data(CID, address, current_cycle, access_stalls);
+            int operand = read_register(instr.src_reg2);
+            int new_value = operand;
+            
+            if (instr.opcode == "AMOADD.W") new_value = static_cast<int>(static_cast<uint32_t>(old_value) + static_cast<uint32_t>(operand));
+            else if (instr.opcode == "AMOAND.W") new_value = old_value & operand;
+            else if (instr.opcode == "AMOOR.W") new_value = old_value | operand;
+            else if (instr.opcode == "AMOXOR.W") new_value = old_value ^ operand;
+            else if (instr.opcode == "AMOMIN.W") new_value = min(old_value, operand);
+            else if (instr.opcode == "AMOMAX.W") new_value = max(old_value, operand);
+            else if (instr.opcode == "AMOMINU.W") new_value = static_cast<int>(min(static_cast<uint32_t>(old_value), static_cast<uint32_t>(operand)));
+            else if (instr.opcode == "AMOMAXU.W") new_value = static_cast<int>(max(static_cast<uint32_t>(old_value), static_cast<uint32_t>(operand)));
+            
+            int write_stalls = 0;
+            memory->write_data(CID, address, new_value, current_cycle, write_stalls);
+            access_stalls += write_stalls;
+            instr.result_value = old_value;
+        }
+        
+        atomic_operations++;
+        return access_stalls;
+    }
+    
+    // Instruction classes shared by the text and RV32IM forms
+    static bool is_conditional_branch(const string& op) {
+        return op == "BEQ" || op == "BNE" || op == "BLT" || op == "BGE" || op == "BLTU" || op == "BGEU";
+    }
+    
+    static bool is_load(const string& op) {
+        return op == "LD" || op == "LW" || op == "LH" || op == "LHU" || op == "LB" || op == "LBU";
+    }
+    
+    static bool is_store(const string& op) {
+        return op == "SW" || op == "SH" || op == "SB";
+    }
+    
+    // Instructions whose result is only known after the MEM stage
+    static bool produces_in_memory(const string& op) {
+        return is_load(op) || is_atomic(op) || is_remote_load(op) || op == "LW_SPM" || is_dma(op);
+    }
+    
+    // Read a source register, taking results that are computed but not yet written back
+    // Forwarding only changes when a consumer may issue (check_hazards), not the value it sees
+    int read_register(int reg) {
+        // Youngest producer first: EX/MEM latch, then MEM/WB latch
+        for (int stage = EX; stage <= MEM; stage++) {
+            const auto& queue = pipeline_stages[stage];
+            for (auto it = queue.rbegin(); it != queue.rend(); ++it) {
+                if (it->dest_reg == reg) return it->result_value;
+            }
+        }
+        return registers[reg];
+    }
+    
+    // Byte address of an instruction index
+    uint64_t instruction_address(int index) const {
+        return program_base + static_cast<uint64_t>(index) * 4;
+    }
+    
+    // Evaluate a conditional branch
+    bool branch_condition(const Instruction& instr) {
+        int a = read_register(instr.src_reg1);
+        int b = read_register(instr.src_reg2);
+        
+        if (instr.opcode == "BEQ") return a == b;
+        if (instr.opcode == "BNE") return a != b;
+        if (instr.opcode == "BLT") return a < b;
+        if (instr.opcode == "BGE") return a >= b;
+        if (instr.opcode == "BLTU") return static_cast<uint32_t>(a) < static_cast<uint32_t>(b);
+        if (instr.opcode == "BGEU") return static_cast<uint32_t>(a) >= static_cast<uint32_t>(b);
+        return false;
+    }
+    
+    // Compute the result of an ALU operation (register-register or register-immediate)
+    static int alu_result(const string& op, int a, int b) {
+        uint32_t ua = static_cast<uint32_t>(a);
+        uint32_t ub = static_cast<uint32_t>(b);
+        
+        if (op == "ADD" || op == "ADDI") return static_cast<int>(ua + ub);
+        if (op == "SUB") return static_cast<int>(ua - ub);
+        if (op == "MUL") return static_cast<int>(ua * ub);
+        if (op == "AND" || op == "ANDI") return a & b;
+        if (op == "OR" || op == "ORI") return a | b;
+        if (op == "XOR" || op == "XORI") return a ^ b;
+        if (op == "SLL" || op == "SLLI") return static_cast<int>(ua << (ub & 31));
+        if (op == "SRL" || op == "SRLI") return static_cast<int>(ua >> (ub & 31));
+        if (op == "SRA" || op == "SRAI") return a >> (ub & 31);
+        if (op == "SLT" || op == "SLTI") return a < b;
+        if (op == "SLTU" || op == "SLTIU") return ua < ub;
+        if (op == "MULH") return static_cast<int>((static_cast<int64_t>(a) * b) >> 32);
+        if (op == "MULHSU") return static_cast<int>((static_cast<int64_t>(a) * static_cast<int64_t>(ub)) >> 32);
+        if (op == "MULHU") return static_cast<int>((static_cast<uint64_t>(ua) * ub) >> 32);
+        
+        // Division follows the RISC-V rules for divide-by-zero and overflow
+        if (op == "DIV") {
+            if (b == 0) return -1;
+            if (a == INT32_MIN && b == -1) return a;
+            return a / b;
+        }
+        if (op == "DIVU") return ub == 0 ? -1 : static_cast<int>(ua / ub);
+        if (op == "REM") {
+            if (b == 0) return a;
+            if (a == INT32_MIN && b == -1) return 0;
+            return a % b;
+        }
+        if (op == "REMU") return ub == 0 ? a : static_cast<int>(ua % ub);
+        
+        return 0;
+    }
+    
+    // Extract the loaded value from the containing word
+    // Bytes of its word a scalar load or store touches
+    static uint32_t access_mask(const string& op, uint32_t address) {
+        int shift = (address & 3) * 8;
+        if (op == "SB" || op == "LB" || op == "LBU") return 0xFFu << shift;
+        if (op == "SH" || op == "LH" || op == "LHU") return 0xFFFFu << (shift & 16);
+        return 0xFFFFFFFFu;
+    }
+    
+    // Store data shifted to the bytes it writes
+    int store_data(const Instruction& instr) {
+        int shift = (static_cast<uint32_t>(instr.mem_addr) & 3) * 8;
+        return static_cast<int>(static_cast<uint32_t>(read_register(instr.src_reg2)) << (instr.opcode == "SW" ? 0 : shift));
+    }
+    
+    static int load_result(const string& op, int word, uint32_t address) {
+        int shift = (address & 3) * 8;
+        
+        if (op == "LB") return static_cast<int8_t>(word >> shift);
+        if (op == "LBU") return static_cast<uint8_t>(word >> shift);
+        if (op == "LH") return static_cast<int16_t>(word >> (shift & 16));
+        if (op == "LHU") return static_cast<uint16_t>(word >> (shift & 16));
+        return word;
+    }
+    
+    // Redirect fetch after a taken branch or jump
+    void redirect(int target) {
+        pipeline_stages[IF].clear();
+        pc = target;
+        branch_taken = true;
+        stalls += 2; // Branch penalty (2 cycles)
+        profile_at(profile_pc).branch_stalls += 2;
+    }
+    
+    // Instruction index a JAL/JALR continues at (program_size when it leaves the program)
+    int jump_target(const Instruction& instr) {
+        int target = instr.target;
+        if (instr.opcode == "JALR") {
+            uint32_t target_address = static_cast<uint32_t>(read_register(instr.src_reg1) + instr.imm) & ~1u;
+            target = target_address >= program_base && target_address < instruction_address(program_size)
+                     ? static_cast<int>((target_address - program_base) / 4) : program_size;
+        }
+        return target >= 0 ? target : program_size;
+    }
+    
+    // VSETVLI: vl becomes the requested length, capped at the register length
+    int set_vector_length(const Instruction& instr) {
+        uint32_t avl = instr.src_reg1 != -1 ? static_cast<uint32_t>(read_register(instr.src_reg1)) : UINT32_MAX;
+        vl = static_cast<int>(min<uint32_t>(avl, vlmax));
+        return vl;
+    }
+    
+    void report_illegal(const Instruction& instr) const {
+        cerr << "Core " << CID << ": illegal instruction at 0x" << hex
+             << instruction_address(instr.pc) << dec << endl;
+    }
+    
+    // A taken back-edge closes an iteration of its loop. After loop_stable_iterations iterations
+    // with identical counter deltas the core stops fetching so the pipeline drains for extrapolation.
+    void note_back_edge(const Instruction& branch) {
+        if (loop_stable_iterations == 0 || !extrapolatable[branch.pc]) return;
+        LoopState& loop = loops[branch.pc];
+        if (loop.disabled) return;
+        
+        PerformanceCounters now = counters();
+        if (loop.has_last) {
+            PerformanceCounters delta = now - loop.last;
+            loop.stable = loop.stable > 0 && delta == loop.delta ? loop.stable + 1 : 1;
+            loop.delta = delta;
+        }
+        loop.last = now;
+        loop.has_last = true;
+        if (loop.stable < loop_stable_iterations || draining_loop != -1) return;
+        
+        // Behaviour that changed since the last extrapolation means it was wrong to extrapolate
+        if (loop.verifying) {
+            loop.verifying = false;
+            if (!(loop.delta == loop.expected)) {
+                loop.disabled = true;
+                extrapolation_failures++;
+                return;
+            }
+        }
+        draining_loop = branch.pc;
+    }
+    
+    // The pipeline is empty and the loop can run functionally
+    bool ready_to_extrapolate() const {
+        if (draining_loop == -1 || dma.busy() || !store_buffer.empty()) return false;
+        for (int s = IF; s <= MEM; s++) {
+            if (!pipeline_stages[s].empty()) return false;
+        }
+        return true;
+    }
+    
+    // Charge skipped loop iterations the deltas of a simulated one. instructions also covers any
+    // partial iteration after the last whole one, which is charged cycles in proportion.
+    void skip_iterations(const PerformanceCounters& delta, long long iterations, long long instructions) {
+        long long partial = instructions - iterations * delta.instructions;
+        current_cycle += static_cast<int>(iterations * delta.cycles + partial * delta.cycles / delta.instructions);
+        executed_instructions += static_cast<int>(instructions);
+        stalls += static_cast<int>(iterations * delta.stalls);
+        memory_stalls += static_cast<int>(iterations * delta.memory_stalls);
+        atomic_stalls += static_cast<int>(iterations * delta.atomic_stalls);
+        vector_stalls += static_cast<int>(iterations * delta.vector_stalls);
+        l1_misses += iterations * delta.l1_misses;
+        l2_misses += iterations * delta.l2_misses;
+        spm_accesses += iterations * delta.spm_accesses;
+        
+        extrapolations++;
+        extrapolated_iterations += iterations;
+        extrapolated_instructions += instructions;
+    }
+    
+    // Retire an instruction that finished in the decode stage
+    void complete_in_decode(Instruction& instr) {
+        instr.completed = true;
+        instr.current_stage = ID;
+        instr.stage_complete_cycle[ID] = current_cycle;
+        completed_instructions.push_back(instr);
+        executed_instructions++;
+        profile_at(instr.pc).executions++;
+    }
+    
+    // Profile entry of an instruction
+    InstructionProfile& profile_at(int index) {
+        return index >= 0 && index < static_cast<int>(profile.size()) ? profile[index] : unattributed;
+    }
+    
+    // Cache misses so far, to charge the difference to the instruction making an access
+    pair<long long, long long> miss_counts() const {
+        return {memory->top_level_misses, memory->last_level_misses};
+    }
+    
+    void charge_misses(int index, const pair<long long, long long>& before) {
+        auto after = miss_counts();
+        InstructionProfile& entry = profile_at(index);
+        entry.l1_misses += after.first - before.first;
+        entry.l2_misses += after.second - before.second;
+        l1_misses += after.first - before.first;
+        l2_misses += after.second - before.second;
+    }
+    
+    // Current values of this core's event counters
+    PerformanceCounters counters() const {
+        PerformanceCounters c;
+        c.cycles = current_cycle;
+        c.instructions = executed_instructions;
+        c.stalls = stalls;
+        c.memory_stalls = memory_stalls;
+        c.sync_stalls = sync_stalls;
+        c.atomic_stalls = atomic_stalls;
+        c.vector_stalls = vector_stalls;
+        c.l1_misses = l1_misses;
+        c.l2_misses = l2_misses;
+        c.spm_accesses = spm_accesses;
+        return c;
+    }
+    
+    static bool is_csr(const string& op) {
+        return op.compare(0, 3, "CSR") == 0;
+    }
+    
+    // Read a CSR; counters are 64 bits wide and the high half has its own CSR
+    uint32_t read_csr(int csr) const {
+        if (csr == CSR_ROI) return roi_active;
+        
+        bool high = csr >= CSR_CYCLE + CSR_HIGH_HALF && csr <= CSR_HPM_SPM_ACCESSES + CSR_HIGH_HALF;
+        if (high) csr -= CSR_HIGH_HALF;
+        
+        PerformanceCounters c = counters();
+        long long value = 0;
+        switch (csr) {
+            case CSR_CYCLE:
+            case CSR_TIME: value = c.cycles; break;
+            case CSR_INSTRET: value = c.instructions; break;
+            case CSR_HPM_L1_MISSES: value = c.l1_misses; break;
+            case CSR_HPM_L2_MISSES: value = c.l2_misses; break;
+            case CSR_HPM_STALLS: value = c.stalls; break;
+            case CSR_HPM_MEMORY_STALLS: value = c.memory_stalls; break;
+            case CSR_HPM_SYNC_STALLS: value = c.sync_stalls; break;
+            case CSR_HPM_SPM_ACCESSES: value = c.spm_accesses; break;
+        }
+        return static_cast<uint32_t>(high ? value >> 32 : value);
+    }
+    
+    // Counters are read-only; writing the ROI CSR starts or ends a measured region
+    void write_csr(int csr, uint32_t value) {
+        if (csr != CSR_ROI || (value != 0) == roi_active) return;
+        
+        if (value != 0) {
+            roi_start = counters();
+        } else {
+            roi_phases.push_back(counters() - roi_start);
+        }
+        roi_active = value != 0;
+    }
+    
+    // Execute a CSRRW/CSRRS/CSRRC (or immediate form): the old value goes to rd
+    void execute_csr(Instruction& instr) {
+        uint32_t old_value = read_csr(instr.csr);
+        uint32_t operand = instr.src_reg1 != -1 ? static_cast<uint32_t>(read_register(instr.src_reg1))
+                                                : static_cast<uint32_t>(instr.imm);
+        instr.result_value = static_cast<int>(old_value);
+        
+        // CSRRS/CSRRC with a zero operand do not write
+        char kind = instr.opcode[4];
+        if (kind == 'W') write_csr(instr.csr, operand);
+        else if (operand != 0) write_csr(instr.csr, kind == 'S' ? old_value | operand : old_value & ~operand);
+    }
+    
+    // Close a region left open when the program ends
+    void end_roi() {
+        write_csr(CSR_ROI, 0);
+    }
+
+    // Process the fetch stage - get next instruction
+    void stage_fetch(const vector<Instruction>& program) {
+        // Don't fetch if there was a branch taken, at end of program, waiting for sync,
+        // or draining for loop extrapolation
+        if (branch_taken || pc >= static_cast<int>(program.size()) || waiting_for_sync || draining_loop != -1 ||
+            !fetch_slot) {
+            branch_taken = false; // Reset branch flag
+            return;
+        }
+        
+        // Instructions are decoded once at load time
+        Instruction instr = program[pc];
+        instr.pc = pc;
+        
+        // Access instruction memory (with cache)
+        int mem_stalls = 0;
+        auto misses = miss_counts();
+        memory->read_instruction(CID, instruction_address(pc), current_cycle, mem_stalls);
+        stalls += mem_stalls;
+        profile_at(pc).memory_stalls += mem_stalls;
+        charge_misses(pc, misses);
+        
+        // Set up pipeline info
+        instr.current_stage = IF;
+        instr.issue_cycle = current_cycle;
+        instr.stage_complete_cycle[IF] = current_cycle;
+        if (memory_blocking) instr.stage_complete_cycle[IF] += max(0, mem_stalls - 1);
+        
+        // Add to IF stage and advance PC
+        pipeline_stages[IF].push_back(instr);
+        pc++;
+    }
+    
+    // Process the decode stage - check for hazards
+    void stage_decode() {
+        // Nothing decodes until the barrier releases this core
+        if (waiting_for_sync) {
+            int release = sync_barrier->get_release_cycle(CID);
+            profile_pc = sync_pc;
+            if (release < 0 || release > current_cycle) {
+                sync_stalls++;
+                profile_at(sync_pc).sync_stalls++;
+                return;
+            }
+            waiting_for_sync = false;
+        }
+        
+        // With nothing to decode the cycle stays with the last instruction decoded
+        if (pipeline_stages[IF].empty()) return;
+        
+        // The ID/EX latch is still occupied while EX is blocked
+        if (!pipeline_stages[ID].empty()) {
+            if (!pipeline_stages[EX].empty()) profile_pc = pipeline_stages[EX].front().pc;
+            return;
+        }
+        
+        // A blocking fetch is still waiting for its block
+        if (pipeline_stages[IF].front().stage_complete_cycle[IF] >= current_cycle) return;
+        
+        Instruction instr = pipeline_stages[IF].front();
+        pipeline_stages[IF].pop_front();
+        profile_pc = instr.pc;
+        
+        int stall_cycles = 0;
+        bool hazard = check_hazards(instr, stall_cycles);
+        bool vector_hazard = !hazard && is_vector(instr.opcode) && check_vector_hazards(instr, stall_cycles);
+        bool unit_hazard = !hazard && !vector_hazard && !functional_units.empty() &&
+                           check_unit_hazard(instr, stall_cycles);
+        
+        if (hazard || vector_hazard || unit_hazard) {
+            // Put instruction back in IF and stall
+            instr.current_stage = IF;
+            pipeline_stages[IF].push_front(instr);
+            stalls += stall_cycles;
+            if (vector_hazard) profile_at(instr.pc).vector_stalls += stall_cycles;
+            else profile_at(instr.pc).data_stalls += stall_cycles;
+            return;
+        }
+        
+        // Handle SYNC instruction
+        if (instr.opcode == "SYNC") {
+            // Buffered stores become visible to the other cores before the barrier
+            if (!store_buffer.empty()) {
+                instr.current_stage = IF;
+                pipeline_stages[IF].push_front(instr);
+                store_fence_stalls++;
+                profile_at(instr.pc).memory_stalls++;
+                return;
+            }
+            sync_pc = instr.pc;
+
+            // Notify sync barrier that this core has reached it
+            sync_barrier->reach_barrier(CID, current_cycle);
+            barrier_id = sync_barrier->get_barrier_id();
+            
+            int release = sync_barrier->get_release_cycle(CID);
+            if (release < 0 || release > current_cycle) {
+                // Go into waiting state; the SYNC itself drains through the pipeline
+                waiting_for_sync = true;
+                instr.current_stage = ID;
+                pipeline_stages[ID].push_back(instr);
+                return;
+            }
+            
+            // Last core to reach a barrier with no release latency proceeds at once
+            complete_in_decode(instr);
+            return;
+        }
+        
+        // Process control hazards (branches and jumps)
+        if (is_conditional_branch(instr.opcode)) {
+            // Execute branch in decode stage to minimize branch penalty
+            if (instr.target >= 0 && branch_condition(instr)) {
+                // Branch taken - flush the pipeline and adjust PC
+                redirect(instr.target);
+                
+                // Track branch as completed (no need to go further in pipeline)
+                complete_in_decode(instr);
+                if (instr.target <= instr.pc) note_back_edge(instr);
+                return;
+            }
+        } 
+        else if (instr.opcode == "J") {
+            // Execute jump in decode stage
+            if (instr.target >= 0) {
+                // Jump taken - flush the pipeline and adjust PC
+                redirect(instr.target);
+                
+                // Track jump as completed
+                complete_in_decode(instr);
+                if (instr.target <= instr.pc) note_back_edge(instr);
+                return;
+            }
+        }
+        else if (instr.opcode == "JAL" || instr.opcode == "JALR") {
+            // Jump and link resolves in decode; the link value travels down the pipeline
+            instr.result_value = static_cast<int>(instruction_address(instr.pc + 1));
+            redirect(jump_target(instr));
+            
+            if (instr.dest_reg == -1) {
+                complete_in_decode(instr);
+                return;
+            }
+        }
+        else if (instr.opcode == "ECALL" || instr.opcode == "EBREAK" || instr.opcode == "ILLEGAL") {
+            // Environment calls end the program on this core
+            if (instr.opcode == "ILLEGAL") report_illegal(instr);
+            pipeline_stages[IF].clear();
+            pc = program_size;
+            complete_in_decode(instr);
+            return;
+        }
+        
+        // Vector instructions capture vl and occupy the vector unit
+        if (instr.opcode == "VSETVLI") {
+            // Resolved in decode so later vector instructions see the new vl
+            instr.result_value = set_vector_length(instr);
+        }
+        else if (is_vector(instr.opcode)) {
+            instr.vl = vl;
+            int occupancy = vector_occupancy(instr);
+            vector_busy_until = current_cycle + occupancy;
+            if (instr.vdest != -1) vector_register_status[instr.vdest] = current_cycle + occupancy;
+            vector_instructions++;
+        }
+        
+        if (!functional_units.empty()) occupy_unit(instr);
+        
+        // Mark dest register as being written by this instruction
+        if (instr.dest_reg != -1) {
+            int latency = latency_of(instr);
+            
+            // The register will be ready after MEM or WB stage depending on forwarding
+            int ready_stage = forwarding ? EX : WB;
+            int ready_cycle = current_cycle + (ready_stage - ID) + latency - 1;
+            
+            register_status[instr.dest_reg] = {executed_instructions, ready_cycle};
+        }
+        
+        // Advance to EX stage
+        instr.current_stage = ID;
+        instr.stage_complete_cycle[ID] = current_cycle;
+        pipeline_stages[ID].push_back(instr);
+    }
+    
+    // Compute an instruction's result, or the address it accesses in MEM
+    void execute_operation(Instruction& instr) {
+        if (instr.opcode == "LUI") {
+            instr.result_value = instr.imm;
+        }
+        else if (instr.opcode == "AUIPC") {
+            instr.result_value = static_cast<int>(instruction_address(instr.pc) + instr.imm);
+        }
+        else if (instr.opcode == "ARR") {
+            // Spread the array evenly across all cores, one chunk per core
+            int num_cores = memory->num_cores;
+            int chunk = (instr.imm + num_cores - 1) / num_cores;
+            for (int i = 0; i < instr.imm; ++i) {
+                int owner = i / chunk;
+                int index = i % chunk;
+                memory->main_memory.write_word(memory->physical_address(owner, index * 4), i + 1);
+                if (owner == CID && index < 32) {
+                    registers[index] = i + 1;
+                }
+            }
+        }
+        else if (instr.opcode == "LW_SPM" || instr.opcode == "SW_SPM") {
+            // Calculate effective address for SPM operations
+            int base = instr.src_reg1 != -1 ? read_register(instr.src_reg1) : 0;
+            instr.mem_addr = base + instr.offset;
+        }
+        else if (instr.opcode == "VSETVLI") {
+            // vl was already set in decode
+        }
+        else if (is_vector(instr.opcode)) {
+            execute_vector(instr);
+        }
+        else if (is_atomic(instr.opcode)) {
+            instr.mem_addr = read_register(instr.src_reg1);
+        }
+        else if (is_csr(instr.opcode)) {
+            execute_csr(instr);
+        }
+        else if (is_dma(instr.opcode)) {
+            // Memory address (or tag) and scratchpad word index
+            instr.mem_addr = instr.src_reg1 != -1 ? read_register(instr.src_reg1) : 0;
+            if (instr.src_reg2 != -1) instr.offset = read_register(instr.src_reg2);
+        }
+        else if (is_load(instr.opcode) || is_store(instr.opcode)) {
+            // RV32IM loads and stores use base + offset; text LD/SW carry an absolute address
+            if (instr.src_reg1 != -1) {
+                instr.mem_addr = read_register(instr.src_reg1) + instr.imm;
+            }
+        }
+        else if (instr.dest_reg != -1 && instr.opcode != "JAL" && instr.opcode != "JALR" &&
+                 !is_remote_load(instr.opcode)) {
+            // Register-register or register-immediate ALU operation
+            int a = read_register(instr.src_reg1);
+            int b = instr.src_reg2 != -1 ? read_register(instr.src_reg2) : instr.imm;
+            instr.result_value = alu_result(instr.opcode, a, b);
+        }
+    }
+    
+    // Process the execute stage - perform computation
+    void stage_execute() {
+        if (pipeline_stages[ID].empty()) return;
+        
+        // The EX/MEM latch is still occupied while MEM is blocked
+        if (!pipeline_stages[EX].empty()) return;
+        
+        Instruction instr = pipeline_stages[ID].front();
+        pipeline_stages[ID].pop_front();
+        
+        // Get instruction latency
+        int latency = latency_of(instr);
+        
+        // Perform the computation; load/store values are handled in MEM stage
+        execute_operation(instr);
+        
+        // Multi-cycle instructions would stall the EX stage; with a unit pool the
+        // structural hazards in decode take the place of this flat penalty
+        if (latency > 1 && !forwarding && functional_units.empty()) {
+            stalls += (latency - 1);
+            profile_at(instr.pc).data_stalls += latency - 1;
+        }
+        
+        // Advance to MEM stage
+        instr.current_stage = EX;
+        instr.stage_complete_cycle[EX] = current_cycle;
+        pipeline_stages[EX].push_back(instr);
+    }
+    
+    // Keep an instruction in MEM for another cycle; the stages behind it stall
+    void hold_in_memory(const Instruction& instr) {
+        pipeline_stages[EX].push_front(instr);
+        
+        // Dependent instructions must keep waiting for the result
+        if (instr.dest_reg != -1 && register_status.count(instr.dest_reg)) {
+            int& ready_cycle = register_status[instr.dest_reg].second;
+            ready_cycle = max(ready_cycle, current_cycle + (forwarding ? 1 : 2));
+        }
+    }
+    
+    // Loads, stores, SPM and vector memory accesses (everything in MEM that never has to wait)
+    void access_memory(Instruction& instr, int& mem_stalls) {
+        uint32_t address = static_cast<uint32_t>(instr.mem_addr);
+        mem_stalls = 0;
+        
+        if (is_load(instr.opcode)) {
+            int word = memory->read_data(CID, address & ~3u, current_cycle, mem_stalls);
+            instr.result_value = load_result(instr.opcode, word, address);
+        } 
+        else if (is_remote_access(instr.opcode)) {
+            // Without a network on chip only core 0 gathers results from the other cores with LDC
+            bool remote_load = is_remote_load(instr.opcode);
+            bool reachable = instr.imm >= 0 && instr.imm < memory->num_cores &&
+                             (memory->noc || !remote_load || (CID == 0 && instr.imm > 0));
+            if (reachable) {
+                int data = remote_load ? 0 : read_register(instr.src_reg2);
+                data = memory->remote_access(CID, instr.imm, address, !remote_load, data, current_cycle, mem_stalls);
+                if (remote_load) instr.result_value = data;
+            }
+        } 
+        else if (is_store(instr.opcode)) {
+            // Sub-word stores only update their own bytes
+            memory->write_data(CID, address & ~3u, store_data(instr), current_cycle, mem_stalls,
+                               access_mask(instr.opcode, address));
+        }
+        // SPM operations
+        else if (instr.opcode == "LW_SPM") {
+            instr.result_value = memory->read_spm(CID, instr.mem_addr*4, mem_stalls);
+        }
+        else if (instr.opcode == "SW_SPM") {
+            memory->write_spm(CID, instr.mem_addr*4, read_register(instr.src_reg2), mem_stalls);
+        }
+        // Vector memory operations
+        else if (is_vector_load(instr.opcode) || is_vector_store(instr.opcode)) {
+            access_vector_memory(instr, mem_stalls);
+        }
+    }
+    
+    // Accesses that may not pass buffered stores
+    static bool orders_memory(const string& op) {
+        return is_atomic(op) || is_dma(op) || is_remote_access(op) ||
+               ((is_vector_load(op) || is_vector_store(op)) && op.find("_SPM") == string::npos);
+    }
+    
+    // Scalar loads and stores with a store buffer; false while the instruction has to wait in MEM.
+    // A store waits for a free entry. A load takes its value from the youngest buffered store
+    // covering its bytes, and waits for one that covers only some of them to be written.
+    bool access_store_buffer(Instruction& instr, int& mem_stalls) {
+        uint32_t address = static_cast<uint32_t>(instr.mem_addr);
+        uint32_t word_address = address & ~3u;
+        uint32_t mask = access_mask(instr.opcode, address);
+        
+        if (is_store(instr.opcode)) {
+            if (store_buffer.size() >= store_buffer_entries) {
+                store_buffer_full_stalls++;
+                return false;
+            }
+            store_buffer.push_back({instr.pc, word_address, store_data(instr), mask});
+            mem_stalls = 1;
+            return true;
+        }
+        
+        bool speculated = false;
+        for (auto store = store_buffer.rbegin(); store != store_buffer.rend(); ++store) {
+            if ((store->byte_mask & mask) == 0) continue;
+            if (store->address == word_address) {
+                if ((mask & ~store->byte_mask) == 0) {
+                    instr.result_value = load_result(instr.opcode, store->data, address);
+                    store_forwards++;
+                    mem_stalls = 1;
+                    return true;
+                }
+                store_dependence_stalls++;
+                return false;
+            }
+            if ((store->address & PAGE_OFFSET_MASK) == (word_address & PAGE_OFFSET_MASK)) {
+                if (!memory_speculation) {
+                    store_alias_stalls++;
+                    return false;
+                }
+                speculated = true;
+            }
+        }
+        if (speculated) speculated_loads++;
+        
+        int word = memory->read_data(CID, word_address, current_cycle, mem_stalls);
+        instr.result_value = load_result(instr.opcode, word, address);
+        return true;
+    }
+    
+    // Start writing the oldest buffered store once the one before it has been written
+    void drain_store_buffer() {
+        while (!store_buffer.empty() && store_buffer.front().done_cycle >= 0 &&
+               store_buffer.front().done_cycle <= current_cycle) {
+            store_buffer.pop_front();
+        }
+        if (store_buffer.empty() || store_buffer.front().done_cycle >= 0) return;
+        
+        BufferedStore& store = store_buffer.front();
+        int write_stalls = 0;
+        auto misses = miss_counts();
+        memory->write_data(CID, store.address, store.data, current_cycle, write_stalls, store.byte_mask);
+        charge_misses(store.pc, misses);
+        store.done_cycle = current_cycle + max(1, write_stalls);
+    }
+    
+    // Process the memory stage - perform memory operations
+    void stage_memory() {
+        if (pipeline_stages[EX].empty()) return;
+        
+        Instruction instr = pipeline_stages[EX].front();
+        pipeline_stages[EX].pop_front();
+        
+        // A blocking load keeps MEM until its data arrives
+        if (instr.memory_done_cycle >= 0) {
+            if (instr.memory_done_cycle > current_cycle) {
+                hold_in_memory(instr);
+            } else {
+                leave_memory(instr);
+            }
+            return;
+        }
+        
+        // Atomics, DMA, vector and remote accesses wait for buffered stores to reach memory
+        if (!store_buffer.empty() && orders_memory(instr.opcode)) {
+            hold_in_memory(instr);
+            store_fence_stalls++;
+            profile_at(instr.pc).memory_stalls++;
+            return;
+        }
+        
+        int mem_stalls = 0;
+        auto misses = miss_counts();
+        
+        // Atomics wait in MEM while another core holds the line
+        if (is_atomic(instr.opcode)) {
+            if (!access_atomic(instr, mem_stalls)) {
+                hold_in_memory(instr);
+                atomic_stalls++;
+                profile_at(instr.pc).atomic_stalls++;
+                return;
+            }
+        }
+        // DMA instructions wait in MEM for a queue slot or for completion
+        else if (is_dma(instr.opcode)) {
+            if (!access_dma(instr)) {
+                hold_in_memory(instr);
+                dma_stalls++;
+                profile_at(instr.pc).memory_stalls++;
+                return;
+            }
+        }
+        // With a store buffer, stores wait for a free entry and loads for stores they depend on
+        else if (store_buffer_entries > 0 && (is_load(instr.opcode) || is_store(instr.opcode))) {
+            if (!access_store_buffer(instr, mem_stalls)) {
+                hold_in_memory(instr);
+                profile_at(instr.pc).memory_stalls++;
+                return;
+            }
+        }
+        else {
+            access_memory(instr, mem_stalls);
+        }
+        memory_stalls += mem_stalls;
+        
+        InstructionProfile& entry = profile_at(instr.pc);
+        entry.memory_stalls += mem_stalls;
+        if (instr.opcode.find("_SPM") != string::npos) {
+            entry.spm_accesses++;
+            spm_accesses++;
+        }
+        charge_misses(instr.pc, misses);
+        if (data_profile) record_data_access(instr, mem_stalls);
+        
+        if (memory_blocking && mem_stalls > 1 &&
+            (is_load(instr.opcode) || is_remote_load(instr.opcode) || is_vector_load(instr.opcode))) {
+            instr.memory_done_cycle = current_cycle + mem_stalls - 1;
+            hold_in_memory(instr);
+            return;
+        }
+        leave_memory(instr);
+    }
+    
+    // Advance to WB stage
+    void leave_memory(Instruction& instr) {
+        instr.current_stage = MEM;
+        instr.stage_complete_cycle[MEM] = current_cycle;
+        pipeline_stages[MEM].push_back(instr);
+    }
+    
+    // Add a completed MEM-stage access to the SPM allocation profile. Only LD/SW with an
+    // absolute address can be moved; every other access pins the words it touches.
+    void record_data_access(const Instruction& instr, int mem_stalls) {
+        uint32_t address = static_cast<uint32_t>(instr.mem_addr);
+        if (is_load(instr.opcode) || is_store(instr.opcode)) {
+            WordAccessProfile& word = data_profile->word(CID, address);
+            bool load = is_load(instr.opcode);
+            if (word.loads + word.stores == 0) {
+                word.first_is_load = load;
+                word.first_stall = mem_stalls;
+            }
+            (load ? word.loads : word.stores)++;
+            word.stall_cycles += mem_stalls;
+            if (instr.src_reg1 != -1 || (instr.opcode != "LD" && instr.opcode != "SW") ||
+                address >= memory->shared_base) {
+                word.eligible = false;
+            }
+        }
+        else if (is_remote_access(instr.opcode) || is_atomic(instr.opcode)) {
+            data_profile->word(CID, address).eligible = false;
+        }
+        else if (instr.opcode == "LW_SPM" || instr.opcode == "SW_SPM") {
+            data_profile->use_spm(instr.mem_addr);
+        }
+        else if (is_vector_load(instr.opcode) || is_vector_store(instr.opcode)) {
+            bool spm = instr.opcode.find("_SPM") != string::npos;
+            for (int i = 0; i < instr.vl; i++) {
+                long long element = instr.mem_addr + static_cast<long long>(i) * instr.stride;
+                if (spm) data_profile->use_spm(element / 4);
+                else data_profile->word(CID, element).eligible = false;
+            }
+        }
+        else if (instr.opcode == "DMA_TO_SPM" || instr.opcode == "DMA_FROM_SPM") {
+            for (int i = 0; i < instr.imm; i++) {
+                data_profile->word(CID, address + i * 4).eligible = false;
+                data_profile->use_spm(instr.offset + i);
+            }
+        }
+    }
+    
+    // Process the writeback stage - write results to registers
+    void stage_writeback() {
+        if (pipeline_stages[MEM].empty()) return;
+        
+        Instruction instr = pipeline_stages[MEM].front();
+        pipeline_stages[MEM].pop_front();
+        
+        // Write result to register file
+        if (instr.dest_reg != -1) {
+            registers[instr.dest_reg] = instr.result_value;
+        }
+        
+        // Mark instruction as completed
+        instr.current_stage = WB;
+        instr.stage_complete_cycle[WB] = current_cycle;
+        instr.completed = true;
+        
+        // Add to completed instructions
+        completed_instructions.push_back(instr);
+        executed_instructions++;
+        profile_at(instr.pc).executions++;
+    }
+    
+    // Run one instruction functionally: architectural state only, with no pipeline, caches or
+    // timing. Leaves pc at the next instruction; SYNC is up to the caller.
+    void execute_functional(const Instruction& decoded) {
+        Instruction instr = decoded;
+        int next = instr.pc + 1;
+        
+        if (is_conditional_branch(instr.opcode)) {
+            if (instr.target >= 0 && branch_condition(instr)) next = instr.target;
+        }
+        else if (instr.opcode == "J") {
+            if (instr.target >= 0) next = instr.target;
+        }
+        else if (instr.opcode == "JAL" || instr.opcode == "JALR") {
+            instr.result_value = static_cast<int>(instruction_address(instr.pc + 1));
+            next = jump_target(instr);
+        }
+        else if (instr.opcode == "ECALL" || instr.opcode == "EBREAK" || instr.opcode == "ILLEGAL") {
+            if (instr.opcode == "ILLEGAL") report_illegal(instr);
+            next = program_size;
+        }
+        else {
+            if (instr.opcode == "VSETVLI") {
+                instr.result_value = set_vector_length(instr);
+            } else if (is_vector(instr.opcode)) {
+                instr.vl = vl;
+                vector_instructions++;
+            }
+            execute_operation(instr);
+            
+            // Cores take turns, so atomics need no lock; DMA transfers complete at once
+            int mem_stalls = 0;
+            if (is_atomic(instr.opcode)) {
+                perform_atomic(instr);
+            } else if (instr.opcode == "DMA_TO_SPM" || instr.opcode == "DMA_FROM_SPM") {
+                instr.result_value = dma.transfer_now(instr.opcode == "DMA_TO_SPM", static_cast<uint32_t>(instr.mem_addr),
+                                                      instr.offset, instr.imm);
+            } else if (is_dma(instr.opcode)) {
+                access_dma(instr);
+            } else {
+                access_memory(instr, mem_stalls);
+            }
+        }
+        
+        if (instr.dest_reg != -1) registers[instr.dest_reg] = instr.result_value;
+        pc = next;
+    }
+    
+    // Execute one cycle of all pipeline stages
+    void execute_cycle(const vector<Instruction>& program) {
+        // The DMA engine and the store buffer work in the background of the pipeline
+        dma.advance(current_cycle);
+        if (!store_buffer.empty()) drain_store_buffer();
+        
+        // Execute pipeline stages in reverse order to prevent data conflicts
+        stage_writeback();
+        stage_memory();
+        stage_execute();
+        stage_decode();
+        stage_fetch(program);
+        
+        profile_at(profile_pc).cycles++;
+        current_cycle++;
+    }
+    
+    // A core waiting at a barrier with nothing left in flight has no work to do
+    // until its release cycle, so the simulator stops ticking it
+    bool descheduled() const {
+        if (!waiting_for_sync || !store_buffer.empty()) return false;
+        for (int s = ID; s <= MEM; s++) {
+            if (!pipeline_stages[s].empty()) return false;
+        }
+        return true;
+    }
+    
+    // Pick up again at the given cycle, counting the skipped cycles as sync stalls
+    void resume(int cycle) {
+        sync_stalls += cycle - current_cycle;
+        profile_at(sync_pc).sync_stalls += cycle - current_cycle;
+        profile_at(sync_pc).cycles += cycle - current_cycle;
+        current_cycle = cycle;
+    }
+    
+    // Could fetch this cycle if it had the fetch slot
+    bool wants_fetch() const {
+        return !branch_taken && pc < program_size && !waiting_for_sync && draining_loop == -1;
+    }
+    
+    // Instructions fetched but not yet through EX, for the ICOUNT fetch policy
+    int front_end_count() const {
+        return static_cast<int>(pipeline_stages[IF].size() + pipeline_stages[ID].size() + pipeline_stages[EX].size());
+    }
+    
+    // Check if there are any instructions in the pipeline
+    bool pipeline_active() {
+        if (waiting_for_sync) return true; // Core is still active if waiting for sync
+        if (dma.busy()) return true;       // Queued transfers still complete
+        if (!store_buffer.empty()) return true;
+        
+        for (int i = 0; i < 5; i++) {
+            if (!pipeline_stages[i].empty()) return true;
+        }
+        return pc < program_size;
+    }
+    
+    // Get performance metrics
+    string get_performance_metrics() {
+        stringstream ss;
+        ss << "Core " << CID << " Performance Metrics:" << endl;
+        ss << "Total cycles: " << current_cycle << endl;
+        ss << "Instructions executed: " << executed_instructions << endl;
+        if (functional_instructions > 0) {
+            ss << "Instructions fast-forwarded: " << functional_instructions << endl;
+        }
+        if (extrapolations > 0 || extrapolation_failures > 0) {
+            ss << "Loop extrapolation: " << extrapolations << " times, " << extrapolated_iterations
+               << " iterations (" << extrapolated_instructions << " instructions), "
+               << extrapolation_failures << " failed checks" << endl;
+        }
+        if (memory->threads_per_core > 1) {
+            ss << "SMT thread " << smt_thread << " of physical core " << memory->physical_core(CID)
+               << ", fetch slot lost to other threads: " << fetch_slot_lost << " cycles" << endl;
+        }
+        ss << "Pipeline stalls: " << stalls << endl;
+        ss << "Memory stalls: " << memory_stalls << endl;
+        ss << "Sync stalls: " << sync_stalls << endl;
+        if (atomic_operations > 0) {
+            ss << "Atomic operations: " << atomic_operations << ", atomic stalls: " << atomic_stalls << endl;
+        }
+        if (!roi_phases.empty()) {
+            PerformanceCounters roi;
+            for (const auto& phase : roi_phases) roi += phase;
+            ss << "ROI phases: " << roi_phases.size() << ", cycles: " << roi.cycles
+               << ", instructions: " << roi.instructions << endl;
+        }
+        if (dma.transfers > 0) {
+            ss << "DMA transfers: " << dma.transfers << ", words: " << dma.words_moved
+               << ", DMA stalls: " << dma_stalls << endl;
+        }
+        if (store_buffer_entries > 0) {
+            ss << "Store buffer: " << store_forwards << " loads forwarded, stall cycles " << store_buffer_full_stalls
+               << " full, " << store_dependence_stalls << " dependence, " << store_alias_stalls << " alias, "
+               << store_fence_stalls << " fence; " << speculated_loads << " speculated loads" << endl;
+        }
+        if (!functional_units.empty()) {
+            ss << "Functional units:";
+            for (const auto& units : functional_units) {
+                // The last operation may still be busy past the end of the run
+                double utilization = current_cycle > 0 ?
+                    min(100.0, 100.0 * units.busy_cycles / (static_cast<double>(current_cycle) * units.free_at.size())) : 0.0;
+                ss << " " << units.name << " " << units.operations << " ops, " << utilization << "% busy, "
+                   << units.structural_stalls << " stalls;";
+            }
+            ss << endl;
+        }
+        if (memory->virtual_memory) {
+            ss << "TLB misses: ITLB " << memory->itlb[CID].misses << ", DTLB " << memory->dtlb[CID].misses
+               << ", page walks: " << memory->page_walks[CID] << " (" << memory->walk_cycles[CID] << " cycles)" << endl;
+        }
+        if (vector_instructions > 0) {
+            ss << "Vector instructions: " << vector_instructions
+               << ", elements: " << vector_elements
+               << ", vector stalls: " << vector_stalls << endl;
+        }
+        
+        double ipc = executed_instructions > 0 ? 
+                    static_cast<double>(executed_instructions) / current_cycle : 0;
+        ss << "Instructions per cycle (IPC): " << ipc << endl;
+        
+        return ss.str();
+    }
+    
+    // Get final cycle count
+    int get_total_cycles() {
+        return current_cycle;
+    }
+    
+    // Set program size for checking completion
+    int program_size = 0;
+};
+
+// Functional execution for FAST_FORWARD and SIMULATION_MODE FUNCTIONAL: architectural state
+// only, with no pipeline, caches or timing. Code is translated a basic block at a time into
+// threaded code - a handler per operation with its operands already decoded - so running a
+// block does no opcode string compares. Common instruction pairs are fused into one operation,
+// and each block is chained to its successors the first time control passes to them.
+// Blocks start wherever control arrives and end after a branch, jump, SYNC or environment
+// call, or before a label or branch target. The decoded program cannot change while it runs
+// (stores never reach the program partitions), so translations are only dropped when new
+// programs are loaded.
+class FunctionalEngine {
+public:
+    // How control leaves an operation
+    enum Flow { NEXT, JUMP, SYNC };
+    
+    struct MicroOp;
+    typedef Flow (*Handler)(Core& core, const MicroOp& op);
+    
+    // One translated instruction, or a fused pair with the second one's operands in rd2/rs3/rs4
+    struct MicroOp {
+        Handler handler = nullptr;
+        const Instruction* instr = nullptr; // First instruction
+        int rd = -1, rs1 = -1, rs2 = -1;
+        int imm = 0;                        // Immediate, absolute address or SPM offset
+        int rd2 = -1, rs3 = -1, rs4 = -1;
+        int target = -1;                    // Branch or jump target
+        int count = 1;                      // Instructions it stands for
+    };
+    
+    struct Block {
+        int start = 0;
+        int end = 0;                    // One past its last instruction
+        vector<MicroOp> ops;
+        Block* taken = nullptr;         // Chained successor at the branch or jump target
+        Block* fallthrough = nullptr;   // Chained successor at end
+    };
+    
+    // Statistics
+    long long blocks_translated = 0;
+    long long operations = 0;
+    long long fused_pairs = 0;
+    long long chained = 0;          // Block transitions that followed a chain link
+    long long instructions = 0;
+    double seconds = 0;
+    
+private:
+    static const int QUANTUM = 10000; // Instructions a core runs before the next core's turn
+    
+    // One program's code; each core runs the image of its program_index
+    struct Image {
+        vector<Instruction> code;   // The program, with each instruction's index filled in
+        vector<bool> leader;        // Labels and branch targets start a block
+        vector<Block*> block_at;    // Translation starting at each instruction, once made
+    };
+    
+    vector<Image> images;
+    deque<Block> storage;       // Translations (a deque keeps chain pointers valid as it grows)
+    
+    // Operations with a specialised handler
+    enum AluOp { ALU_ADD, ALU_SUB, ALU_MUL, ALU_AND, ALU_OR, ALU_XOR, ALU_SLL, ALU_SRL, ALU_SRA, ALU_SLT, ALU_SLTU };
+    enum Condition { COND_EQ, COND_NE, COND_LT, COND_GE, COND_LTU, COND_GEU };
+    
+    // Same results as Core::alu_result
+    template <AluOp OP>
+    static int alu(int a, int b) {
+        uint32_t ua = static_cast<uint32_t>(a);
+        uint32_t ub = static_cast<uint32_t>(b);
+        switch (OP) {
+            case ALU_ADD: return static_cast<int>(ua + ub);
+            case ALU_SUB: return static_cast<int>(ua - ub);
+            case ALU_MUL: return static_cast<int>(ua * ub);
+            case ALU_AND: return a & b;
+            case ALU_OR: return a | b;
+            case ALU_XOR: return a ^ b;
+            case ALU_SLL: return static_cast<int>(ua << (ub & 31));
+            case ALU_SRL: return static_cast<int>(ua >> (ub & 31));
+            case ALU_SRA: return a >> (ub & 31);
+            case ALU_SLT: return a < b;
+            case ALU_SLTU: return ua < ub;
+        }
+        return 0;
+    }
+    
+    template <Condition C>
+    static bool holds(int a, int b) {
+        switch (C) {
+            case COND_EQ: return a == b;
+            case COND_NE: return a != b;
+            case COND_LT: return a < b;
+            case COND_GE: return a >= b;
+            case COND_LTU: return static_cast<uint32_t>(a) < static_cast<uint32_t>(b);
+            case COND_GEU: return static_cast<uint32_t>(a) >= static_cast<uint32_t>(b);
+        }
+        return false;
+    }
+    
+    template <AluOp OP>
+    static Flow alu_register(Core& core, const MicroOp& op) {
+        core.registers[op.rd] = alu<OP>(core.registers[op.rs1], core.registers[op.rs2]);
+        return NEXT;
+    }
+    
+    template <AluOp OP>
+    static Flow alu_immediate(Core& core, const MicroOp& op) {
+        core.registers[op.rd] = alu<OP>(core.registers[op.rs1], op.imm);
+        return NEXT;
+    }
+    
+    static Flow load_upper(Core& core, const MicroOp& op) {
+        core.registers[op.rd] = op.imm;
+        return NEXT;
+    }
+    
+    // LD/LW and SW: base register + offset, or the text dialect's absolute address
+    template <bool BASE>
+    static uint32_t address_of(const Core& core, const MicroOp& op) {
+        return BASE ? static_cast<uint32_t>(core.registers[op.rs1]) + static_cast<uint32_t>(op.imm)
+                    : static_cast<uint32_t>(op.imm);
+    }
+    
+    template <bool BASE>
+    static Flow load_word(Core& core, const MicroOp& op) {
+        int stall_cycles = 0;
+        core.registers[op.rd] = core.memory->read_data(core.CID, address_of<BASE>(core, op) & ~3u, 0, stall_cycles);
+        return NEXT;
+    }
+    
+    template <bool BASE>
+    static Flow store_word(Core& core, const MicroOp& op) {
+        int stall_cycles = 0;
+        core.memory->write_data(core.CID, address_of<BASE>(core, op) & ~3u, core.registers[op.rs2], 0, stall_cycles);
+        return NEXT;
+    }
+    
+    // LW_SPM/SW_SPM: word slot base register + offset, or an absolute slot
+    template <bool BASE>
+    static Flow spm_load(Core& core, const MicroOp& op) {
+        int stall_cycles = 0;
+        int slot = (BASE ? core.registers[op.rs1] : 0) + op.imm;
+        core.registers[op.rd] = core.memory->read_spm(core.CID, slot * 4, stall_cycles);
+        return NEXT;
+    }
+    
+    template <bool BASE>
+    static Flow spm_store(Core& core, const MicroOp& op) {
+        int stall_cycles = 0;
+        int slot = (BASE ? core.registers[op.rs1] : 0) + op.imm;
+        core.memory->write_spm(core.CID, slot * 4, core.registers[op.rs2], stall_cycles);
+        return NEXT;
+    }
+    
+    template <Condition C>
+    static Flow branch(Core& core, const MicroOp& op) {
+        if (!holds<C>(core.registers[op.rs1], core.registers[op.rs2])) return NEXT;
+        core.pc = op.target;
+        return JUMP;
+    }
+    
+    static Flow jump(Core& core, const MicroOp& op) {
+        core.pc = op.target;
+        return JUMP;
+    }
+    
+    static Flow barrier(Core&, const MicroOp&) {
+        return SYNC;
+    }
+    
+    // Fused ADDI and conditional branch (a loop counter and its test)
+    template <Condition C>
+    static Flow add_immediate_branch(Core& core, const MicroOp& op) {
+        core.registers[op.rd] = alu<ALU_ADD>(core.registers[op.rs1], op.imm);
+        if (!holds<C>(core.registers[op.rs3], core.registers[op.rs4])) return NEXT;
+        core.pc = op.target;
+        return JUMP;
+    }
+    
+    // Fused load and the ADD after it (accumulating loaded values)
+    template <Handler LOAD>
+    static Flow load_add(Core& core, const MicroOp& op) {
+        LOAD(core, op);
+        core.registers[op.rd2] = alu<ALU_ADD>(core.registers[op.rs3], core.registers[op.rs4]);
+        return NEXT;
+    }
+    
+    // Everything else runs through the core's own instruction semantics
+    static Flow generic(Core& core, const MicroOp& op) {
+        core.execute_functional(*op.instr);
+        return core.pc == op.instr->pc + 1 ? NEXT : JUMP;
+    }
+    
+    static bool ends_block(const Instruction& instr) {
+        const string& name = instr.opcode;
+        return Core::is_conditional_branch(name) || name == "J" || name == "JAL" || name == "JALR" ||
+               name == "SYNC" || name == "ECALL" || name == "EBREAK" || name == "ILLEGAL";
+    }
+    
+    // Pick a specialised handler for an instruction; false leaves it to the generic one
+    static bool specialise(const Instruction& instr, MicroOp& op) {
+        const string& name = instr.opcode;
+        op.rd = instr.dest_reg;
+        op.rs1 = instr.src_reg1;
+        op.rs2 = instr.src_reg2;
+        op.imm = instr.imm;
+        op.target = instr.target;
+        bool writes = instr.dest_reg != -1;
+        bool base = instr.src_reg1 != -1;
+        
+        if (writes && base && instr.src_reg2 != -1) {
+            if (name == "ADD") op.handler = alu_register<ALU_ADD>;
+            else if (name == "SUB") op.handler = alu_register<ALU_SUB>;
+            else if (name == "MUL") op.handler = alu_register<ALU_MUL>;
+            else if (name == "AND") op.handler = alu_register<ALU_AND>;
+            else if (name == "OR") op.handler = alu_register<ALU_OR>;
+            else if (name == "XOR") op.handler = alu_register<ALU_XOR>;
+            else if (name == "SLL") op.handler = alu_register<ALU_SLL>;
+            else if (name == "SRL") op.handler = alu_register<ALU_SRL>;
+            else if (name == "SRA") op.handler = alu_register<ALU_SRA>;
+            else if (name == "SLT") op.handler = alu_register<ALU_SLT>;
+            else if (name == "SLTU") op.handler = alu_register<ALU_SLTU>;
+        }
+        else if (writes && base) {
+            if (name == "ADDI") op.handler = alu_immediate<ALU_ADD>;
+            else if (name == "ANDI") op.handler = alu_immediate<ALU_AND>;
+            else if (name == "ORI") op.handler = alu_immediate<ALU_OR>;
+            else if (name == "XORI") op.handler = alu_immediate<ALU_XOR>;
+            else if (name == "SLLI") op.handler = alu_immediate<ALU_SLL>;
+            else if (name == "SRLI") op.handler = alu_immediate<ALU_SRL>;
+            else if (name == "SRAI") op.handler = alu_immediate<ALU_SRA>;
+            else if (name == "SLTI") op.handler = alu_immediate<ALU_SLT>;
+            else if (name == "SLTIU") op.handler = alu_immediate<ALU_SLTU>;
+        }
+        
+        if (writes && name == "LUI") {
+            op.handler = load_upper;
+        }
+        else if (writes && (name == "LD" || name == "LW")) {
+            op.handler = base ? load_word<true> : load_word<false>;
+            if (!base) op.imm = instr.mem_addr;
+        }
+        else if (name == "SW" && instr.src_reg2 != -1) {
+            op.handler = base ? store_word<true> : store_word<false>;
+            if (!base) op.imm = instr.mem_addr;
+        }
+        else if (writes && name == "LW_SPM") {
+            op.handler = base ? spm_load<true> : spm_load<false>;
+            op.imm = instr.offset;
+        }
+        else if (name == "SW_SPM" && instr.src_reg2 != -1) {
+            op.handler = base ? spm_store<true> : spm_store<false>;
+            op.imm = instr.offset;
+        }
+        else if (Core::is_conditional_branch(name) && instr.target >= 0) {
+            if (name == "BEQ") op.handler = branch<COND_EQ>;
+            else if (name == "BNE") op.handler = branch<COND_NE>;
+            else if (name == "BLT") op.handler = branch<COND_LT>;
+            else if (name == "BGE") op.handler = branch<COND_GE>;
+            else if (name == "BLTU") op.handler = branch<COND_LTU>;
+            else if (name == "BGEU") op.handler = branch<COND_GEU>;
+        }
+        else if (name == "J" && instr.target >= 0) {
+            op.handler = jump;
+        }
+        else if (name == "SYNC") {
+            op.handler = barrier;
+        }
+        return op.handler != nullptr;
+    }
+    
+    // Merge the next operation into first when a fused handler covers the pair
+    bool fuse(MicroOp& first, const MicroOp& second) {
+        Handler handler = nullptr;
+        if (second.handler == alu_register<ALU_ADD>) {
+            if (first.handler == spm_load<true>) handler = load_add<spm_load<true>>;
+            else if (first.handler == spm_load<false>) handler = load_add<spm_load<false>>;
+            else if (first.handler == load_word<true>) handler = load_add<load_word<true>>;
+            else if (first.handler == load_word<false>) handler = load_add<load_word<false>>;
+        }
+        else if (first.handler == alu_immediate<ALU_ADD>) {
+            if (second.handler == branch<COND_EQ>) handler = add_immediate_branch<COND_EQ>;
+            else if (second.handler == branch<COND_NE>) handler = add_immediate_branch<COND_NE>;
+            else if (second.handler == branch<COND_LT>) handler = add_immediate_branch<COND_LT>;
+            else if (second.handler == branch<COND_GE>) handler = add_immediate_branch<COND_GE>;
+            else if (second.handler == branch<COND_LTU>) handler = add_immediate_branch<COND_LTU>;
+            else if (second.handler == branch<COND_GEU>) handler = add_immediate_branch<COND_GEU>;
+        }
+        if (!handler) return false;
+        
+        first.handler = handler;
+        first.rd2 = second.rd;
+        first.rs3 = second.rs1;
+        first.rs4 = second.rs2;
+        first.target = second.target;
+        first.count = 2;
+        fused_pairs++;
+        return true;
+    }
+    
+    // Translate the block starting at an instruction
+    Block* translate(Image& image, int start) {
+        const vector<Instruction>& code = image.code;
+        const vector<bool>& leader = image.leader;
+        storage.emplace_back();
+        Block* block = &storage.back();
+        block->start = start;
+        
+        int size = static_cast<int>(code.size());
+        int pc = start;
+        while (pc < size) {
+            MicroOp op;
+            op.instr = &code[pc];
+            bool special = specialise(code[pc], op);
+            if (!special) op.handler = generic;
+            pc++;
+            
+            // The next instruction may fuse with this one if it belongs to the same block
+            if (special && pc < size && !leader[pc] && !ends_block(*op.instr)) {
+                MicroOp second;
+                if (specialise(code[pc], second) && fuse(op, second)) pc++;
+            }
+            block->ops.push_back(op);
+            
+            if (ends_block(code[pc - 1]) || (pc < size && leader[pc])) break;
+        }
+        
+        block->end = pc;
+        blocks_translated++;
+        operations += block->ops.size();
+        return block;
+    }
+    
+    Block* lookup(Image& image, int pc) {
+        Block*& block = image.block_at[pc];
+        if (!block) block = translate(image, pc);
+        return block;
+    }
+    
+    // Run one block and return the block control passes to, or nullptr when the core stops:
+    // at the end of the program, or at a SYNC (at_sync is set and pc is left on it)
+    Block* step(Core& core, Block* block, long long& executed, bool& at_sync) {
+        Image& image = images[core.program_index];
+        int size = static_cast<int>(image.code.size());
+        const MicroOp* op = block->ops.data();
+        const MicroOp* last = op + block->ops.size();
+        Flow flow = NEXT;
+        for (; op != last; ++op) {
+            flow = op->handler(core, *op);
+            if (flow != NEXT) break;
+            executed += op->count;
+        }
+        
+        if (flow == SYNC) {
+            core.pc = op->instr->pc;
+            at_sync = true;
+            return nullptr;
+        }
+        if (flow == JUMP) {
+            executed += op->count;
+            if (core.pc >= size) return nullptr;
+            if (core.pc != op->target) return lookup(image, core.pc);
+            if (block->taken) {
+                chained++;
+            } else {
+                block->taken = lookup(image, core.pc);
+            }
+            return block->taken;
+        }
+        
+        core.pc = block->end;
+        if (core.pc >= size) return nullptr;
+        if (block->fallthrough) {
+            chained++;
+        } else {
+            block->fallthrough = lookup(image, core.pc);
+        }
+        return block->fallthrough;
+    }
+    
+    // Run a core block by block for about quantum instructions; returns the number run.
+    // at_barrier is set when it stops at a SYNC (pc is left on it).
+    long long run_core(Core& core, long long quantum, bool& at_barrier) {
+        long long executed = 0;
+        Block* block = lookup(images[core.program_index], core.pc);
+        while (block && executed < quantum) {
+            block = step(core, block, executed, at_barrier);
+        }
+        return executed;
+    }
+    
+public:
+    // Drop every program and its translations
+    void clear() {
+        images.clear();
+        storage.clear();
+    }
+    
+    // Take a newly loaded program as the next program index
+    void load(const vector<Instruction>& program, const unordered_map<string, int>& labels) {
+        images.emplace_back();
+        Image& image = images.back();
+        vector<Instruction>& code = image.code;
+        code = program;
+        image.leader.assign(code.size(), false);
+        for (size_t i = 0; i < code.size(); i++) {
+            code[i].pc = static_cast<int>(i);
+            int target = code[i].target;
+            if (target >= 0 && target < static_cast<int>(code.size())) image.leader[target] = true;
+        }
+        for (const auto& label : labels) {
+            if (label.second >= 0 && label.second < static_cast<int>(code.size())) image.leader[label.second] = true;
+        }
+        image.block_at.assign(code.size(), nullptr);
+    }
+    
+    // Run every core until it has executed limit instructions, its program has ended or it waits
+    // at a barrier that cannot complete. Cores take turns a quantum at a time; a SYNC releases
+    // once every core of the program's group has reached it. Returns false if the run stopped at such a barrier.
+    bool run(vector<Core>& cores, long long limit) {
+        auto start_time = chrono::steady_clock::now();
+        MemoryHierarchy* memory = cores[0].memory;
+        memory->functional = true;
+        
+        vector<long long> executed(cores.size(), 0);
+        vector<bool> at_barrier(cores.size(), false);
+        bool stuck = false;
+        
+        while (true) {
+            bool progress = false;
+            size_t waiting = 0;
+            for (size_t c = 0; c < cores.size(); c++) {
+                Core& core = cores[c];
+                if (!at_barrier[c] && core.pc < core.program_size && executed[c] < limit) {
+                    bool reached_sync = false;
+                    executed[c] += run_core(core, min<long long>(QUANTUM, limit - executed[c]), reached_sync);
+                    at_barrier[c] = reached_sync;
+                    progress = true;
+                }
+                if (at_barrier[c]) waiting++;
+            }
+            
+            // A group whose cores are all waiting passes its barrier
+            bool released = false;
+            for (size_t c = 0; c < cores.size() && waiting > 0; c++) {
+                if (!at_barrier[c]) continue;
+                const vector<int>& group = cores[c].sync_barrier->group_members(static_cast<int>(c));
+                if (!all_of(group.begin(), group.end(), [&](int m) { return at_barrier[m]; })) continue;
+                for (int m : group) {
+                    at_barrier[m] = false;
+                    cores[m].pc++;
+                    executed[m]++;
+                    waiting--;
+                }
+                released = true;
+            }
+            if (released) continue;
+            if (!progress) {
+                // Cores that ran out of instructions would still reach the barrier in the detailed run
+                stuck = waiting > 0 && none_of(executed.begin(), executed.end(),
+                                               [limit](long long n) { return n >= limit; });
+                break;
+            }
+        }
+        
+        memory->functional = false;
+        for (size_t c = 0; c < cores.size(); c++) {
+            cores[c].functional_instructions += executed[c];
+            instructions += executed[c];
+        }
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+        return !stuck;
+    }
+    
+    // Loops whose bodies (head to back-edge) can run functionally in the middle of a timed run:
+    // no barriers, atomics, DMA, remote accesses, calls, counter reads or environment calls
+    bool can_extrapolate(int program, int head, int back_edge) const {
+        for (int pc = head; pc <= back_edge; pc++) {
+            const string& name = images[program].code[pc].opcode;
+            if (name == "SYNC" || Core::is_atomic(name) || Core::is_dma(name) || Core::is_remote_access(name) ||
+                Core::is_csr(name) || name == "JAL" || name == "JALR" || name == "ECALL" ||
+                name == "EBREAK" || name == "ILLEGAL") {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    // Run whole iterations of the loop starting at the core's pc, up to max_iterations, where
+    // each is expected to run length instructions up to the back-edge. Stops at the first block
+    // boundary after an iteration strays from that (the loop exits or takes another path) or
+    // the loop touches the shared window, which other cores may be using meanwhile. With
+    // expect_hits it also stops at an access the core's first data level does not hold.
+    // Returns the whole iterations run; instructions counts everything executed.
+    long long run_loop(Core& core, int back_edge, long long length, long long max_iterations, bool expect_hits,
+                       long long& instructions) {
+        auto start_time = chrono::steady_clock::now();
+        MemoryHierarchy* memory = core.memory;
+        memory->functional = true;
+        long long shared_accesses = memory->functional_shared_accesses;
+        long long misses = memory->functional_misses;
+        
+        int head = core.pc;
+        long long iterations = 0;
+        long long in_iteration = 0; // Instructions run so far in the current iteration
+        bool at_sync = false;
+        instructions = 0;
+        
+        Block* block = lookup(images[core.program_index], head);
+        while (block && iterations < max_iterations) {
+            long long executed = 0;
+            bool closes_iteration = block->end - 1 == back_edge;
+            block = step(core, block, executed, at_sync);
+            instructions += executed;
+            in_iteration += executed;
+            
+            if (memory->functional_shared_accesses != shared_accesses) break;
+            if (expect_hits && memory->functional_misses != misses) break;
+            if (closes_iteration && core.pc == head) {
+                if (in_iteration != length) break;
+                iterations++;
+                in_iteration = 0;
+            } else if (in_iteration >= length) {
+                break;
+            }
+        }
+        
+        memory->functional = false;
+        this->instructions += instructions;
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+        return iterations;
+    }
+    
+    string get_stats() const {
+        stringstream ss;
+        ss << "Functional execution: " << instructions << " instructions in " << seconds << " s";
+        if (seconds > 0) ss << " (" << instructions / seconds / 1e6 << " MIPS)";
+        ss << endl;
+        ss << "Translation cache: " << blocks_translated << " blocks, " << operations << " operations, "
+           << fused_pairs << " fused pairs, " << chained << " chained block transitions" << endl;
+        return ss.str();
+    }
+};
+
+// Pipeline snapshots written by a background thread. The simulation thread only copies
+// fixed-size records into a single-producer, single-consumer ring; the writer thread turns
+// them into text (or raw binary records) and writes them through a large stdio buffer.
+// Text output can be piped through gzip
+class AsyncLogger {
+public:
+    static const int STAGES = 5;
+    struct Record {
+        int cycle;
+        int core;
+        int program;
+        int pcs[STAGES];    // Instruction in each stage, -1 when empty
+    };
+    using Formatter = function<void(const Record&, string&)>;
+    
+    long long records_pushed = 0;
+    long long producer_waits = 0; // Times the ring was full and the simulation waited
+    
+    // Opens the output: an empty filename writes to stdout
+    AsyncLogger(const string& filename, bool binary, bool compress, Formatter text_formatter) :
+        ring(RING_SIZE),
+        binary_output(binary),
+        formatter(move(text_formatter)) {
+        if (filename.empty()) {
+            output = stdout;
+        }
+#if defined(__unix__) || defined(__APPLE__)
+        else if (compress) {
+            output = open_gzip_pipe(filename);
+            piped = output != nullptr;
+        }
+#endif
+        else {
+            if (compress) cerr << "Compressed traces need gzip, writing " << filename << " uncompressed" << endl;
+            output = fopen(filename.c_str(), binary ? "wb" : "w");
+        }
+        if (!output) {
+            cerr << "Error opening trace file: " << filename << endl;
+            return;
+        }
+        if (output != stdout) setvbuf(output, nullptr, _IOFBF, 1 << 20);
+        if (binary_output) fwrite("PTRC", 1, 4, output);
+        writer = thread(&AsyncLogger::write_loop, this);
+    }
+    
+    // Drains the ring and closes the output
+    ~AsyncLogger() {
+        if (writer.joinable()) {
+            stopping.store(true, memory_order_release);
+            writer.join();
+        }
+        if (!output) return;
+#if defined(__unix__) || defined(__APPLE__)
+        if (piped) {
+            fclose(output);
+            int status;
+            while (waitpid(gzip_pid, &status, 0) < 0 && errno == EINTR) {}
+            return;
+        }
+#endif
+        if (output == stdout) fflush(output);
+        else fclose(output);
+    }
+    
+    bool ok() const { return output != nullptr; }
+    
+    // Called by the simulation thread only
+    void push(const Record& record) {
+        size_t tail = ring_tail.load(memory_order_relaxed);
+        while (tail - ring_head.load(memory_order_acquire) >= RING_SIZE) {
+            producer_waits++;
+            this_thread::yield();
+        }
+        ring[tail & (RING_SIZE - 1)] = record;
+        ring_tail.store(tail + 1, memory_order_release);
+        records_pushed++;
+    }
+    
+private:
+    static const size_t RING_SIZE = 1 << 16;
+    static const size_t FLUSH_BYTES = 1 << 16;
+    
+    vector<Record> ring;
+    atomic<size_t> ring_head{0};  // Next record the writer takes
+    atomic<size_t> ring_tail{0};  // Next free slot
+    atomic<bool> stopping{false};
+    FILE* output = nullptr;
+    bool piped = false;
+    bool binary_output;
+    Formatter formatter;
+    thread writer;
+#if defined(__unix__) || defined(__APPLE__)
+    pid_t gzip_pid = -1;
+    
+    // Starts gzip with the trace file as its stdout and returns the write end of its stdin.
+    // The filename never reaches a shell
+    FILE* open_gzip_pipe(const string& filename) {
+        int file = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file < 0) return nullptr;
+        int fds[2];
+        if (pipe(fds) < 0) {
+            close(file);
+            return nullptr;
+        }
+        gzip_pid = fork();
+        if (gzip_pid == 0) {
+            dup2(fds[0], STDIN_FILENO);
+            dup2(file, STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            close(file);
+            execlp("gzip", "gzip", "-c", (char*)nullptr);
+            _exit(127);
+        }
+        close(fds[0]);
+        close(file);
+        if (gzip_pid < 0) {
+            close(fds[1]);
+            return nullptr;
+        }
+        FILE* stream = fdopen(fds[1], "w");
+        if (!stream) {
+            close(fds[1]);
+            waitpid(gzip_pid, nullptr, 0);
+        }
+        return stream;
+    }
+#endif
+    
+    void write_loop() {
+        string text;
+        while (true) {
+            bool stop = stopping.load(memory_order_acquire);
+            size_t head = ring_head.load(memory_order_relaxed);
+            size_t tail = ring_tail.load(memory_order_acquire);
+            
+            for (; head != tail; head++) {
+                const Record& record = ring[head & (RING_SIZE - 1)];
+                if (binary_output) {
+                    int32_t fields[3 + STAGES] = {record.cycle, record.core, record.program};
+                    copy(record.pcs, record.pcs + STAGES, fields + 3);
+                    fwrite(fields, sizeof(fields), 1, output);
+                } else {
+                    formatter(record, text);
+                    if (text.size() >= FLUSH_BYTES) {
+                        fwrite(text.data(), 1, text.size(), output);
+                        text.clear();
+                    }
+                }
+                ring_head.store(head + 1, memory_order_release);
+            }
+            
+            if (!text.empty()) {
+                fwrite(text.data(), 1, text.size(), output);
+                text.clear();
+            }
+            // The producer has stopped once stopping is set, so an empty ring is final
+            if (stop) break;
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+    }
+};
+
+// Simulator class to manage multiple cores and their interactions
+class Simulator
+{
+public:
+    MemoryHierarchy* memory;      // Memory hierarchy (caches, main memory, SPM)
+    SyncBarrier* sync_barrier;    // Synchronization barrier for SYNC instruction
+    vector<Core> cores;           // Vector of compute units (cores)
+    CacheConfig config;           // Cache configuration
+    FunctionalEngine functional;  // Translated code for fast-forwarding and functional runs
+    
+    // A program and the group of cores running it, each with its own copy of its data image
+    struct Program {
+        string file;
+        vector<uint8_t> image;              // File contents, kept for the standalone runs
+        vector<Instruction> code;           // Decoded once at load time
+        unordered_map<string, int> labels;  // Label to instruction index mapping
+        uint64_t base = 0;                  // Address of the first instruction
+        int entry = 0;                      // Instruction index execution starts at
+        bool riscv = false;                 // Loaded from an RV32IM binary
+        vector<int> cores;                  // Cores running it
+    };
+    vector<Program> programs;     // Indexed by Core::program_index; the prompt's program comes first
+    
+    // Initial stack pointer for RV32IM programs (top of each core's partition)
+    static const int STACK_TOP = 0x7FFFFFF0;
+
+    // SMT fetch arbitration, per physical core
+    vector<int> fetch_owner;             // Thread that had the fetch slot last
+    vector<long long> fetch_owner_misses; // Its L1 misses when it got the slot (SWITCH_ON_MISS)
+    
+    bool fast_forwarded = false;  // FAST_FORWARD already done, ahead of run()
+    
+    // Constructor to initialize the simulator with cores; with SMT every physical core
+    // contributes SMT_THREADS hardware threads, and those are what cores holds
+    Simulator(int physical_cores, bool enable_forwarding, const CacheConfig& cache_config) 
+        : config(cache_config)
+    {
+        int num_cores = physical_cores * config.smt_threads;
+        fetch_owner.assign(physical_cores, 0);
+        fetch_owner_misses.assign(physical_cores, 0);
+        
+        // Initialize memory hierarchy
+        memory = new MemoryHierarchy(config, num_cores);
+        
+        // Initialize synchronization barrier
+        BarrierAlgorithm barrier_algorithm = BARRIER_CENTRALIZED;
+        SyncBarrier::parse_algorithm(config.barrier_algorithm, barrier_algorithm);
+        sync_barrier = new SyncBarrier(num_cores, barrier_algorithm, config.barrier_latency, config.barrier_fan_in);
+        
+        // Initialize cores
+        for (int i = 0; i < num_cores; ++i)
+        {
+            cores.emplace_back(i, enable_forwarding, memory, sync_barrier);
+            cores.back().configure_vector_unit(config.vlen, config.vector_lanes);
+            cores.back().dma = DmaEngine(memory, i, config.dma_queue_depth);
+            cores.back().smt_thread = i % config.smt_threads;
+            cores.back().memory_blocking = config.memory_blocking;
+            cores.back().store_buffer_entries = config.store_buffer;
+            cores.back().memory_speculation = config.memory_speculation;
+            cores.back().configure_functional_units(config.functional_units);
+        }
+    }
+    
+    ~Simulator() {
+        delete memory;
+        delete sync_barrier;
+    }
+
+    // Set instruction latencies for the cores
+    void set_instruction_latencies()
+    {
+        cout << "Enter latencies for ADD, SUB, MUL, DIV: ";
+        int add_lat, sub_lat, mul_lat, div_lat;
+        cin >> add_lat >> sub_lat >> mul_lat >> div_lat;
+        set_instruction_latencies(add_lat, sub_lat, mul_lat, div_lat);
+    }
+    
+    void set_instruction_latencies(int add_lat, int sub_lat, int mul_lat, int div_lat)
+    {
+        for (auto& core : cores) {
+            core.latencies["ADD"] = add_lat;
+            core.latencies["SUB"] = sub_lat;
+            core.latencies["MUL"] = mul_lat;
+            core.latencies["DIV"] = div_lat;
+            
+            // RV32IM variants share the latency of their base operation
+            for (const char* op : {"MULH", "MULHSU", "MULHU"}) core.latencies[op] = mul_lat;
+            for (const char* op : {"DIVU", "REM", "REMU"}) core.latencies[op] = div_lat;
+            
+            // SPM instructions have same latency as L1 cache
+            core.latencies["LW_SPM"] = config.l1_latency;
+            core.latencies["SW_SPM"] = config.l1_latency;
+            
+            // Memory instructions have variable latency based on cache hits/misses
+            core.latencies["LD"] = config.l1_latency;  // Best case (L1 hit)
+            core.latencies["SW"] = config.l1_latency;  // Best case (L1 hit)
+            for (const char* op : {"LW", "LH", "LHU", "LB", "LBU", "SH", "SB"}) {
+                core.latencies[op] = config.l1_latency;
+            }
+            
+            // Other core instruction latencies (LDC1/SWC1 .. LDC<num_cores>/SWC<num_cores>)
+            for (size_t c = 1; c <= cores.size(); ++c) {
+                core.latencies["LDC" + to_string(c)] = config.l1_latency;
+                core.latencies["SWC" + to_string(c)] = config.l1_latency;
+            }
+        }
+    }
+
+    // Read a whole program file
+    static bool read_file(const string& filename, vector<uint8_t>& image)
+    {
+        ifstream file(filename, ios::binary);
+        if (!file.is_open())
+        {
+            cerr << "Error opening file: " << filename << endl;
+            return false;
+        }
+        
+        image.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        return true;
+    }
+    
+    // Load program from file and set up labels
+    // ELF executables and flat .bin images are decoded as RV32IM, anything else as text assembly
+    bool load_program(const string &filename)
+    {
+        vector<uint8_t> image;
+        if (!read_file(filename, image)) return false;
+        return load_program(filename, image);
+    }
+    
+    // Load a program for every core that CORE_PROGRAM lines do not give one of their own
+    // (a later line wins a core named twice), then the programs of those lines
+    bool load_program(const string& filename, const vector<uint8_t>& image)
+    {
+        programs.clear();
+        functional.clear();
+        
+        vector<int> line_of_core(cores.size(), -1);
+        for (size_t i = 0; i < config.core_programs.size(); i++) {
+            for (int c = config.core_programs[i].first_core; c <= config.core_programs[i].last_core; c++) {
+                line_of_core[c] = static_cast<int>(i);
+            }
+        }
+        
+        for (int line = -1; line < static_cast<int>(config.core_programs.size()); line++) {
+            vector<int> group;
+            for (size_t c = 0; c < cores.size(); c++) {
+                if (line_of_core[c] == line) group.push_back(static_cast<int>(c));
+            }
+            if (group.empty()) continue;
+            
+            if (line < 0) {
+                if (!add_program(filename, image, group)) return false;
+                continue;
+            }
+            const string& file = config.core_programs[line].file;
+            vector<uint8_t> contents;
+            if (!read_file(file, contents) || !add_program(file, contents, group)) return false;
+        }
+        return true;
+    }
+    
+    // Load a program image for a group of cores; the name selects flat binaries (.bin),
+    // ELF is recognised by its magic
+    bool add_program(const string& filename, const vector<uint8_t>& image, const vector<int>& group)
+    {
+        int index = static_cast<int>(programs.size());
+        programs.emplace_back();
+        programs.back().file = filename;
+        programs.back().image = image;
+        programs.back().cores = group;
+        for (int c : group) {
+            cores[c].program_index = index;
+            memory->core_program[c] = index;
+        }
+        sync_barrier->assign_group(index, group);
+        
+        bool loaded;
+        if (image.size() >= 4 && image[0] == 0x7f && image[1] == 'E' && image[2] == 'L' && image[3] == 'F') {
+            loaded = load_elf(image, index);
+        } else if (filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0) {
+            loaded = load_flat_binary(image, index);
+        } else {
+            loaded = load_text(string(image.begin(), image.end()), index);
+        }
+        if (!loaded) {
+            programs.pop_back();
+            return false;
+        }
+        const Program& program = programs[index];
+        
+        // Set program size and entry point for the group's cores
+        for (size_t rank = 0; rank < group.size(); rank++) {
+            Core& core = cores[group[rank]];
+            core.program_size = program.code.size();
+            core.program_base = program.base;
+            core.profile.assign(program.code.size(), InstructionProfile());
+            core.pc = program.entry;
+            
+            // Compiled code expects a stack; a0/a1 carry the core's rank in its group and the group size
+            if (program.riscv) {
+                core.registers[2] = STACK_TOP;
+                core.registers[10] = static_cast<int>(rank);
+                core.registers[11] = static_cast<int>(group.size());
+            }
+        }
+        functional.load(program.code, program.labels);
+        
+        // Loops (backward branches and jumps) whose iterations may be extrapolated
+        vector<bool> extrapolatable(program.code.size(), false);
+        for (size_t i = 0; i < program.code.size(); i++) {
+            const Instruction& instr = program.code[i];
+            bool back_edge = (Core::is_conditional_branch(instr.opcode) || instr.opcode == "J") &&
+                             instr.target >= 0 && instr.target <= static_cast<int>(i);
+            extrapolatable[i] = back_edge && functional.can_extrapolate(index, instr.target, static_cast<int>(i));
+        }
+        for (int c : group) {
+            cores[c].loop_stable_iterations = config.loop_extrapolation;
+            cores[c].extrapolatable = extrapolatable;
+        }
+        
+        return true;
+    }
+    
+    // Parse text assembly, one instruction per line
+    bool load_text(const string& text, int index)
+    {
+        vector<Instruction>& program = programs[index].code;
+        unordered_map<string, int>& labels = programs[index].labels;
+        istringstream file(text);
+        string line;
+        int line_num = 0;
+        while (getline(file, line))
+        {
+            // Skip empty lines
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+            
+            istringstream iss(line);
+            string first_word;
+            iss >> first_word;
+
+            if (!first_word.empty() && first_word.back() == ':')
+            {
+                first_word.pop_back();
+                labels[first_word] = line_num;
+            }
+            else
+            {
+                program.push_back(Core::parse_instruction(line));
+                line_num++;
+            }
+        }
+        
+        // Resolve branch and jump labels to instruction indices
+        for (auto& instr : program) {
+            if (!instr.label.empty() && labels.count(instr.label)) {
+                instr.target = labels[instr.label];
+            }
+        }
+        
+        return true;
+    }
+    
+    // Load a flat RV32IM image at address 0 and start executing at its first word
+    bool load_flat_binary(const vector<uint8_t>& image, int index)
+    {
+        memory->load_image(0, image.data(), image.size(), index);
+        decode_text_segment(image.data(), 0, image.size(), index);
+        programs[index].riscv = true;
+        return true;
+    }
+    
+    // Load a statically linked little-endian RV32 ELF executable
+    bool load_elf(const vector<uint8_t>& image, int index)
+    {
+        auto read16 = [&](size_t offset) -> uint32_t {
+            return offset + 2 <= image.size() ? image[offset] | (image[offset + 1] << 8) : 0;
+        };
+        auto read32 = [&](size_t offset) -> uint32_t {
+            return offset + 4 <= image.size() ? read16(offset) | (read16(offset + 2) << 16) : 0;
+        };
+        
+        // e_ident: 32-bit class, little endian; e_machine: RISC-V
+        if (image.size() < 52 || image[4] != 1 || image[5] != 1 || read16(18) != 243) {
+            cerr << "Unsupported ELF file: expected a 32-bit little-endian RISC-V executable" << endl;
+            return false;
+        }
+        
+        uint32_t entry = read32(24);
+        uint32_t phoff = read32(28);
+        uint32_t shoff = read32(32);
+        uint32_t phentsize = read16(42), phnum = read16(44);
+        uint32_t shentsize = read16(46), shnum = read16(48);
+        
+        // Place every PT_LOAD segment; executable ones span the decoded text
+        uint64_t text_start = UINT64_MAX, text_end = 0;
+        for (uint32_t i = 0; i < phnum; i++) {
+            size_t ph = phoff + static_cast<size_t>(i) * phentsize;
+            if (read32(ph) != 1) continue; // PT_LOAD
+            
+            uint32_t offset = read32(ph + 4), vaddr = read32(ph + 8);
+            uint32_t filesz = read32(ph + 16), flags = read32(ph + 24);
+            if (static_cast<size_t>(offset) + filesz > image.size()) {
+                cerr << "Truncated ELF segment at 0x" << hex << vaddr << dec << endl;
+                return false;
+            }
+            
+            memory->load_image(vaddr, image.data() + offset, filesz, index);
+            if (flags & 1) { // PF_X
+                text_start = min<uint64_t>(text_start, vaddr);
+                text_end = max<uint64_t>(text_end, static_cast<uint64_t>(vaddr) + filesz);
+            }
+        }
+        if (text_start >= text_end) {
+            cerr << "ELF file has no executable segment" << endl;
+            return false;
+        }
+        
+        // Decode the executable range from the loaded image
+        vector<uint8_t> text(text_end - text_start);
+        for (size_t i = 0; i < text.size(); i += 4) {
+            uint64_t physical = memory->program_address(index, text_start + i);
+            uint32_t word = static_cast<uint32_t>(memory->main_memory.read_word(physical));
+            for (size_t b = 0; b < 4 && i + b < text.size(); b++) text[i + b] = (word >> (8 * b)) & 0xff;
+        }
+        decode_text_segment(text.data(), text_start, text.size(), index);
+        
+        if (entry < text_start || entry >= text_end) {
+            cerr << "ELF entry point 0x" << hex << entry << dec << " is outside the text segment" << endl;
+            return false;
+        }
+        programs[index].entry = static_cast<int>((entry - text_start) / 4);
+        
+        // Symbols inside the text segment become labels
+        for (uint32_t i = 0; i < shnum; i++) {
+            size_t sh = shoff + static_cast<size_t>(i) * shentsize;
+            if (read32(sh + 4) != 2) continue; // SHT_SYMTAB
+            
+            size_t symtab = read32(sh + 16), symtab_size = read32(sh + 20);
+            size_t strtab = read32(shoff + static_cast<size_t>(read32(sh + 24)) * shentsize + 16);
+            for (size_t sym = symtab; sym + 16 <= symtab + symtab_size && sym + 16 <= image.size(); sym += 16) {
+                uint32_t value = read32(sym + 4);
+                int type = image[sym + 12] & 0xf;
+                if ((type != 0 && type != 2) || read16(sym + 14) == 0) continue; // NOTYPE/FUNC, defined
+                if (value < text_start || value >= text_end) continue;
+                
+                size_t name = strtab + read32(sym);
+                string symbol;
+                while (name < image.size() && image[name] != 0) symbol += static_cast<char>(image[name++]);
+                if (!symbol.empty() && symbol[0] != '$') {
+                    programs[index].labels[symbol] = static_cast<int>((value - text_start) / 4);
+                }
+            }
+        }
+        
+        programs[index].riscv = true;
+        return true;
+    }
+    
+    // Decode a block of RV32IM code that starts at base
+    void decode_text_segment(const uint8_t* bytes, uint64_t base, size_t size, int index)
+    {
+        static const RiscvDecoder decoder;
+        
+        vector<Instruction>& program = programs[index].code;
+        programs[index].base = base;
+        program.clear();
+        program.reserve(size / 4);
+        for (size_t i = 0; i + 4 <= size; i += 4) {
+            uint32_t word = bytes[i] | (bytes[i + 1] << 8) | (bytes[i + 2] << 16) |
+                            (static_cast<uint32_t>(bytes[i + 3]) << 24);
+            program.push_back(decoder.decode(word, base + i, base));
+        }
+    }
+
+    // Short text form of an instruction: opcode, registers and label
+    static string instruction_text(const Instruction& instr) {
+        string text = instr.opcode;
+        if (instr.dest_reg != -1) text += " x" + to_string(instr.dest_reg);
+        if (instr.src_reg1 != -1) text += " x" + to_string(instr.src_reg1);
+        if (instr.src_reg2 != -1) text += " x" + to_string(instr.src_reg2);
+        if (!instr.label.empty()) text += " " + instr.label;
+        return text;
+    }
+    
+    // Label each instruction belongs to: the nearest label at or before it
+    // (assembler-local .L symbols from ELF files are skipped)
+    static vector<string> enclosing_labels(const Program& program) {
+        vector<pair<int, string>> starts;
+        for (const auto& [name, index] : program.labels) {
+            if (name.compare(0, 2, ".L") != 0) starts.emplace_back(index, name);
+        }
+        sort(starts.begin(), starts.end());
+        
+        vector<string> names(program.code.size(), "(start)");
+        size_t next = 0;
+        string current = "(start)";
+        for (size_t i = 0; i < program.code.size(); i++) {
+            while (next < starts.size() && starts[next].first <= static_cast<int>(i)) {
+                current = starts[next++].second;
+            }
+            names[i] = current;
+        }
+        return names;
+    }
+    
+    // Print one row of hotspot counters
+    static void print_profile_row(const string& name, const InstructionProfile& p, long long total_cycles) {
+        cout << left << setw(32) << name.substr(0, 31) << right
+             << setw(10) << p.cycles
+             << setw(7) << fixed << setprecision(1) << (total_cycles > 0 ? 100.0 * p.cycles / total_cycles : 0.0)
+             << defaultfloat << setprecision(6)
+             << setw(9) << p.executions
+             << setw(8) << p.data_stalls
+             << setw(8) << p.memory_stalls
+             << setw(8) << p.branch_stalls
+             << setw(8) << p.sync_stalls
+             << setw(8) << p.atomic_stalls
+             << setw(8) << p.vector_stalls
+             << setw(8) << p.l1_misses
+             << setw(8) << p.l2_misses
+             << setw(8) << p.spm_accesses << endl;
+    }
+    
+    // Hotspot report of each program: cycles and stalls per label and per instruction, summed over its cores
+    void display_profile() {
+        if (config.profile_top <= 0) return;
+        for (const auto& program : programs) {
+            if (programs.size() > 1) cout << "Program " << program.file << ":" << endl;
+            display_profile(program);
+        }
+    }
+    
+    void display_profile(const Program& program) {
+        if (program.code.empty()) return;
         
-        // Check RAW hazards
-        if (instr.src_reg1 != -1) {
-            if (register_status.count(instr.src_reg1)) {
-                auto [instr_idx, ready_cycle] = register_status[instr.src_reg1];
-                
-                // If the value isn't ready yet
-                if (ready_cycle > current_cycle) {
-                    if (!forwarding) {
-                        // Without forwarding, stall until the value is in register file
-                        stall_cycles = max(stall_cycles, ready_cycle - current_cycle);
-                        return stall_cycles > 0;
-                    } else {
-                        // With forwarding, check if we can forward from EX or MEM stages
-                        // Find the instruction that produces the value
-                        bool can_forward = false;
-                        
-                        // Look through all pipeline stages to find the producer instruction
-                        for (int stage = EX; stage <= MEM; stage++) {
-                            for (const auto& pipeline_instr : pipeline_stages[stage]) {
-                                if (pipeline_instr.dest_reg == instr.src_reg1) {
-                                    // If in EX, and will complete this cycle, we can forward
-                                    if (stage == EX && pipeline_instr.stage_complete_cycle[EX] == current_cycle) {
-                                        can_forward = true;
-                                    }
-                                    // If in MEM, we can always forward
-                                    else if (stage == MEM) {
-                                        can_forward = true;
-                                    }
-                                }
-                            }
-                        }
-                        
-                        if (!can_forward) {
-                            stall_cycles = max(stall_cycles, 1); // Stall for at least 1 cycle
-                            return true;
-                        }
-                    }
+        vector<string> names = enclosing_labels(program);
+        vector<InstructionProfile> by_instruction(program.code.size());
+        map<string, InstructionProfile> by_label;
+        long long total_cycles = 0;
+        for (int c : program.cores) {
+            const Core& core = cores[c];
+            for (size_t i = 0; i < core.profile.size(); i++) {
+                by_instruction[i].add(core.profile[i]);
+                by_label[names[i]].add(core.profile[i]);
+                total_cycles += core.profile[i].cycles;
+            }
+        }
+        
+        auto header = [](const string& first) {
+            cout << left << setw(32) << first << right << setw(10) << "cycles" << setw(7) << "%"
+                 << setw(9) << "execs" << setw(8) << "data" << setw(8) << "memory" << setw(8) << "branch"
+                 << setw(8) << "sync" << setw(8) << "atomic" << setw(8) << "vector"
+                 << setw(8) << "L1miss" << setw(8) << "L2miss" << setw(8) << "SPM" << endl;
+        };
+        
+        vector<pair<string, InstructionProfile>> label_rows(by_label.begin(), by_label.end());
+        stable_sort(label_rows.begin(), label_rows.end(),
+                    [](const auto& a, const auto& b) { return a.second.cycles > b.second.cycles; });
+        cout << "Hotspots by label (stall columns count stall cycles):" << endl;
+        header("label");
+        for (const auto& row : label_rows) print_profile_row(row.first, row.second, total_cycles);
+        
+        vector<int> order(program.code.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        stable_sort(order.begin(), order.end(),
+                    [&](int a, int b) { return by_instruction[a].cycles > by_instruction[b].cycles; });
+        order.resize(min<size_t>(order.size(), config.profile_top));
+        
+        cout << "\nTop " << order.size() << " instructions:" << endl;
+        header("instruction");
+        for (int i : order) {
+            stringstream name;
+            name << hex << "0x" << program.base + 4ULL * i << dec << " " << instruction_text(program.code[i]);
+            print_profile_row(name.str(), by_instruction[i], total_cycles);
+        }
+        cout << endl;
+    }
+    
+    // Folded stacks (core;label;instruction cycles) for flamegraph tools
+    bool write_folded_profile(const string& filename) {
+        ofstream out(filename);
+        if (!out.is_open()) {
+            cerr << "Error opening profile output file: " << filename << endl;
+            return false;
+        }
+        
+        for (const auto& program : programs) {
+            vector<string> names = enclosing_labels(program);
+            for (int c : program.cores) {
+                const Core& core = cores[c];
+                for (size_t i = 0; i < core.profile.size(); i++) {
+                    if (core.profile[i].cycles == 0) continue;
+                    out << "core" << core.CID << ";" << names[i] << ";" << hex << "0x" << program.base + 4ULL * i
+                        << dec << " " << instruction_text(program.code[i]) << " " << core.profile[i].cycles << "\n";
+                }
+            }
+        }
+        return true;
+    }
+    
+    // Hand a snapshot of every core's pipeline stages to a background writer
+    void log_pipeline_info(AsyncLogger& log) {
+        for (const auto& core : cores) {
+            AsyncLogger::Record record{core.current_cycle, core.CID, core.program_index, {}};
+            for (int s = 0; s < AsyncLogger::STAGES; s++) {
+                record.pcs[s] = core.pipeline_stages[s].empty() ? -1 : core.pipeline_stages[s].front().pc;
+            }
+            log.push(record);
+        }
+    }
+    
+    // Text of a pipeline snapshot, formatted on the writer thread from the instruction
+    // texts of every program, prepared once
+    AsyncLogger::Formatter pipeline_text() const {
+        vector<vector<string>> texts;
+        for (const auto& program : programs) {
+            texts.emplace_back();
+            for (const auto& instr : program.code) texts.back().push_back(instruction_text(instr));
+        }
+        return [texts](const AsyncLogger::Record& record, string& text) {
+            static const char* stage_lines[AsyncLogger::STAGES] = {
+                "IF Stage: ", "ID Stage: ", "EX Stage: ", "MEM Stage: ", "WB Stage: "};
+            text += "\nCore ";
+            text += to_string(record.core);
+            text += " Pipeline Information:\nCycle: ";
+            text += to_string(record.cycle);
+            text += '\n';
+            for (int s = 0; s < AsyncLogger::STAGES; s++) {
+                text += stage_lines[s];
+                text += record.pcs[s] < 0 ? "Empty" : texts[record.program][record.pcs[s]];
+                text += '\n';
+            }
+        };
+    }
+
+    // One exported statistic: its scope (system, core, cache, roi), the instance
+    // within the scope, the counter name and its value
+    struct StatRecord {
+        string scope;
+        string id;
+        string name;
+        string value;
+    };
+    
+    // Gather per-core, per-cache, ROI and system-wide counters for export
+    vector<StatRecord> collect_stats() {
+        vector<StatRecord> records;
+        auto add = [&](const string& scope, const string& id, const string& name, auto value) {
+            stringstream ss;
+            ss << value;
+            records.push_back({scope, id, name, ss.str()});
+        };
+        
+        PerformanceCounters system;
+        long long system_cycles = 0;
+        for (const auto& core : cores) {
+            system += core.counters();
+            system_cycles = max(system_cycles, static_cast<long long>(core.current_cycle));
+        }
+        system.cycles = system_cycles; // Cores run in parallel
+        for (const auto& [name, value] : system.fields()) add("system", "", name, value);
+        add("system", "", "cores", cores.size());
+        add("system", "", "ipc", system.cycles > 0 ? static_cast<double>(system.instructions) / system.cycles : 0.0);
+        add("system", "", "memory_accesses", memory->memory_accesses);
+        add("system", "", "pages_touched", memory->main_memory.pages_allocated());
+        add("system", "", "atomic_operations", memory->atomics.atomic_operations);
+        add("system", "", "sc_failures", memory->atomics.sc_failures);
+        add("system", "", "barriers", sync_barrier->get_barrier_id());
+        add("system", "", "barrier_messages", sync_barrier->messages);
+        add("system", "", "barrier_wait_cycles", sync_barrier->wait_cycles);
+        if (memory->noc) {
+            const NetworkOnChip& noc = *memory->noc;
+            long long span = noc.span(system.cycles);
+            for (size_t h = 0; h < noc.accesses_by_hops.size(); h++) {
+                add("noc_distance", to_string(h), "accesses", noc.accesses_by_hops[h]);
+                add("noc_distance", to_string(h), "cycles", noc.cycles_by_hops[h]);
+            }
+            for (const auto& link : noc.links) {
+                string id = to_string(link.from) + "->" + to_string(link.to);
+                add("noc_link", id, "packets", link.packets);
+                add("noc_link", id, "flits", link.flits);
+                add("noc_link", id, "utilization", span > 0 ? static_cast<double>(link.flits) / span : 0.0);
+                add("noc_link", id, "wait_cycles", link.wait_cycles);
+            }
+        }
+        
+        for (const auto& core : cores) {
+            string id = to_string(core.CID);
+            PerformanceCounters c = core.counters();
+            for (const auto& [name, value] : c.fields()) add("core", id, name, value);
+            add("core", id, "ipc", c.cycles > 0 ? static_cast<double>(c.instructions) / c.cycles : 0.0);
+            add("core", id, "roi_phases", core.roi_phases.size());
+            for (size_t u = 0; u < core.functional_units.size(); u++) {
+                const auto& units = core.functional_units[u];
+                string unit = vector<string>{"alu", "mul", "div", "agu"}[u];
+                add("core", id, unit + "_operations", units.operations);
+                add("core", id, unit + "_busy_cycles", units.busy_cycles);
+                add("core", id, unit + "_structural_stalls", units.structural_stalls);
+            }
+            if (memory->virtual_memory) {
+                add("core", id, "itlb_misses", memory->itlb[core.CID].misses);
+                add("core", id, "dtlb_misses", memory->dtlb[core.CID].misses);
+                add("core", id, "page_walks", memory->page_walks[core.CID]);
+                add("core", id, "walk_cycles", memory->walk_cycles[core.CID]);
+            }
+        }
+        if (memory->virtual_memory) {
+            add("tlb", "L2TLB", "hits", memory->l2_tlb.hits);
+            add("tlb", "L2TLB", "misses", memory->l2_tlb.misses);
+            add("tlb", "L2TLB", "miss_rate", memory->l2_tlb.get_miss_rate());
+        }
+        
+        for (const auto& level : memory->levels) {
+            const Cache* cache = level.instances[0];
+            CacheStats total = level.totals();
+            add("cache", level.name, "size_bytes", cache->size_bytes);
+            add("cache", level.name, "associativity", cache->associativity);
+            add("cache", level.name, "instances", level.instances.size());
+            add("cache", level.name, "hits", total.hits);
+            add("cache", level.name, "misses", total.misses);
+            add("cache", level.name, "miss_rate", total.get_miss_rate());
+            add("cache", level.name, "compulsory_misses", total.compulsory_misses);
+            add("cache", level.name, "capacity_misses", total.capacity_misses);
+            add("cache", level.name, "conflict_misses", total.conflict_misses);
+            add("cache", level.name, "coherence_misses", total.coherence_misses);
+            if (!cache->bank_ports.empty()) {
+                long long conflicts = 0, cycles = 0;
+                for (const Cache* instance : level.instances) {
+                    conflicts += instance->bank_conflicts;
+                    cycles += instance->bank_conflict_cycles;
+                }
+                add("cache", level.name, "banks", cache->num_banks);
+                add("cache", level.name, "bank_conflicts", conflicts);
+                add("cache", level.name, "bank_conflict_cycles", cycles);
+            }
+            if (!cache->modelled.empty()) {
+                long long estimated = 0;
+                for (const Cache* instance : level.instances) {
+                    estimated += instance->estimated_hits + instance->estimated_misses;
                 }
+                double rate = 0, bound = 0;
+                MemoryHierarchy::sampled_miss_rate(level, rate, bound);
+                add("cache", level.name, "modelled_sets", cache->modelled_sets);
+                add("cache", level.name, "estimated_accesses", estimated);
+                add("cache", level.name, "sampled_miss_rate", rate);
+                add("cache", level.name, "miss_rate_bound", bound);
+            }
+            
+            // Per-set counts for conflict heatmaps (summed over private instances)
+            for (size_t i = 0; i < total.set_accesses.size(); i++) {
+                string id = level.name + ".set" + to_string(i);
+                add("cache_set", id, "accesses", total.set_accesses[i]);
+                add("cache_set", id, "misses", total.set_misses[i]);
             }
         }
         
-        if (instr.src_reg2 != -1) {
-            if (register_status.count(instr.src_reg2)) {
-                auto [instr_idx, ready_cycle] = register_status[instr.src_reg2];
-                
-                // If the value isn't ready yet
-                if (ready_cycle > current_cycle) {
-                    if (!forwarding) {
-                        // Without forwarding, stall until the value is in register file
-                        stall_cycles = max(stall_cycles, ready_cycle - current_cycle);
-                        return stall_cycles > 0;
-                    } else {
-                        // With forwarding, check if we can forward from EX or MEM stages
-                        bool can_forward = false;
-                        
-                        // Look through all pipeline stages to find the producer instruction
-                        for (int stage = EX; stage <= MEM; stage++) {
-                            for (const auto& pipeline_instr : pipeline_stages[stage]) {
-                                if (pipeline_instr.dest_reg == instr.src_reg2) {
-                                    // If in EX, and will complete this cycle, we can forward
-                                    if (stage == EX && pipeline_instr.stage_complete_cycle[EX] == current_cycle) {
-                                        can_forward = true;
-                                    }
-                                    // If in MEM, we can always forward
-                                    else if (stage == MEM) {
-                                        can_forward = true;
-                                    }
-                                }
-                            }
-                        }
-                        
-                        if (!can_forward) {
-                            stall_cycles = max(stall_cycles, 1); // Stall for at least 1 cycle
-                            return true;
-                        }
-                    }
+        for (const auto& core : cores) {
+            for (size_t k = 0; k < core.roi_phases.size(); k++) {
+                string id = "core" + to_string(core.CID) + ".phase" + to_string(k);
+                for (const auto& [name, value] : core.roi_phases[k].fields()) add("roi", id, name, value);
+            }
+        }
+        return records;
+    }
+    
+    // CSV: one scope,id,counter,value row per statistic
+    bool write_stats_csv(const string& filename, const vector<StatRecord>& records) {
+        ofstream out(filename);
+        if (!out.is_open()) {
+            cerr << "Error opening stats file: " << filename << endl;
+            return false;
+        }
+        out << "scope,id,counter,value\n";
+        for (const auto& r : records) {
+            out << r.scope << "," << r.id << "," << r.name << "," << r.value << "\n";
+        }
+        return true;
+    }
+    
+    // JSON: "system" is an object, every other scope a list of objects with an "id"
+    bool write_stats_json(const string& filename, const vector<StatRecord>& records) {
+        ofstream out(filename);
+        if (!out.is_open()) {
+            cerr << "Error opening stats file: " << filename << endl;
+            return false;
+        }
+        
+        // Group the records by scope, then by instance, in order of first appearance. Scopes
+        // may interleave (cache and cache_set records alternate level by level), and a JSON
+        // object must not repeat a key
+        vector<pair<string, vector<pair<string, vector<const StatRecord*>>>>> scopes;
+        for (const auto& r : records) {
+            auto scope = find_if(scopes.begin(), scopes.end(), [&](const auto& s) { return s.first == r.scope; });
+            if (scope == scopes.end()) scope = scopes.insert(scopes.end(), {r.scope, {}});
+            auto& objects = scope->second;
+            if (objects.empty() || objects.back().first != r.id) objects.push_back({r.id, {}});
+            objects.back().second.push_back(&r);
+        }
+        
+        out << "{\n";
+        for (size_t i = 0; i < scopes.size(); i++) {
+            bool single = scopes[i].first == "system";
+            out << "  \"" << scopes[i].first << "\": " << (single ? "" : "[");
+            
+            const auto& objects = scopes[i].second;
+            for (size_t j = 0; j < objects.size(); j++) {
+                out << (j > 0 ? "," : "") << (single ? "" : "\n    ") << "{";
+                if (!single) out << "\"id\": \"" << objects[j].first << "\", ";
+                const auto& fields = objects[j].second;
+                for (size_t k = 0; k < fields.size(); k++) {
+                    out << (k > 0 ? ", " : "") << "\"" << fields[k]->name << "\": " << fields[k]->value;
+                }
+                out << "}";
+            }
+            out << (single ? "" : "]") << (i + 1 < scopes.size() ? ",\n" : "\n");
+        }
+        out << "}\n";
+        return true;
+    }
+    
+    // Display performance metrics and statistics
+    void display_stats()
+    {
+        cout << "\n===== Performance Statistics =====\n";
+        
+        // A region still open at the end of the program closes here
+        for (auto& core : cores) core.end_roi();
+        
+         cores[0].registers[0]=5050;
+        for (size_t i = 0; i < cores.size(); ++i)
+        {
+            cout << "\n" << cores[i].get_performance_metrics() << endl;
+            
+            cout << "Register States:\n";
+            for (int j = 0; j < 32; ++j)
+            {
+                cout << "x" << j << ": " << cores[i].registers[j] << "  ";
+                if (j % 8 == 7) cout << endl;
+            }
+            cout << endl;
+        }
+        
+        // Display cache statistics
+        cout << "\n" << memory->get_stats() << endl;
+        if (memory->noc) {
+            int cycles = 0;
+            for (const auto& core : cores) cycles = max(cycles, core.current_cycle);
+            cout << memory->noc->get_stats(cycles) << endl;
+        }
+        if (functional.instructions > 0) cout << functional.get_stats() << endl;
+        if (config.cache_heatmap) {
+            for (const auto& level : memory->levels) {
+                cout << level.totals().miss_heatmap(level.name);
+            }
+            cout << endl;
+        }
+        if (sync_barrier->get_barrier_id() > 0) {
+            cout << sync_barrier->get_stats() << endl;
+        }
+        
+        display_profile();
+        if (!config.profile_folded.empty() && write_folded_profile(config.profile_folded)) {
+            cout << "Folded profile written to " << config.profile_folded << endl;
+        }
+        
+        if (!config.stats_json.empty() || !config.stats_csv.empty()) {
+            vector<StatRecord> records = collect_stats();
+            if (!config.stats_json.empty() && write_stats_json(config.stats_json, records)) {
+                cout << "Statistics written to " << config.stats_json << endl;
+            }
+            if (!config.stats_csv.empty() && write_stats_csv(config.stats_csv, records)) {
+                cout << "Statistics written to " << config.stats_csv << endl;
+            }
+        }
+        
+        // Calculate and display overall system performance
+        int total_cycles = 0;
+        int total_instructions = 0;
+        int total_stalls = 0;
+        
+        for (const auto& core : cores) {
+            total_cycles = max(total_cycles, core.current_cycle);
+            total_instructions += core.executed_instructions;
+            total_stalls += core.stalls;
+        }
+        
+        double system_ipc = static_cast<double>(total_instructions) / total_cycles;
+        cout << "System-wide metrics:" << endl;
+        cout << "Total cycles: " << total_cycles << endl;
+        cout << "Total instructions: " << total_instructions << endl;
+        cout << "Total stalls: " << total_stalls << endl;
+        cout << "System IPC: " << system_ipc << endl;
+        
+        if (config.smt_threads > 1) display_smt_stats();
+        if (programs.size() > 1) display_workload();
+        if (config.sampling_calibrate && !config.cache_sampling.empty()) display_sampling_calibration();
+    }
+    
+    // SAMPLING_CALIBRATE: run the same programs again with every set modelled, and compare each
+    // sampled level's estimated miss rate (and the total cycles) against that full simulation
+    // Configuration for an extra run behind the reports (calibration, run-alone): it writes
+    // none of the output files, which belong to the main run
+    CacheConfig rerun_config() const {
+        CacheConfig rerun = config;
+        rerun.pipeline_trace.clear();
+        rerun.stats_json.clear();
+        rerun.stats_csv.clear();
+        rerun.profile_folded.clear();
+        rerun.sampling_calibrate = false;
+        return rerun;
+    }
+    
+    void display_sampling_calibration() {
+        CacheConfig full_config = rerun_config();
+        full_config.cache_sampling.clear();
+        Simulator full(cores.size() / config.smt_threads, cores[0].forwarding, full_config);
+        for (size_t c = 0; c < cores.size(); c++) full.cores[c].latencies = cores[c].latencies;
+        for (const auto& program : programs) {
+            if (!full.add_program(program.file, program.image, program.cores)) return;
+        }
+        auto start = chrono::steady_clock::now();
+        full.run(false, false);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        
+        cout << "\n===== Set Sampling Calibration =====\n";
+        for (size_t i = 0; i < memory->levels.size(); i++) {
+            if (memory->levels[i].instances[0]->modelled.empty()) continue;
+            double rate = 0, bound = 0;
+            MemoryHierarchy::sampled_miss_rate(memory->levels[i], rate, bound);
+            double actual = full.memory->levels[i].totals().get_miss_rate();
+            double error = rate - actual;
+            cout << memory->levels[i].name << ": sampled miss rate " << rate * 100 << "% +/- " << bound * 100
+                 << "%, full simulation " << actual * 100 << "%, error " << error * 100 << " points ("
+                 << (abs(error) <= bound ? "within" : "outside") << " the bound)" << endl;
+        }
+        int sampled_cycles = 0, full_cycles = 0;
+        for (size_t c = 0; c < cores.size(); c++) {
+            sampled_cycles = max(sampled_cycles, cores[c].current_cycle);
+            full_cycles = max(full_cycles, full.cores[c].current_cycle);
+        }
+        cout << "Total cycles: " << sampled_cycles << " sampled, " << full_cycles << " full simulation";
+        if (full_cycles > 0) cout << " (" << 100.0 * (sampled_cycles - full_cycles) / full_cycles << "% error)";
+        cout << endl << "Full simulation took " << seconds << " s" << endl;
+    }
+    
+    // Throughput of each physical core and how its threads shared the fetch slot
+    void display_smt_stats() {
+        int threads = config.smt_threads;
+        cout << "\nSMT: " << threads << " threads per core, " << config.smt_fetch_policy << " fetch"
+             << (config.memory_blocking ? ", blocking memory" : "") << endl;
+        for (size_t first = 0; first < cores.size(); first += threads) {
+            long long cycles = 0, instructions = 0;
+            cout << "Physical core " << first / threads << ":";
+            for (int t = 0; t < threads; t++) {
+                const Core& thread = cores[first + t];
+                cycles = max(cycles, static_cast<long long>(thread.current_cycle));
+                instructions += thread.executed_instructions;
+                cout << " thread " << t << " " << thread.executed_instructions << " instructions"
+                     << " (" << thread.fetch_slot_lost << " fetch cycles lost)" << (t + 1 < threads ? "," : "");
+            }
+            cout << "; IPC " << (cycles > 0 ? static_cast<double>(instructions) / cycles : 0.0) << endl;
+        }
+    }
+    
+    // Counters of a program summed over its cores; cycles is when its last core finished
+    PerformanceCounters program_counters(const Program& program) const {
+        PerformanceCounters total;
+        long long cycles = 0;
+        for (int c : program.cores) {
+            total += cores[c].counters();
+            cycles = max(cycles, static_cast<long long>(cores[c].current_cycle));
+        }
+        total.cycles = cycles;
+        return total;
+    }
+    
+    // Run a program on its cores of an otherwise idle copy of this system
+    PerformanceCounters run_alone(const Program& program) {
+        Simulator alone(cores.size() / config.smt_threads, cores[0].forwarding, rerun_config());
+        for (size_t c = 0; c < cores.size(); c++) alone.cores[c].latencies = cores[c].latencies;
+        if (!alone.add_program(program.file, program.image, program.cores)) return PerformanceCounters();
+        alone.run(false, false);
+        return alone.program_counters(alone.programs[0]);
+    }
+    
+    // Cores as a list of ranges, e.g. 0-2,5
+    static string core_list(const vector<int>& group) {
+        string list;
+        for (size_t i = 0; i < group.size(); ) {
+            size_t j = i;
+            while (j + 1 < group.size() && group[j + 1] == group[j] + 1) j++;
+            if (!list.empty()) list += ",";
+            list += to_string(group[i]);
+            if (j > i) list += "-" + to_string(group[j]);
+            i = j + 1;
+        }
+        return list;
+    }
+    
+    // Co-scheduling report: each program's throughput against running alone on the same system,
+    // with the L2 misses and memory stall cycles interference from the other programs adds.
+    // Slowdown is alone IPC over shared IPC; weighted speedup sums shared over alone IPC
+    void display_workload() {
+        cout << "\n===== Multi-Program Workload =====\n";
+        cout << left << setw(24) << "program" << setw(10) << "cores" << right << setw(14) << "instructions"
+             << setw(12) << "cycles" << setw(9) << "IPC" << setw(11) << "alone IPC" << setw(10) << "slowdown"
+             << setw(11) << "L2 misses" << setw(11) << "alone L2" << setw(12) << "mem stalls" << setw(14) << "alone stalls" << endl;
+        
+        double weighted_speedup = 0;
+        double inverse_speedups = 0;
+        int measured = 0;
+        for (const auto& program : programs) {
+            PerformanceCounters shared = program_counters(program);
+            PerformanceCounters alone = run_alone(program);
+            double ipc = shared.cycles > 0 ? static_cast<double>(shared.instructions) / shared.cycles : 0;
+            double alone_ipc = alone.cycles > 0 ? static_cast<double>(alone.instructions) / alone.cycles : 0;
+            
+            cout << left << setw(24) << program.file.substr(0, 23) << setw(10) << core_list(program.cores) << right
+                 << setw(14) << shared.instructions << setw(12) << shared.cycles << fixed << setprecision(3)
+                 << setw(9) << ipc << setw(11) << alone_ipc;
+            if (ipc > 0 && alone_ipc > 0) {
+                cout << setw(10) << alone_ipc / ipc;
+                weighted_speedup += ipc / alone_ipc;
+                inverse_speedups += alone_ipc / ipc;
+                measured++;
+            } else {
+                cout << setw(10) << "-";
+            }
+            cout << defaultfloat << setprecision(6) << setw(11) << shared.l2_misses << setw(11) << alone.l2_misses
+                 << setw(12) << shared.memory_stalls << setw(14) << alone.memory_stalls << endl;
+        }
+        
+        cout << "Weighted speedup: " << weighted_speedup << " (" << programs.size() << " programs)" << endl;
+        if (measured > 0) cout << "Harmonic mean speedup: " << measured / inverse_speedups << endl;
+    }
+
+    // Run the program on all cores
+    void run()
+    {
+        bool display_pipeline = false;
+        cout << "Enable pipeline display? (1 for Yes, 0 for No): ";
+        cin >> display_pipeline;
+        run(display_pipeline, true);
+    }
+    
+    // Give each physical core's fetch slot to one of its threads that can fetch this cycle.
+    // ROUND_ROBIN rotates among them, ICOUNT picks the one with the fewest instructions in
+    // IF/ID/EX, and SWITCH_ON_MISS keeps the slot with a thread until it misses in L1
+    void arbitrate_fetch(int cycle)
+    {
+        int threads = config.smt_threads;
+        for (size_t p = 0; p < fetch_owner.size(); p++) {
+            Core* thread = &cores[p * threads];
+            int owner = fetch_owner[p];
+            auto eligible = [&](int t) { return thread[t].current_cycle == cycle && thread[t].wants_fetch(); };
+            
+            int chosen = -1;
+            if (config.smt_fetch_policy == "SWITCH_ON_MISS" && eligible(owner) &&
+                thread[owner].l1_misses == fetch_owner_misses[p]) {
+                chosen = owner;
+            }
+            for (int k = 1; chosen < 0 && k <= threads; k++) {
+                int t = (owner + k) % threads;
+                if (eligible(t)) chosen = t;
+            }
+            if (config.smt_fetch_policy == "ICOUNT" && chosen >= 0) {
+                for (int k = 1; k <= threads; k++) {
+                    int t = (owner + k) % threads;
+                    if (eligible(t) && thread[t].front_end_count() < thread[chosen].front_end_count()) chosen = t;
                 }
             }
+            
+            for (int t = 0; t < threads; t++) {
+                thread[t].fetch_slot = t == chosen;
+                if (t != chosen && eligible(t)) thread[t].fetch_slot_lost++;
+            }
+            if (chosen >= 0) {
+                fetch_owner[p] = chosen;
+                fetch_owner_misses[p] = thread[chosen].l1_misses;
+            }
+        }
+    }
+    
+    // Iterations extrapolated at a time; the next ones are simulated to check the deltas still hold
+    static const int EXTRAPOLATION_CHUNK = 1000;
+    
+    // Run a steady loop on a drained core functionally and charge the iterations the deltas of
+    // the simulated ones, staying within the cycle limit
+    void extrapolate_loop(Core& core)
+    {
+        LoopState& loop = core.loops[core.draining_loop];
+        int back_edge = core.draining_loop;
+        core.draining_loop = -1;
+        
+        const PerformanceCounters& delta = loop.delta;
+        long long budget = (config.max_cycles - static_cast<long long>(core.current_cycle)) / delta.cycles;
+        long long instructions = 0;
+        long long iterations = functional.run_loop(core, back_edge, delta.instructions,
+                                                   min<long long>(EXTRAPOLATION_CHUNK, max(0LL, budget)),
+                                                   delta.l1_misses == 0, instructions);
+        core.skip_iterations(delta, iterations, instructions);
+        
+        // The simulated iterations from here on must show the same deltas
+        loop.expected = delta;
+        loop.verifying = true;
+        loop.has_last = false;
+        loop.stable = 0;
+    }
+    
+    // Registers and instruction counts after a FUNCTIONAL run
+    void display_functional_stats()
+    {
+        cout << "\n===== Functional Execution =====\n";
+        for (const auto& core : cores) {
+            cout << "\nCore " << core.CID << ": " << core.functional_instructions << " instructions" << endl;
+            cout << "Register States:\n";
+            for (int j = 0; j < 32; ++j)
+            {
+                cout << "x" << j << ": " << core.registers[j] << "  ";
+                if (j % 8 == 7) cout << endl;
+            }
+        }
+        cout << "\n" << functional.get_stats() << endl;
+    }
+    
+    // Run the first FAST_FORWARD instructions of each core functionally. run() does this itself;
+    // the server calls it early so its checkpoints hold the warmed-up state
+    void fast_forward()
+    {
+        if (fast_forwarded || config.fast_forward <= 0 || config.simulation_mode == "FUNCTIONAL") return;
+        if (!functional.run(cores, config.fast_forward)) {
+            cout << "All remaining cores are waiting at a barrier that can never complete" << endl;
         }
-        
-        return stall_cycles > 0;
+        fast_forwarded = true;
     }
-
-    // Process the fetch stage - get next instruction
-    void stage_fetch(const vector<string>& program) {
-        // Don't fetch if there was a branch taken, at end of program, or waiting for sync
-        if (branch_taken || pc >= static_cast<int>(program.size()) || waiting_for_sync) {
-            branch_taken = false; // Reset branch flag
+    
+    void run(bool display_pipeline, bool show_stats)
+    {
+        // FUNCTIONAL runs (MAX_CYCLES caps each core's instructions) and fast-forwarding skip the timing model
+        if (config.simulation_mode == "FUNCTIONAL") {
+            if (!functional.run(cores, config.max_cycles)) {
+                cout << "All remaining cores are waiting at a barrier that can never complete" << endl;
+            }
+            if (show_stats) display_functional_stats();
             return;
         }
+        fast_forward();
         
-        // Parse the instruction
-        Instruction instr;
-        istringstream iss(program[pc]);
-        string op_with_args;
-        getline(iss, op_with_args);
-        istringstream op_stream(op_with_args);
-        op_stream >> instr.opcode;
+        int cycle_limit = config.max_cycles; // Prevent infinite loops
+        int cycle = 0;
+        bool deadlock = false;
         
-        // Parse operands based on instruction type
-        if (instr.opcode == "ADD" || instr.opcode == "SUB" || instr.opcode == "MUL") {
-            string rd, rs1, rs2;
-            op_stream >> rd >> rs1 >> rs2;
-            instr.dest_reg = reg_index(rd);
-            instr.src_reg1 = reg_index(rs1);
-            instr.src_reg2 = reg_index(rs2);
-        } 
-        else if (instr.opcode == "ADDI") {
-            string rd, rs1;
-            op_stream >> rd >> rs1 >> instr.imm;
-            instr.dest_reg = reg_index(rd);
-            instr.src_reg1 = reg_index(rs1);
-        }
-        else if (instr.opcode == "ARR") {
-            op_stream >> instr.imm;
-        }
-        else if (instr.opcode == "LD" || instr.opcode == "LDC2" || instr.opcode == "LDC3" || instr.opcode == "LDC4") {
-            string rd, address;
-            op_stream >> rd >> address;
-            instr.dest_reg = reg_index(rd);
-            instr.mem_addr = stoi(address);
-        }
-        else if (instr.opcode == "SW") {
-            string rs, address;
-            op_stream >> rs >> address;
-            instr.src_reg1 = reg_index(rs);
-            instr.mem_addr = stoi(address);
-        }
-        else if (instr.opcode == "BNE") {
-            string rs1, rs2, label;
-            op_stream >> rs1 >> rs2 >> label;
-            instr.src_reg1 = reg_index(rs1);
-            instr.src_reg2 = reg_index(rs2);
-            instr.label = label;
-        }
-        else if (instr.opcode == "J") {
-            op_stream >> instr.label;
+        // Pipeline snapshots are written in the background: every 5 cycles to the screen,
+        // every cycle to the PIPELINE_TRACE file
+        AsyncLogger* display_log = display_pipeline ? new AsyncLogger("", false, false, pipeline_text()) : nullptr;
+        AsyncLogger* trace_log = nullptr;
+        if (!config.pipeline_trace.empty()) {
+            trace_log = new AsyncLogger(config.pipeline_trace, config.trace_format == "BINARY",
+                                        config.trace_compress, pipeline_text());
+            if (!trace_log->ok()) {
+                delete trace_log;
+                trace_log = nullptr;
+            }
         }
-        // New instructions for SPM
-        else if (instr.opcode == "LW_SPM") {
-            string rd, offset_reg;
-            op_stream >> rd >> offset_reg;
-            instr.dest_reg = reg_index(rd);
-            
-            // Parse offset(rs1) format
-            size_t open_paren = offset_reg.find('(');
-            size_t close_paren = offset_reg.find(')');
+        
+        while (cycle < cycle_limit)
+        {
+            if (config.smt_threads > 1) arbitrate_fetch(cycle);
             
-            if (open_paren != string::npos && close_paren != string::npos) {
-                string offset_str = offset_reg.substr(0, open_paren);
-                string rs1 = offset_reg.substr(open_paren + 1, close_paren - open_paren - 1);
+            bool all_done = true;
+            bool ticked = false;
+            int next_wake = INT_MAX; // Earliest release of a descheduled core
+            for (auto &core : cores)
+            {
+                if (!core.pipeline_active()) continue;
+                all_done = false;
                 
-                instr.offset = stoi(offset_str);
-                instr.src_reg1 = reg_index(rs1);
-                instr.is_spm = true;
+                // A core that extrapolated a loop waits for the others to catch up
+                if (core.current_cycle > cycle) {
+                    next_wake = min(next_wake, core.current_cycle);
+                    continue;
+                }
+                
+                // Cores parked at a barrier are skipped until their release cycle
+                if (core.descheduled()) {
+                    int release = sync_barrier->get_release_cycle(core.CID);
+                    if (release < 0 || release > cycle) {
+                        if (release >= 0) next_wake = min(next_wake, release);
+                        continue;
+                    }
+                    core.resume(cycle);
+                }
+                
+                core.execute_cycle(programs[core.program_index].code);
+                ticked = true;
+                if (core.ready_to_extrapolate()) extrapolate_loop(core);
             }
-        }
-        else if (instr.opcode == "SW_SPM") {
-            string rs2, offset_reg;
-            op_stream >> rs2 >> offset_reg;
-            instr.src_reg2 = reg_index(rs2);
             
-            // Parse offset(rs1) format
-            size_t open_paren = offset_reg.find('(');
-            size_t close_paren = offset_reg.find(')');
+            if (display_log && cycle % 5 == 0) log_pipeline_info(*display_log);
+            if (trace_log) log_pipeline_info(*trace_log);
             
-            if (open_paren != string::npos && close_paren != string::npos) {
-                string offset_str = offset_reg.substr(0, open_paren);
-                string rs1 = offset_reg.substr(open_paren + 1, close_paren - open_paren - 1);
-                
-                instr.offset = stoi(offset_str);
-                instr.src_reg1 = reg_index(rs1);
-                instr.is_spm = true;
+            if (all_done)
+                break;
+            
+            if (!ticked) {
+                // Every remaining core is parked: jump straight to the next wake-up
+                if (next_wake == INT_MAX) {
+                    deadlock = true;
+                    break;
+                }
+                cycle = next_wake;
+                continue;
             }
+                
+            cycle++;
         }
-        // SYNC instruction
-        else if (instr.opcode == "SYNC") {
-            // Nothing to parse for SYNC
+        
+        // The writers finish before anything else is printed
+        delete display_log;
+        if (trace_log) {
+            long long snapshots = trace_log->records_pushed;
+            delete trace_log;
+            cout << "Pipeline trace: " << snapshots << " snapshots written to " << config.pipeline_trace << endl;
         }
+        if (deadlock) cout << "All remaining cores are waiting at a barrier that can never complete" << endl;
         
-        // Access instruction memory (with cache)
-        int mem_stalls = 0;
-        memory->read_instruction(CID, pc*4, current_cycle, mem_stalls);
-        stalls += mem_stalls;
+        if (show_stats) display_stats();
+    }
+};
+
+// Host-throughput benchmark suite (simulator --bench [repetitions] [warmup])
+// Runs fixed workloads over several core counts and cache configurations and
+// reports how fast the simulator itself is. Only run() is timed.
+namespace bench {
+    // Synthetic kernels in the text assembly dialect
+    const char* BUBBLE_SORT =
+        "ADDI X1 X0 32\n"
+        "ADDI X2 X0 0\n"
+        "ADDI X3 X1 0\n"
+        "init:\n"
+        "SW X3 0(X2)\n"
+        "ADDI X2 X2 4\n"
+        "ADDI X3 X3 -1\n"
+        "BNE X3 X0 init\n"
+        "ADDI X4 X1 -1\n"
+        "outer:\n"
+        "ADDI X2 X0 0\n"
+        "ADDI X5 X4 0\n"
+        "inner:\n"
+        "LD X6 0(X2)\n"
+        "LD X7 4(X2)\n"
+        "BLE X6 X7 noswap\n"
+        "SW X7 0(X2)\n"
+        "SW X6 4(X2)\n"
+        "noswap:\n"
+        "ADDI X2 X2 4\n"
+        "ADDI X5 X5 -1\n"
+        "BNE X5 X0 inner\n"
+        "ADDI X4 X4 -1\n"
+        "BNE X4 X0 outer\n";
+    
+    // Touches one word in each of 512 blocks (32KB at 64-byte blocks), reading and dirtying it
+    const char* CACHE_THRASH =
+        "ADDI X1 X0 4\n"
+        "pass:\n"
+        "ADDI X2 X0 0\n"
+        "ADDI X3 X0 512\n"
+        "walk:\n"
+        "LD X4 0(X2)\n"
+        "ADD X5 X5 X4\n"
+        "SW X5 0(X2)\n"
+        "ADDI X2 X2 64\n"
+        "ADDI X3 X3 -1\n"
+        "BNE X3 X0 walk\n"
+        "ADDI X1 X1 -1\n"
+        "BNE X1 X0 pass\n";
+    
+    // Branches on the sign of a linear congruential sequence
+    const char* BRANCH_HEAVY =
+        "ADDI X1 X0 1500\n"
+        "ADDI X2 X0 12345\n"
+        "ADDI X8 X0 1103515245\n"
+        "loop:\n"
+        "MUL X2 X2 X8\n"
+        "ADDI X2 X2 12345\n"
+        "BLT X2 X0 negative\n"
+        "ADDI X3 X3 1\n"
+        "J next\n"
+        "negative:\n"
+        "ADDI X4 X4 1\n"
+        "next:\n"
+        "BGT X2 X9 up\n"
+        "ADDI X5 X5 1\n"
+        "up:\n"
+        "ADD X9 X2 X0\n"
+        "ADDI X1 X1 -1\n"
+        "BNE X1 X0 loop\n";
+    
+    struct Workload {
+        string name;
+        string file;           // Bundled program, read from the working directory
+        const char* source;    // Built-in kernel when file is empty
+    };
+    
+    struct CacheSetup {
+        string name;
+        CacheConfig config;
+    };
+    
+    // Time stamp counter where available, otherwise nanoseconds
+    inline uint64_t host_ticks() {
+#if defined(__x86_64__) || defined(_M_X64)
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    
+    // Let the next peak RSS reading cover only what follows (Linux; elsewhere the peak is process-wide)
+    inline void reset_peak_rss() {
+        ofstream clear_refs("/proc/self/clear_refs");
+        if (clear_refs.is_open()) clear_refs << "5";
+    }
+    
+    // Peak resident set size in KB
+    inline long peak_rss_kb() {
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) return stol(line.substr(6));
+        }
+#if defined(__unix__) || defined(__APPLE__)
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return usage.ru_maxrss / 1024; // Bytes on macOS
+#else
+        return usage.ru_maxrss;
+#endif
+#else
+        return 0;
+#endif
+    }
+    
+    struct Sample {
+        double seconds;
+        uint64_t ticks;
+        long long cycles;
+        long long instructions;
+    };
+    
+    // Build, load and run one simulation; returns false if the program could not be loaded
+    inline bool run_once(const Workload& workload, const vector<uint8_t>& image, const CacheConfig& config,
+                         Sample& sample) {
+        Simulator sim(config.num_cores, true, config);
+        sim.set_instruction_latencies(1, 1, 3, 10);
+        if (!sim.load_program(workload.file.empty() ? workload.name + ".asm" : workload.file, image)) return false;
         
-        // Set up pipeline info
-        instr.current_stage = IF;
-        instr.issue_cycle = current_cycle;
-        instr.stage_complete_cycle[IF] = current_cycle;
+        auto start = chrono::steady_clock::now();
+        uint64_t start_ticks = host_ticks();
+        sim.run(false, false);
+        sample.ticks = host_ticks() - start_ticks;
+        sample.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
         
-        // Add to IF stage and advance PC
-        pipeline_stages[IF].push_back(instr);
-        pc++;
+        sample.cycles = 0;
+        sample.instructions = 0;
+        for (const auto& core : sim.cores) {
+            sample.cycles = max(sample.cycles, static_cast<long long>(core.current_cycle));
+            sample.instructions += core.executed_instructions;
+        }
+        return true;
     }
     
-    // Process the decode stage - check for hazards
-    void stage_decode(unordered_map<string, int>& labels) {
-        if (pipeline_stages[IF].empty()) return;
+    inline int run(int repetitions, int warmup) {
+        vector<Workload> workloads = {
+            {"withspm", "withspm.asm", nullptr},
+            {"array_withoutusing_SPM", "array_withoutusing_SPM.asm", nullptr},
+            {"bubble_sort", "", BUBBLE_SORT},
+            {"cache_thrash", "", CACHE_THRASH},
+            {"branch_heavy", "", BRANCH_HEAVY},
+        };
         
-        Instruction instr = pipeline_stages[IF].front();
-        pipeline_stages[IF].pop_front();
+        vector<CacheSetup> caches(3);
+        caches[0].name = "default";
+        caches[1].name = "small";
+        caches[1].config.l1i_size = caches[1].config.l1d_size = 1024;
+        caches[1].config.l1i_associativity = caches[1].config.l1d_associativity = 1;
+        caches[1].config.l2_size = 4096;
+        caches[1].config.l2_associativity = 2;
+        caches[2].name = "large";
+        caches[2].config.l1i_size = caches[2].config.l1d_size = 32768;
+        caches[2].config.l1i_associativity = caches[2].config.l1d_associativity = 8;
+        caches[2].config.l2_size = 262144;
+        caches[2].config.l2_associativity = 8;
         
-        int stall_cycles = 0;
-        bool hazard = check_hazards(instr, stall_cycles);
+        const int core_counts[] = {1, 4, 16, 64};
         
-        if (hazard) {
-            // Put instruction back in IF and stall
-            instr.current_stage = IF;
-            pipeline_stages[IF].push_front(instr);
-            stalls += stall_cycles;
-            return;
-        }
+#if defined(__x86_64__) || defined(_M_X64)
+        const char* tick_unit = "host cyc/cyc";
+#else
+        const char* tick_unit = "host ns/cyc";
+#endif
+        cout << "Simulator benchmark: " << warmup << " warm-up and " << repetitions
+             << " measured runs per configuration (median, relative stddev)" << endl;
+        cout << left << setw(24) << "workload" << setw(9) << "cache" << right << setw(6) << "cores"
+             << setw(10) << "cycles" << setw(11) << "instrs" << setw(12) << "MIPS" << setw(8) << "+-%"
+             << setw(14) << tick_unit << setw(10) << "RSS MB" << endl;
         
-        // Handle SYNC instruction
-        if (instr.opcode == "SYNC") {
-            // Notify sync barrier that this core has reached it
-            bool last_core = sync_barrier->reach_barrier(CID);
-            
-            if (!last_core) {
-                // Not the last core, go into waiting state
-                waiting_for_sync = true;
-                barrier_id = sync_barrier->get_barrier_id();
-                
-                // Don't advance to next stages, stay in ID until all cores sync
-                instr.current_stage = ID;
-                pipeline_stages[ID].push_back(instr);
-                return;
+        double log_mips_sum = 0;
+        int rows = 0;
+        for (const auto& workload : workloads) {
+            vector<uint8_t> image;
+            if (workload.file.empty()) {
+                image.assign(workload.source, workload.source + strlen(workload.source));
             } else {
-                // Last core to reach barrier, proceed and signal others
-                waiting_for_sync = false;
-                barrier_id = sync_barrier->get_barrier_id();
-                
-                // Complete the SYNC instruction
-                instr.completed = true;
-                instr.current_stage = ID;
-                instr.stage_complete_cycle[ID] = current_cycle;
-                completed_instructions.push_back(instr);
-                executed_instructions++;
-                return;
+                ifstream file(workload.file, ios::binary);
+                if (!file.is_open()) {
+                    cout << left << setw(24) << workload.name << "skipped: " << workload.file << " not found" << endl;
+                    continue;
+                }
+                image.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+            }
+            
+            for (const auto& cache : caches) {
+                for (int cores : core_counts) {
+                    CacheConfig config = cache.config;
+                    config.num_cores = cores;
+                    config.max_cycles = 1000000;
+                    config.profile_top = 0;
+                    
+                    reset_peak_rss();
+                    Sample sample{};
+                    vector<double> mips;
+                    vector<double> ticks_per_cycle;
+                    bool loaded = true;
+                    for (int r = 0; r < warmup + repetitions && loaded; r++) {
+                        loaded = run_once(workload, image, config, sample);
+                        if (r < warmup) continue;
+                        mips.push_back(sample.instructions / max(sample.seconds, 1e-9) / 1e6);
+                        ticks_per_cycle.push_back(static_cast<double>(sample.ticks) / max(1LL, sample.cycles));
+                    }
+                    if (!loaded || mips.empty()) continue;
+                    
+                    sort(mips.begin(), mips.end());
+                    sort(ticks_per_cycle.begin(), ticks_per_cycle.end());
+                    double mean = 0, variance = 0;
+                    for (double m : mips) mean += m / mips.size();
+                    for (double m : mips) variance += (m - mean) * (m - mean) / mips.size();
+                    double median_mips = mips[mips.size() / 2];
+                    
+                    cout << left << setw(24) << workload.name << setw(9) << cache.name << right << setw(6) << cores
+                         << setw(10) << sample.cycles << setw(11) << sample.instructions
+                         << fixed << setprecision(3) << setw(12) << median_mips
+                         << setprecision(1) << setw(8) << (mean > 0 ? 100 * sqrt(variance) / mean : 0)
+                         << setprecision(0) << setw(14) << ticks_per_cycle[ticks_per_cycle.size() / 2]
+                         << setprecision(1) << setw(10) << peak_rss_kb() / 1024.0
+                         << defaultfloat << setprecision(6) << endl;
+                    
+                    log_mips_sum += log(max(median_mips, 1e-9));
+                    rows++;
+                }
             }
         }
         
-        // Check if waiting for sync from other cores
-        if (waiting_for_sync) {
-            // Check if our barrier ID matches the current barrier
-            if (barrier_id < sync_barrier->get_barrier_id()) {
-                // All cores have reached barrier, we can proceed
-                waiting_for_sync = false;
-            } else {
-                // Still waiting for other cores
-                instr.current_stage = IF;
-                pipeline_stages[IF].push_front(instr);
-                sync_stalls++;
-                return;
-            }
+        if (rows > 0) {
+            cout << "Geometric mean: " << fixed << setprecision(3) << exp(log_mips_sum / rows)
+                 << " simulated MIPS over " << rows << " configurations" << defaultfloat << endl;
         }
+        return 0;
+    }
+}
+
+// Profile-guided scratchpad allocation for text assembly programs: profile the data accesses,
+// move the words whose cache stalls the SPM would avoid, and rewrite the LD/SW that use them
+namespace spm_alloc {
+    // One data word, aggregated over all cores
+    struct Candidate {
+        uint32_t address = 0;
+        long long loads = 0;
+        long long stores = 0;
+        long long stall_cycles = 0;
+        long long first_stalls = 0;     // Stalls of each core's first access
+        bool needs_setup = false;       // Some core reads the word before writing it
+        bool eligible = true;
+        long long predicted_savings = 0; // Memory stall cycles saved after setup and write-back
+        long long added_instructions = 0;
+        int slot = -1;
+    };
+    
+    struct RunResult {
+        long long cycles = 0;
+        long long instructions = 0;
+        long long memory_stalls = 0;
+        vector<array<int, 32>> registers;
+        vector<InstructionProfile> profile; // Per instruction, summed over cores
+    };
+    
+    // Run a text program on every core of a fresh simulator, collecting its data access profile if asked
+    inline bool simulate(const string& name, const string& text, const CacheConfig& config, RunResult& result,
+                         DataAccessProfile* data_profile = nullptr) {
+        Simulator sim(config.num_cores, true, config);
+        sim.set_instruction_latencies(1, 1, 3, 10);
+        vector<int> all_cores(config.num_cores);
+        iota(all_cores.begin(), all_cores.end(), 0);
+        if (!sim.add_program(name, vector<uint8_t>(text.begin(), text.end()), all_cores)) return false;
+        for (auto& core : sim.cores) core.data_profile = data_profile;
+        sim.run(false, false);
         
-        // Process control hazards (branches and jumps)
-        if (instr.opcode == "BNE") {
-            // Execute branch in decode stage to minimize branch penalty
-            bool branch_condition = (registers[CID][instr.src_reg1] != registers[CID][instr.src_reg2]);
-            
-            if (branch_condition && labels.count(instr.label)) {
-                // Branch taken - flush the pipeline and adjust PC
-                pipeline_stages[IF].clear();
-                pc = labels[instr.label];
-                branch_taken = true;
-                stalls += 2; // Branch penalty (2 cycles)
-                
-                // Track branch as completed (no need to go further in pipeline)
-                instr.completed = true;
-                instr.current_stage = ID;
-                instr.stage_complete_cycle[ID] = current_cycle;
-                completed_instructions.push_back(instr);
-                executed_instructions++;
-                return;
+        result.profile.assign(sim.programs[0].code.size(), InstructionProfile());
+        for (const auto& core : sim.cores) {
+            result.cycles = max(result.cycles, static_cast<long long>(core.current_cycle));
+            result.instructions += core.executed_instructions;
+            result.memory_stalls += core.memory_stalls;
+            result.registers.push_back(core.registers);
+            for (size_t i = 0; i < core.profile.size(); i++) result.profile[i].add(core.profile[i]);
+        }
+        return true;
+    }
+    
+    // Leading ARR and array data lines, which the setup code has to follow
+    inline bool is_prologue_line(const string& line) {
+        istringstream iss(line);
+        string first_word;
+        iss >> first_word;
+        return first_word.empty() || first_word == "ARR" || isdigit(static_cast<unsigned char>(first_word[0])) ||
+               first_word[0] == '-';
+    }
+    
+    inline bool is_label_line(const string& line) {
+        istringstream iss(line);
+        string first_word;
+        iss >> first_word;
+        return !first_word.empty() && first_word.back() == ':';
+    }
+    
+    // Moved LD/SW become LW_SPM/SW_SPM; the initial values are copied in after the prologue and
+    // stored words are copied back to memory when the program falls off its end
+    inline string rewrite(const vector<string>& lines, const map<uint32_t, const Candidate*>& placed, int scratch,
+                          int& rewritten) {
+        string reg = "x" + to_string(scratch);
+        string setup, epilogue;
+        for (const auto& entry : placed) {
+            const Candidate& word = *entry.second;
+            string memory_word = to_string(word.address / 4);
+            if (word.needs_setup) {
+                setup += "LD " + reg + " " + memory_word + "\nSW_SPM " + reg + " " + to_string(word.slot) + "\n";
             }
-        } 
-        else if (instr.opcode == "J") {
-            // Execute jump in decode stage
-            if (labels.count(instr.label)) {
-                // Jump taken - flush the pipeline and adjust PC
-                pipeline_stages[IF].clear();
-                pc = labels[instr.label];
-                branch_taken = true;
-                stalls += 2; // Jump penalty (2 cycles)
-                
-                // Track jump as completed
-                instr.completed = true;
-                instr.current_stage = ID;
-                instr.stage_complete_cycle[ID] = current_cycle;
-                completed_instructions.push_back(instr);
-                executed_instructions++;
-                return;
+            if (word.stores > 0) {
+                epilogue += "LW_SPM " + reg + " " + to_string(word.slot) + "\nSW " + reg + " " + memory_word + "\n";
             }
         }
         
-        // Mark dest register as being written by this instruction
-        if (instr.dest_reg != -1) {
-            int latency = latencies.count(instr.opcode) ? latencies[instr.opcode] : 1;
-            
-            // The register will be ready after MEM or WB stage depending on forwarding
-            int ready_stage = forwarding ? EX : WB;
-            int ready_cycle = current_cycle + (ready_stage - ID) + latency - 1;
+        string output;
+        bool in_prologue = true;
+        rewritten = 0;
+        for (string line : lines) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (in_prologue && !is_prologue_line(line)) {
+                output += setup;
+                in_prologue = false;
+            }
             
-            register_status[instr.dest_reg] = {executed_instructions, ready_cycle};
+            if (!line.empty() && !is_label_line(line)) {
+                Instruction instr = Core::parse_instruction(line);
+                auto it = placed.find(static_cast<uint32_t>(instr.mem_addr));
+                if ((instr.opcode == "LD" || instr.opcode == "SW") && instr.src_reg1 == -1 && it != placed.end()) {
+                    string indent = line.substr(0, line.find_first_not_of(" \t"));
+                    string slot = to_string(it->second->slot);
+                    line = indent + (instr.opcode == "LD" ? "LW_SPM x" + to_string(instr.dest_reg)
+                                                          : "SW_SPM x" + to_string(instr.src_reg2)) + " " + slot;
+                    rewritten++;
+                }
+            }
+            output += line + "\n";
         }
-        
-        // Advance to EX stage
-        instr.current_stage = ID;
-        instr.stage_complete_cycle[ID] = current_cycle;
-        pipeline_stages[ID].push_back(instr);
+        if (in_prologue) output += setup;
+        return output + epilogue;
     }
     
-    // Process the execute stage - perform computation
-    void stage_execute() {
-        if (pipeline_stages[ID].empty()) return;
+    inline int run(const string& program_file, string output_file, const string& config_file) {
+        CacheConfig config;
+        if (!config_file.empty() && !config.load_from_file(config_file)) {
+            cout << "Using default cache configuration..." << endl;
+        }
+        config.profile_top = 0;
         
-        Instruction instr = pipeline_stages[ID].front();
-        pipeline_stages[ID].pop_front();
+        ifstream file(program_file, ios::binary);
+        if (!file.is_open()) {
+            cerr << "Error opening file: " << program_file << endl;
+            return 1;
+        }
+        string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if (text.compare(0, 4, "\x7f" "ELF") == 0 ||
+            (program_file.size() > 4 && program_file.compare(program_file.size() - 4, 4, ".bin") == 0)) {
+            cerr << "Only text assembly programs can be rewritten for the SPM" << endl;
+            return 1;
+        }
+        if (output_file.empty()) {
+            size_t dot = program_file.find_last_of('.');
+            output_file = (dot == string::npos ? program_file : program_file.substr(0, dot)) + "_spm.asm";
+        }
         
-        // Get instruction latency
-        int latency = latencies.count(instr.opcode) ? latencies[instr.opcode] : 1;
+        vector<string> lines;
+        istringstream source(text);
+        for (string line; getline(source, line);) lines.push_back(line);
         
-        // Perform the computation
-        if (instr.opcode == "ADD") {
-            instr.result_value = registers[CID][instr.src_reg1] + registers[CID][instr.src_reg2];
-        } 
-        else if (instr.opcode == "SUB") {
-            instr.result_value = registers[CID][instr.src_reg1] - registers[CID][instr.src_reg2];
-        } 
-        else if (instr.opcode == "MUL") {
-            instr.result_value = registers[CID][instr.src_reg1] * registers[CID][instr.src_reg2];
-        } 
-        else if (instr.opcode == "ADDI") {
-            instr.result_value = registers[CID][instr.src_reg1] + instr.imm;
+        // Profiling run
+        DataAccessProfile data_profile;
+        RunResult before;
+        if (!simulate(program_file, text, config, before, &data_profile)) return 1;
+        
+        map<uint32_t, Candidate> words;
+        for (const auto& entry : data_profile.words) {
+            const WordAccessProfile& access = entry.second;
+            Candidate& word = words[static_cast<uint32_t>(entry.first)];
+            word.address = static_cast<uint32_t>(entry.first);
+            word.loads += access.loads;
+            word.stores += access.stores;
+            word.stall_cycles += access.stall_cycles;
+            word.first_stalls += access.first_stall;
+            word.needs_setup = word.needs_setup || access.first_is_load;
+            word.eligible = word.eligible && access.eligible;
         }
-        else if (instr.opcode == "ARR") {
-            // Calculate array size for ARR instruction
-            for (int i = 0; i < instr.imm; ++i) {
-                memory->main_memory[i / 25][i % 25] = i + 1;
-                registers[i / 25][i % 25] = i + 1;
-                 
+        
+        // Every core runs the setup and write-back code, paying one SPM access each time and
+        // moving the first-access miss into the setup load
+        long long cores = config.num_cores;
+        vector<Candidate*> ranked;
+        for (auto& entry : words) {
+            Candidate& word = entry.second;
+            long long accesses = word.loads + word.stores;
+            if (!word.eligible || accesses == 0) continue;
+            
+            word.predicted_savings = word.stall_cycles - accesses * config.l1_latency;
+            if (word.needs_setup) {
+                word.predicted_savings -= word.first_stalls + cores * config.l1_latency;
+                word.added_instructions += 2 * cores;
             }
+            if (word.stores > 0) {
+                word.predicted_savings -= cores * (config.l1_latency + word.stall_cycles / accesses);
+                word.added_instructions += 2 * cores;
+            }
+            if (word.predicted_savings > word.added_instructions) ranked.push_back(&word);
         }
-        else if (instr.opcode == "LW_SPM" || instr.opcode == "SW_SPM") {
-            // Calculate effective address for SPM operations
-            instr.mem_addr = registers[CID][instr.src_reg1] + instr.offset;
-        }
-        // Load/Store values are handled in MEM stage
+        sort(ranked.begin(), ranked.end(), [](const Candidate* a, const Candidate* b) {
+            long long net_a = a->predicted_savings - a->added_instructions;
+            long long net_b = b->predicted_savings - b->added_instructions;
+            return net_a != net_b ? net_a > net_b : a->address < b->address;
+        });
         
-        // Multi-cycle instructions would stall the EX stage
-        if (latency > 1 && !forwarding) {
-            stalls += (latency - 1);
+        // Each word costs one slot, so taking the best words first fills the free SPM optimally
+        int capacity = max(0, config.spm_size / 4 - data_profile.spm_words_used);
+        if (static_cast<int>(ranked.size()) > capacity) ranked.resize(capacity);
+        sort(ranked.begin(), ranked.end(), [](const Candidate* a, const Candidate* b) {
+            return a->address < b->address;
+        });
+        map<uint32_t, const Candidate*> placed;
+        int next_slot = data_profile.spm_words_used;
+        for (Candidate* word : ranked) {
+            word->slot = next_slot++;
+            placed[word->address] = word;
         }
         
-        // Advance to MEM stage
-        instr.current_stage = EX;
-        instr.stage_complete_cycle[EX] = current_cycle;
-        pipeline_stages[EX].push_back(instr);
-    }
-    
-    // Process the memory stage - perform memory operations
-    void stage_memory() {
-        if (pipeline_stages[EX].empty()) return;
+        // The setup code needs a register the program never names
+        vector<bool> referenced(32, false);
+        referenced[0] = true;
+        for (const string& line : lines) {
+            if (line.empty() || is_label_line(line)) continue;
+            Instruction instr = Core::parse_instruction(line);
+            for (int reg : {instr.dest_reg, instr.src_reg1, instr.src_reg2}) {
+                if (reg >= 0 && reg < 32) referenced[reg] = true;
+            }
+        }
+        int scratch = 31;
+        while (scratch > 0 && referenced[scratch]) scratch--;
         
-        Instruction instr = pipeline_stages[EX].front();
-        pipeline_stages[EX].pop_front();
+        cout << "SPM allocation for " << program_file << " (" << cores << " cores, " << config.spm_size / 4
+             << " SPM words, " << data_profile.spm_words_used << " used by the program)" << endl;
         
-        int mem_stalls = 0;
+        // Profile by cache block
+        map<uint32_t, Candidate> blocks;
+        for (const auto& entry : words) {
+            Candidate& block = blocks[entry.first / config.block_size * config.block_size];
+            block.loads += entry.second.loads;
+            block.stores += entry.second.stores;
+            block.stall_cycles += entry.second.stall_cycles;
+            block.eligible = block.eligible && entry.second.eligible;
+        }
+        vector<pair<uint32_t, Candidate>> hot_blocks(blocks.begin(), blocks.end());
+        sort(hot_blocks.begin(), hot_blocks.end(), [](const pair<uint32_t, Candidate>& a,
+                                                      const pair<uint32_t, Candidate>& b) {
+            return a.second.stall_cycles > b.second.stall_cycles;
+        });
+        cout << "Hottest address ranges:" << endl;
+        cout << "  " << left << setw(24) << "range" << right << setw(8) << "loads" << setw(8) << "stores"
+             << setw(10) << "stalls" << "  movable" << endl;
+        for (size_t i = 0; i < hot_blocks.size() && i < 10; i++) {
+            uint32_t start = hot_blocks[i].first;
+            const Candidate& block = hot_blocks[i].second;
+            stringstream range;
+            range << hex << setfill('0') << "0x" << setw(8) << start << "-0x" << setw(8)
+                  << start + config.block_size - 1;
+            cout << "  " << left << setw(24) << range.str() << right << setw(8) << block.loads
+                 << setw(8) << block.stores << setw(10) << block.stall_cycles
+                 << "  " << (block.eligible ? "yes" : "no") << endl;
+        }
         
-        // Handle memory operations
-        if (instr.opcode == "LD") {
-            instr.result_value = memory->read_data(CID, instr.mem_addr*4, current_cycle, mem_stalls);
-            memory_stalls += mem_stalls;
-        } 
-        else if (instr.opcode == "LDC2") {
-            if (CID == 0) {
-                instr.result_value = memory->read_data(1, instr.mem_addr*4, current_cycle, mem_stalls);
-                memory_stalls += mem_stalls;
-            }
-        } 
-        else if (instr.opcode == "LDC3") {
-            if (CID == 0) {
-                instr.result_value = memory->read_data(2, instr.mem_addr*4, current_cycle, mem_stalls);
-                memory_stalls += mem_stalls;
-            }
-        } 
-        else if (instr.opcode == "LDC4") {
-            if (CID == 0) {
-                instr.result_value = memory->read_data(3, instr.mem_addr*4, current_cycle, mem_stalls);
-                memory_stalls += mem_stalls;
-            }
-        } 
-        else if (instr.opcode == "SW") {
-            memory->write_data(CID, instr.mem_addr*4, registers[CID][instr.src_reg1], current_cycle, mem_stalls);
-            memory_stalls += mem_stalls;
+        // Profile by instruction
+        vector<int> order;
+        for (size_t i = 0; i < before.profile.size(); i++) {
+            if (before.profile[i].memory_stalls > 0) order.push_back(static_cast<int>(i));
         }
-        // SPM operations
-        else if (instr.opcode == "LW_SPM") {
-            instr.result_value = memory->read_spm(CID, instr.mem_addr*4, mem_stalls);
-            memory_stalls += mem_stalls;
+        sort(order.begin(), order.end(), [&](int a, int b) {
+            return before.profile[a].memory_stalls > before.profile[b].memory_stalls;
+        });
+        vector<string> instruction_lines;
+        for (const string& line : lines) {
+            if (!line.empty() && !is_label_line(line) && line != "\r") instruction_lines.push_back(line);
         }
-        else if (instr.opcode == "SW_SPM") {
-            memory->write_spm(CID, instr.mem_addr*4, registers[CID][instr.src_reg2], mem_stalls);
-            memory_stalls += mem_stalls;
+        cout << "Instructions with the most memory stalls:" << endl;
+        for (size_t i = 0; i < order.size() && i < 10; i++) {
+            int index = order[i];
+            string source_line = index < static_cast<int>(instruction_lines.size()) ? instruction_lines[index] : "";
+            source_line.erase(0, source_line.find_first_not_of(" \t"));
+            if (!source_line.empty() && source_line.back() == '\r') source_line.pop_back();
+            if (source_line.size() > 20) source_line = source_line.substr(0, 17) + "...";
+            cout << "  " << right << setw(5) << index << "  " << left << setw(20) << source_line << right
+                 << setw(10) << before.profile[index].memory_stalls << " stalls" << setw(6)
+                 << before.profile[index].l1_misses << " L1 misses" << endl;
         }
         
-        // Advance to WB stage
-        instr.current_stage = MEM;
-        instr.stage_complete_cycle[MEM] = current_cycle;
-        pipeline_stages[MEM].push_back(instr);
-    }
-    
-    // Process the writeback stage - write results to registers
-    void stage_writeback() {
-        if (pipeline_stages[MEM].empty()) return;
+        if (placed.empty()) {
+            cout << "No word is worth moving to the SPM: no absolute LD/SW word misses often enough "
+                 << "to pay for its setup and write-back" << endl;
+            return 0;
+        }
+        if (scratch == 0) {
+            cout << "No free register for the setup code; the program was not rewritten" << endl;
+            return 1;
+        }
         
-        Instruction instr = pipeline_stages[MEM].front();
-        pipeline_stages[MEM].pop_front();
+        long long predicted_savings = 0;
+        long long added_instructions = 0;
+        cout << "Placed words:" << endl;
+        cout << "  " << left << setw(12) << "address" << right << setw(6) << "slot" << setw(8) << "loads"
+             << setw(8) << "stores" << setw(10) << "stalls" << setw(11) << "predicted" << endl;
+        for (const auto& entry : placed) {
+            const Candidate& word = *entry.second;
+            stringstream address;
+            address << "0x" << hex << setfill('0') << setw(8) << word.address;
+            cout << "  " << left << setw(12) << address.str() << right << setw(6) << word.slot << setw(8)
+                 << word.loads << setw(8) << word.stores << setw(10) << word.stall_cycles << setw(11)
+                 << word.predicted_savings << endl;
+            predicted_savings += word.predicted_savings;
+            added_instructions += word.added_instructions;
+        }
         
-        // Write result to register file
-        if (instr.dest_reg != -1) {
-            // For most instructions, write the computed result
-            if (instr.opcode == "ADD" || instr.opcode == "SUB" || instr.opcode == "MUL" || 
-                instr.opcode == "ADDI" || instr.opcode == "LD" || 
-                instr.opcode == "LDC2" || instr.opcode == "LDC3" || instr.opcode == "LDC4" ||
-                instr.opcode == "LW_SPM") {
-                registers[CID][instr.dest_reg] = instr.result_value;
-            }
+        int rewritten = 0;
+        string output = rewrite(lines, placed, scratch, rewritten);
+        ofstream out(output_file);
+        if (!out.is_open()) {
+            cerr << "Error opening file: " << output_file << endl;
+            return 1;
         }
+        out << output;
+        out.close();
         
-        // Mark instruction as completed
-        instr.current_stage = WB;
-        instr.stage_complete_cycle[WB] = current_cycle;
-        instr.completed = true;
+        // Measurement run of the rewritten program
+        RunResult after;
+        if (!simulate(output_file, output, config, after)) return 1;
         
-        // Add to completed instructions
-        completed_instructions.push_back(instr);
-        executed_instructions++;
-    }
-    
-    // Execute one cycle of all pipeline stages
-    void execute_cycle(const vector<string>& program, unordered_map<string, int>& labels) {
-        // Execute pipeline stages in reverse order to prevent data conflicts
-        stage_writeback();
-        stage_memory();
-        stage_execute();
-        stage_decode(labels);
-        stage_fetch(program);
+        cout << "Rewrote " << rewritten << " instructions, scratch register x" << scratch << ": " << output_file << endl;
+        cout << "Predicted: " << predicted_savings << " memory stall cycles saved, "
+             << added_instructions << " instructions added" << endl;
+        cout << "Measured: memory stalls " << before.memory_stalls << " -> " << after.memory_stalls
+             << " (saved " << before.memory_stalls - after.memory_stalls << "), instructions "
+             << before.instructions << " -> " << after.instructions << ", cycles " << before.cycles
+             << " -> " << after.cycles << endl;
         
-        current_cycle++;
+        bool registers_match = true;
+        for (size_t c = 0; c < before.registers.size(); c++) {
+            for (int r = 1; r < 32; r++) {
+                if (r != scratch && before.registers[c][r] != after.registers[c][r]) registers_match = false;
+            }
+        }
+        cout << (registers_match ? "Final registers match the original program"
+                                 : "Warning: final registers differ from the original program") << endl;
+        return registers_match ? 0 : 1;
     }
+}
+
+// Simulation server (simulator --serve <socket> [workers] [checkpoints])
+// Takes jobs over a Unix domain socket so that short runs skip process start-up and the
+// loading of their configuration and programs. A loaded simulator is kept as a checkpoint,
+// after its FAST_FORWARD warm-up, in an LRU cache keyed by a hash of the configuration,
+// the prompt answers and the contents of every program it loads. Each job runs in a forked
+// worker on its own copy of the checkpoint, so jobs cannot disturb each other or the cache;
+// at most `workers` of them run at once. The accept loop never blocks on one client: it
+// reads all requests together, each with a deadline for the whole request, and missing
+// checkpoints are built one at a time on a builder thread while cached ones keep running.
+//
+// A request is a series of lines ending with RUN:
+//   CONFIG <file>                      base configuration file (optional)
+//   SET <configuration line>           override, e.g. SET MAX_CYCLES 50000 (optional, repeatable)
+//   FORWARDING <0|1>                   default 1
+//   LATENCIES <add> <sub> <mul> <div>  default 1 1 3 10
+//   PROGRAM <file>
+//   RUN
+// The reply is what an interactive run prints after its prompts, and the connection is
+// closed when the job ends. A request that cannot run gets an "ERROR <reason>" line.
+// STATS and SHUTDOWN on their own are also requests. Paths are taken relative to the
+// server's working directory.
+namespace server {
+#if defined(__unix__) || defined(__APPLE__)
+    // What one job asks for: its configuration text (the CONFIG file, then the SET lines)
+    // and the answers to the interactive prompts
+    struct Job {
+        string config_text;
+        bool forwarding = true;
+        int latencies[4] = {1, 1, 3, 10};
+        string program;
+    };
     
-    // Check if there are any instructions in the pipeline
-    bool pipeline_active() {
-        if (waiting_for_sync) return true; // Core is still active if waiting for sync
-        
-        for (int i = 0; i < 5; i++) {
-            if (!pipeline_stages[i].empty()) return true;
+    // A loaded simulator and what loading it printed, which every job using it replays
+    struct Checkpoint {
+        Simulator* sim;
+        string output;
+    };
+    
+    // FNV-1a, chained over the pieces that make up a checkpoint
+    inline uint64_t content_hash(const string& data, uint64_t hash = 14695981039346656037ULL) {
+        for (unsigned char c : data) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
         }
-        return pc < program_size;
+        return hash;
     }
     
-    // Get performance metrics
-    string get_performance_metrics() {
-        stringstream ss;
-        ss << "Core " << CID << " Performance Metrics:" << endl;
-        ss << "Total cycles: " << current_cycle << endl;
-        ss << "Instructions executed: " << executed_instructions << endl;
-        ss << "Pipeline stalls: " << stalls << endl;
-        ss << "Memory stalls: " << memory_stalls << endl;
-        ss << "Sync stalls: " << sync_stalls << endl;
+    // Checkpoints by content hash; the least recently used one goes when the cache is full
+    class CheckpointCache {
+    public:
+        size_t capacity;
+        list<uint64_t> order;  // Most recently used first
+        unordered_map<uint64_t, pair<Checkpoint, list<uint64_t>::iterator>> entries;
+        long long hits = 0;
+        long long misses = 0;
+        long long evictions = 0;
         
-        double ipc = executed_instructions > 0 ? 
-                    static_cast<double>(executed_instructions) / current_cycle : 0;
-        ss << "Instructions per cycle (IPC): " << ipc << endl;
+        explicit CheckpointCache(size_t max_checkpoints) : capacity(max<size_t>(1, max_checkpoints)) {}
         
-        return ss.str();
-    }
-    
-    // Get final cycle count
-    int get_total_cycles() {
-        return current_cycle;
-    }
-    
-    // Set program size for checking completion
-    int program_size = 0;
-};
-
-// Simulator class to manage multiple cores and their interactions
-class Simulator
-{
-public:
-    MemoryHierarchy* memory;      // Memory hierarchy (caches, main memory, SPM)
-    SyncBarrier* sync_barrier;    // Synchronization barrier for SYNC instruction
-    vector<Core> cores;           // Vector of compute units (cores)
-    vector<string> program;       // Program to execute
-    unordered_map<string, int> labels; // Label to line number mapping
-    CacheConfig config;           // Cache configuration
-
-    // Constructor to initialize the simulator with cores
-    Simulator(int num_cores, bool enable_forwarding, const CacheConfig& cache_config) 
-        : config(cache_config)
-    {
-        // Initialize memory hierarchy
-        memory = new MemoryHierarchy(config, num_cores);
+        ~CheckpointCache() {
+            for (auto& entry : entries) delete entry.second.first.sim;
+        }
         
-        // Initialize synchronization barrier
-        sync_barrier = new SyncBarrier(num_cores);
+        Checkpoint* find(uint64_t key) {
+            auto it = entries.find(key);
+            if (it == entries.end()) {
+                misses++;
+                return nullptr;
+            }
+            hits++;
+            order.splice(order.begin(), order, it->second.second);
+            return &it->second.first;
+        }
         
-        // Initialize cores
-        for (int i = 0; i < num_cores; ++i)
-        {
-            cores.emplace_back(i, enable_forwarding, memory, sync_barrier);
+        Checkpoint* insert(uint64_t key, const Checkpoint& checkpoint) {
+            if (entries.size() >= capacity) {
+                auto victim = entries.find(order.back());
+                delete victim->second.first.sim;
+                entries.erase(victim);
+                order.pop_back();
+                evictions++;
+            }
+            order.push_front(key);
+            auto& entry = entries[key];
+            entry = {checkpoint, order.begin()};
+            return &entry.first;
         }
-    }
+    };
     
-    ~Simulator() {
-        delete memory;
-        delete sync_barrier;
-    }
-
-    // Set instruction latencies for the cores
-    void set_instruction_latencies()
-    {
-        cout << "Enter latencies for ADD, SUB, MUL, DIV: ";
-        int add_lat, sub_lat, mul_lat, div_lat;
-        cin >> add_lat >> sub_lat >> mul_lat >> div_lat;
-        
-        for (auto& core : cores) {
-            core.latencies["ADD"] = add_lat;
-            core.latencies["SUB"] = sub_lat;
-            core.latencies["MUL"] = mul_lat;
-            core.latencies["DIV"] = div_lat;
-            
-            // SPM instructions have same latency as L1 cache
-            core.latencies["LW_SPM"] = config.l1_latency;
-            core.latencies["SW_SPM"] = config.l1_latency;
-            
-            // Memory instructions have variable latency based on cache hits/misses
-            core.latencies["LD"] = config.l1_latency;  // Best case (L1 hit)
-            core.latencies["SW"] = config.l1_latency;  // Best case (L1 hit)
-            
-            // Other core instruction latencies
-            core.latencies["LDC2"] = config.l1_latency;
-            core.latencies["LDC3"] = config.l1_latency;
-            core.latencies["LDC4"] = config.l1_latency;
+    inline void send_all(int client, const string& data) {
+        for (size_t sent = 0; sent < data.size(); ) {
+            ssize_t n = send(client, data.data() + sent, data.size() - sent, 0);
+            if (n <= 0) return;
+            sent += n;
         }
     }
-
-    // Load program from file and set up labels
-    bool load_program(const string &filename)
-    {
-        ifstream file(filename);
-        if (!file.is_open())
-        {
-            cerr << "Error opening file: " << filename << endl;
-            return false;
+    
+    // Settings that make a run write files; clients of the socket may not choose those paths
+    inline bool writes_files(const string& param) {
+        return param == "PIPELINE_TRACE" || param == "STATS_JSON" || param == "STATS_CSV" ||
+               param == "PROFILE_FOLDED";
+    }
+    
+    // Whole requests must arrive within this many seconds of the connection
+    static const int REQUEST_SECONDS = 10;
+    
+    // A connection whose request is still being read
+    struct Client {
+        int fd;
+        chrono::steady_clock::time_point deadline;
+        string pending;      // Received text not yet split into lines
+        string base_config;
+        string overrides;
+        Job job;
+    };
+    
+    // Apply one request line; returns RUN, STATS or SHUTDOWN once the request is complete,
+    // otherwise "" (with the reason in error if the line is not valid)
+    inline string parse_request_line(Client& client, const string& line, string& error) {
+        istringstream iss(line);
+        string command;
+        iss >> command;
+        if (command == "RUN" || command == "STATS" || command == "SHUTDOWN") {
+            client.job.config_text = client.base_config + client.overrides;
+            return command;
         }
-
-        string line;
-        int line_num = 0;
-        while (getline(file, line))
-        {
-            // Skip empty lines
-            if (line.empty()) continue;
-            
-            istringstream iss(line);
-            string first_word;
-            iss >> first_word;
-
-            if (!first_word.empty() && first_word.back() == ':')
-            {
-                first_word.pop_back();
-                labels[first_word] = line_num;
+        bool valid = true;
+        if (command == "CONFIG") {
+            string file;
+            iss >> file;
+            ifstream in(file);
+            if (!in.is_open()) {
+                error = "cannot open configuration file " + file;
+                return "";
             }
-            else
-            {
-                program.push_back(line);
-                line_num++;
+            client.base_config.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            client.base_config += "\n";
+        } else if (command == "SET") {
+            string setting, param;
+            getline(iss >> ws, setting);
+            istringstream(setting) >> param;
+            if (writes_files(param)) {
+                error = param + " cannot be set in a server job";
+                return "";
             }
+            client.overrides += setting + "\n";
+        } else if (command == "FORWARDING") {
+            valid = static_cast<bool>(iss >> client.job.forwarding);
+        } else if (command == "LATENCIES") {
+            for (int& latency : client.job.latencies) valid = valid && (iss >> latency) && latency > 0;
+        } else if (command == "PROGRAM") {
+            valid = static_cast<bool>(iss >> client.job.program);
+        } else {
+            valid = command.empty();
+        }
+        if (!valid) error = "malformed request line: " + line;
+        return "";
+    }
+    
+    // A checkpoint being built, and the jobs waiting for it
+    struct Build {
+        uint64_t key;
+        Job job;
+        CacheConfig config;
+        vector<uint8_t> image;
+        vector<pair<int, string>> waiting; // Client and what parsing its configuration printed
+        Simulator* sim = nullptr;
+        string output;                     // What loading printed
+    };
+    
+    // Parse the job's configuration and hash everything its checkpoint depends on. Warnings go
+    // to prelude; false (with the reason in error) if the job cannot run. Runs on the accept
+    // loop, so it only reads files and never touches cout or cerr
+    inline bool plan(const Job& job, CacheConfig& config, uint64_t& key, vector<uint8_t>& image,
+                     string& prelude, string& error) {
+        if (job.program.empty()) {
+            error = "no PROGRAM given";
+            return false;
         }
-        file.close();
         
-        // Set program size for all cores
-        for (auto& core : cores) {
-            core.program_size = program.size();
+        ostringstream warnings;
+        istringstream text(job.config_text);
+        config.load(text, warnings);
+        prelude = warnings.str();
+        if (!config.pipeline_trace.empty() || !config.stats_json.empty() || !config.stats_csv.empty() ||
+            !config.profile_folded.empty()) {
+            error = "server jobs cannot write trace, stats or profile files";
+            return false;
         }
         
-        return true;
-    }
-
-    // Display pipeline stage information
-    void display_pipeline_info() {
-        for (size_t i = 0; i < cores.size(); ++i) {
-            cout << "\nCore " << i << " Pipeline Information:" << endl;
-            cout << "Cycle: " << cores[i].current_cycle << endl;
-            
-            // Show instructions in each stage
-            string stage_names[5] = {"IF", "ID", "EX", "MEM", "WB"};
-            for (int s = 0; s < 5; s++) {
-                cout << stage_names[s] << " Stage: ";
-                if (cores[i].pipeline_stages[s].empty()) {
-                    cout << "Empty" << endl;
-                } else {
-                    auto& instr = cores[i].pipeline_stages[s].front();
-                    cout << instr.opcode;
-                    if (instr.dest_reg != -1) cout << " x" << instr.dest_reg;
-                    if (instr.src_reg1 != -1) cout << " x" << instr.src_reg1;
-                    if (instr.src_reg2 != -1) cout << " x" << instr.src_reg2;
-                    if (!instr.label.empty()) cout << " " << instr.label;
-                    cout << endl;
-                }
+        string settings = job.config_text + '\0' + to_string(job.forwarding);
+        for (int latency : job.latencies) settings += ' ' + to_string(latency);
+        key = content_hash(settings);
+        
+        vector<string> files{job.program};
+        for (const auto& program : config.core_programs) files.push_back(program.file);
+        for (size_t i = 0; i < files.size(); i++) {
+            ifstream file(files[i], ios::binary);
+            if (!file.is_open()) {
+                error = "cannot open program " + files[i];
+                return false;
             }
+            string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+            key = content_hash(files[i] + '\0' + contents + '\0', key);
+            if (i == 0) image.assign(contents.begin(), contents.end());
         }
+        return true;
     }
-
-    // Display performance metrics and statistics
-    void display_stats()
-    {
-        cout << "\n===== Performance Statistics =====\n";
+    
+    // Builder thread: load the simulator and run its warm-up. Only one build runs at a time,
+    // and it alone borrows cout and cerr to capture what loading prints; done is written to
+    // wake the accept loop
+    inline void build(Build* job, int done) {
+        ostringstream captured;
+        streambuf* saved_out = cout.rdbuf(captured.rdbuf());
+        streambuf* saved_err = cerr.rdbuf(captured.rdbuf());
         
-         cores[0].registers[0][0]=5050;
-        for (size_t i = 0; i < cores.size(); ++i)
-        {
-            cout << "\n" << cores[i].get_performance_metrics() << endl;
-            
-            cout << "Register States:\n";
-            for (int j = 0; j < 32; ++j)
-            {
-                cout << "x" << j << ": " << cores[i].registers[i][j] << "  ";
-                if (j % 8 == 7) cout << endl;
-            }
-            cout << endl;
+        Simulator* sim = new Simulator(job->config.num_cores, job->job.forwarding, job->config);
+        const int* latencies = job->job.latencies;
+        sim->set_instruction_latencies(latencies[0], latencies[1], latencies[2], latencies[3]);
+        if (sim->load_program(job->job.program, job->image)) {
+            sim->fast_forward();
+            job->sim = sim;
+        } else {
+            delete sim;
         }
         
-        // Display cache statistics
-        cout << "\n" << memory->get_stats() << endl;
-        
-        // Calculate and display overall system performance
-        int total_cycles = 0;
-        int total_instructions = 0;
-        int total_stalls = 0;
+        cout.rdbuf(saved_out);
+        cerr.rdbuf(saved_err);
+        job->output = captured.str();
+        char byte = 1;
+        while (write(done, &byte, 1) < 0 && errno == EINTR) {}
+    }
+    
+    inline int run(const string& socket_path, int workers, int checkpoints) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            cerr << "Socket path too long: " << socket_path << endl;
+            return 1;
+        }
+        strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
         
-        for (const auto& core : cores) {
-            total_cycles = max(total_cycles, core.current_cycle);
-            total_instructions += core.executed_instructions;
-            total_stalls += core.stalls;
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path.c_str());
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+            listen(listener, 64) < 0) {
+            cerr << "Cannot listen on " << socket_path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        int wake[2];
+        if (pipe(wake) < 0) {
+            cerr << "Cannot create a pipe: " << strerror(errno) << endl;
+            return 1;
         }
+        // A client that hangs up only ends its own worker
+        signal(SIGPIPE, SIG_IGN);
+        cout << "Serving on " << socket_path << " with " << workers << " workers and "
+             << checkpoints << " checkpoints" << endl;
+        // Workers may be forked while a build has cout and cerr borrowed
+        streambuf* stdout_buffer = cout.rdbuf();
+        streambuf* stderr_buffer = cerr.rdbuf();
         
-        double system_ipc = static_cast<double>(total_instructions) / total_cycles;
-        cout << "System-wide metrics:" << endl;
-        cout << "Total cycles: " << total_cycles << endl;
-        cout << "Total instructions: " << total_instructions << endl;
-        cout << "Total stalls: " << total_stalls << endl;
-        cout << "System IPC: " << system_ipc << endl;
-    }
-
-    // Run the program on all cores
-    void run()
-    {
-        bool display_pipeline = false;
-        cout << "Enable pipeline display? (1 for Yes, 0 for No): ";
-        cin >> display_pipeline;
+        CheckpointCache cache(checkpoints);
+        vector<Client> clients;                   // Requests being read
+        deque<pair<int, uint64_t>> ready;         // Jobs with a checkpoint, waiting for a worker
+        map<int, string> preludes;                // What each ready job's configuration printed
+        deque<Build*> builds;                     // Front one is building when builder runs
+        thread builder;
+        int running = 0;
+        long long jobs = 0;
+        long long rejected = 0;
+        bool stopping = false;
         
-        int cycle_limit = 10000; // Prevent infinite loops
-        int cycle = 0;
+        auto reject = [&](int client, const string& reply) {
+            send_all(client, reply);
+            close(client);
+            rejected++;
+        };
+        auto reap = [&]() {
+            while (running > 0 && waitpid(-1, nullptr, WNOHANG) > 0) running--;
+        };
+        auto start_build = [&]() {
+            if (!builder.joinable() && !builds.empty()) builder = thread(build, builds.front(), wake[1]);
+        };
         
-        while (cycle < cycle_limit)
-        {
-            bool all_done = true;
-            for (auto &core : cores)
-            {
-                if (core.pipeline_active()) {
-                    core.execute_cycle(program, labels);
-                    all_done = false;
+        while (!stopping || !builds.empty() || !ready.empty()) {
+            // Hand ready jobs to free workers
+            reap();
+            while (!ready.empty() && running < workers) {
+                auto [client, key] = ready.front();
+                ready.pop_front();
+                string prelude = preludes[client];
+                preludes.erase(client);
+                auto entry = cache.entries.find(key);
+                if (entry == cache.entries.end()) {
+                    reject(client, prelude + "ERROR checkpoint evicted before the job started\n");
+                    continue;
+                }
+                Checkpoint* checkpoint = &entry->second.first;
+                
+                fflush(stdout);
+                pid_t pid = fork();
+                if (pid == 0) {
+                    // Worker: the job's output goes straight to the client
+                    signal(SIGPIPE, SIG_DFL);
+                    cout.rdbuf(stdout_buffer);
+                    cerr.rdbuf(stderr_buffer);
+                    close(listener);
+                    close(wake[0]);
+                    close(wake[1]);
+                    for (const auto& other : clients) close(other.fd);
+                    for (const auto& other : ready) close(other.first);
+                    for (const Build* pending : builds) {
+                        for (const auto& waiting : pending->waiting) close(waiting.first);
+                    }
+                    dup2(client, STDOUT_FILENO);
+                    dup2(client, STDERR_FILENO);
+                    close(client);
+                    cout << prelude << checkpoint->output;
+                    checkpoint->sim->run(false, true);
+                    cout.flush();
+                    fflush(stdout);
+                    _exit(0);
+                }
+                if (pid < 0) {
+                    reject(client, prelude + "ERROR cannot start a worker: " + strerror(errno) + "\n");
+                    continue;
                 }
+                running++;
+                jobs++;
+                close(client);
             }
             
-            if (display_pipeline && cycle % 5 == 0) {
-                display_pipeline_info();
-            }
+            vector<pollfd> polled{{wake[0], POLLIN, 0}};
+            bool listening = !stopping;
+            if (listening) polled.push_back({listener, POLLIN, 0});
+            for (const auto& client : clients) polled.push_back({client.fd, POLLIN, 0});
             
-            if (all_done)
+            // Wake for the earliest request deadline, and poll for finished workers while jobs wait
+            auto now = chrono::steady_clock::now();
+            int timeout = ready.empty() ? -1 : 50;
+            for (const auto& client : clients) {
+                auto left = chrono::duration_cast<chrono::milliseconds>(client.deadline - now).count();
+                int wait = static_cast<int>(max<long long>(0, left));
+                timeout = timeout < 0 ? wait : min(timeout, wait);
+            }
+            if (poll(polled.data(), polled.size(), timeout) < 0 && errno != EINTR) {
+                cerr << "Poll failed: " << strerror(errno) << endl;
                 break;
+            }
+            
+            // A finished build fills the cache and releases the jobs waiting for it
+            if (polled[0].revents & POLLIN) {
+                char byte;
+                while (read(wake[0], &byte, 1) < 0 && errno == EINTR) {}
+                builder.join();
+                Build* done = builds.front();
+                builds.pop_front();
+                if (done->sim) {
+                    cache.insert(done->key, {done->sim, done->output});
+                    for (const auto& waiting : done->waiting) {
+                        ready.push_back({waiting.first, done->key});
+                        preludes[waiting.first] = waiting.second;
+                    }
+                } else {
+                    for (const auto& waiting : done->waiting) {
+                        reject(waiting.first, waiting.second + done->output + "ERROR cannot load program " +
+                                              done->job.program + "\n");
+                    }
+                }
+                delete done;
+                start_build();
+            }
+            
+            if (listening && !stopping && (polled[1].revents & POLLIN)) {
+                int client = accept(listener, nullptr, nullptr);
+                if (client >= 0) {
+                    clients.push_back({client, chrono::steady_clock::now() + chrono::seconds(REQUEST_SECONDS),
+                                       "", "", "", Job()});
+                } else if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+                    cerr << "Accept failed: " << strerror(errno) << endl;
+                    stopping = true;
+                }
+            }
+            
+            // Read what has arrived; a request completes, fails or runs out of time
+            now = chrono::steady_clock::now();
+            size_t first_client = listening ? 2 : 1;
+            vector<Client> still_reading;
+            for (size_t i = 0; i < clients.size(); i++) {
+                Client& client = clients[i];
+                string error;
+                string command;
+                size_t slot = first_client + i;
+                bool readable = slot < polled.size() && polled[slot].fd == client.fd &&
+                                (polled[slot].revents & (POLLIN | POLLHUP | POLLERR));
+                if (readable) {
+                    char buffer[4096];
+                    ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+                    if (n > 0) client.pending.append(buffer, n);
+                    else if (n == 0 || errno != EINTR) error = "request ended before RUN";
+                }
+                for (size_t end; command.empty() && error.empty() && (end = client.pending.find('\n')) != string::npos; ) {
+                    string line = client.pending.substr(0, end);
+                    client.pending.erase(0, end + 1);
+                    if (!line.empty() && line.back() == '\r') line.pop_back();
+                    command = parse_request_line(client, line, error);
+                }
+                if (command.empty() && error.empty()) {
+                    if (stopping) error = "server shutting down";
+                    else if (now >= client.deadline) error = "request not complete within " + to_string(REQUEST_SECONDS) + " seconds";
+                }
+                if (command.empty() && error.empty()) {
+                    still_reading.push_back(move(client));
+                    continue;
+                }
                 
-            cycle++;
+                if (!error.empty()) {
+                    reject(client.fd, "ERROR " + error + "\n");
+                } else if (command == "STATS") {
+                    reap();
+                    ostringstream stats;
+                    stats << "Jobs: " << jobs << " run, " << rejected << " rejected, " << running << " running, "
+                          << ready.size() << " waiting for a worker\n"
+                          << "Checkpoints: " << cache.entries.size() << "/" << cache.capacity << ", "
+                          << cache.hits << " hits, " << cache.misses << " misses, " << cache.evictions << " evictions, "
+                          << builds.size() << " building\n";
+                    send_all(client.fd, stats.str());
+                    close(client.fd);
+                } else if (command == "SHUTDOWN") {
+                    send_all(client.fd, "OK\n");
+                    close(client.fd);
+                    stopping = true;
+                } else {
+                    // RUN: start at once on a cached checkpoint, or wait for it to be built
+                    Build* job = new Build{0, client.job, CacheConfig(), {}, {}, nullptr, ""};
+                    string prelude;
+                    if (!plan(job->job, job->config, job->key, job->image, prelude, error)) {
+                        reject(client.fd, prelude + "ERROR " + error + "\n");
+                        delete job;
+                    } else if (cache.find(job->key)) {
+                        ready.push_back({client.fd, job->key});
+                        preludes[client.fd] = prelude;
+                        delete job;
+                    } else {
+                        auto same = find_if(builds.begin(), builds.end(),
+                                            [&](const Build* pending) { return pending->key == job->key; });
+                        if (same != builds.end()) {
+                            (*same)->waiting.push_back({client.fd, prelude});
+                            delete job;
+                        } else {
+                            job->waiting.push_back({client.fd, prelude});
+                            builds.push_back(job);
+                            start_build();
+                        }
+                    }
+                }
+            }
+            clients.swap(still_reading);
         }
         
-        display_stats();
+        for (const auto& client : clients) close(client.fd);
+        while (running > 0 && wait(nullptr) > 0) running--;
+        close(wake[0]);
+        close(wake[1]);
+        close(listener);
+        unlink(socket_path.c_str());
+        cout << "Served " << jobs << " jobs, " << cache.hits << " checkpoint hits" << endl;
+        return 0;
     }
-};
+#else
+    inline int run(const string&, int, int) {
+        cerr << "The simulation server needs Unix domain sockets" << endl;
+        return 1;
+    }
+#endif
+}
 
-int main()
+int main(int argc, char* argv[])
 {
+    // Benchmark mode: simulator --bench [repetitions] [warmup]
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        int repetitions = argc > 2 ? max(1, atoi(argv[2])) : 5;
+        int warmup = argc > 3 ? max(0, atoi(argv[3])) : 1;
+        return bench::run(repetitions, warmup);
+    }
+    
+    // SPM allocation: simulator --spm-alloc <program.asm> [output.asm] [config]
+    if (argc > 2 && string(argv[1]) == "--spm-alloc") {
+        return spm_alloc::run(argv[2], argc > 3 ? argv[3] : "", argc > 4 ? argv[4] : "");
+    }
+    
+    // Simulation server: simulator --serve <socket> [workers] [checkpoints]
+    if (argc > 2 && string(argv[1]) == "--serve") {
+        int workers = argc > 3 ? max(1, atoi(argv[3])) : max(1, static_cast<int>(thread::hardware_concurrency()));
+        int checkpoints = argc > 4 ? max(1, atoi(argv[4])) : 16;
+        return server::run(argv[2], workers, checkpoints);
+    }
+    
     // Load cache configuration
     CacheConfig config;
     string config_file;
@@ -1355,7 +7834,7 @@ int main()
     
     // Get simulation parameters
     bool enable_forwarding;
-    int num_cores = 4;
+    int num_cores = config.num_cores;
     cout << "Enable data forwarding? (1 for Yes, 0 for No): ";
     cin >> enable_forwarding;
 